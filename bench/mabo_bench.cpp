@@ -0,0 +1,304 @@
+#include <mabo/binary.hpp>
+#include <mabo/context.hpp>
+#include <mabo/corpus.hpp>
+#include <mabo/linkline.hpp>
+#include <mabo/symbol_columns.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+// synthetic link sets written with write_corpus() under TMPDIR, removed again on exit
+struct corpora
+{
+    corpora()
+    {
+        char const* tmp = std::getenv("TMPDIR");
+        root = std::string(tmp && *tmp ? tmp : "/tmp") + "/mabo-bench-XXXXXX";
+        if(!::mkdtemp(&root[0]))
+            throw std::runtime_error("cannot create a temporary directory");
+    }
+
+    ~corpora()
+    {
+        for(auto const& sized : generated)
+        {
+            for(std::string const& file : sized.second)
+                ::unlink(file.c_str());
+            ::rmdir(dir(sized.first).c_str());
+        }
+        ::rmdir(root.c_str());
+    }
+
+    // n objects, a quarter of them loose and the rest in four archives,
+    // and a chain of two shared libraries
+    std::vector<std::string> const& get(size_t n)
+    {
+        auto it = generated.find(n);
+        if(it == generated.end())
+        {
+            mabo::corpus_options options;
+            options.objects = n;
+            options.loose = n / 4;
+            options.archives = 4;
+            options.shared = 2;
+            it = generated.emplace(n, mabo::write_corpus(dir(n), options)).first;
+        }
+        return it->second;
+    }
+
+    std::string dir(size_t n) const
+    {
+        return root + "/" + std::to_string(n);
+    }
+
+    std::string root;
+    std::map<size_t, std::vector<std::string>> generated;
+};
+
+// a link set of n objects, then whatever MABO_BENCH_FILES lists, colon
+// separated, so a real workload can be measured before and after an upgrade
+std::vector<std::string> files(size_t n)
+{
+    static corpora generated;
+    std::vector<std::string> result = generated.get(n);
+
+    if(char const* extra = std::getenv("MABO_BENCH_FILES"))
+    {
+        std::string list = extra;
+        for(size_t first = 0, last; first < list.size(); first = last + 1)
+        {
+            last = std::min(list.find(':', first), list.size());
+            if(last != first)
+                result.push_back(list.substr(first, last - first));
+        }
+    }
+    return result;
+}
+
+void rate(benchmark::State& state, char const* name, size_t count)
+{
+    state.counters[name] = benchmark::Counter(double(count), benchmark::Counter::kIsRate);
+}
+
+// of the whole process so far, runs don't shrink it
+void peak_rss(benchmark::State& state)
+{
+    struct rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    state.counters["peak_rss"] = benchmark::Counter(double(usage.ru_maxrss) * 1024, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+}
+
+// objects in the link set
+void sizes(benchmark::internal::Benchmark* b)
+{
+    for(int n : {16, 256, 4096})
+        b->Arg(n);
+}
+
+void binary(benchmark::State& state)
+{
+    std::vector<std::string> inputs = files(state.range(0));
+    size_t objects = 0;
+    for(auto _ : state)
+    {
+        for(std::string const& file : inputs)
+        {
+            mabo::binary bin(file);
+            for(mabo::object const& obj : bin.objects())
+                benchmark::DoNotOptimize(obj.name().data()), ++objects;
+        }
+    }
+    rate(state, "objects/s", objects);
+    peak_rss(state);
+}
+BENCHMARK(binary)->Apply(sizes);
+
+void symbols(benchmark::State& state)
+{
+    std::vector<std::string> inputs = files(state.range(0));
+    size_t objects = 0;
+    size_t symbols = 0;
+    for(auto _ : state)
+    {
+        // fresh binaries, symbol tables are loaded once per object
+        state.PauseTiming();
+        std::vector<mabo::binary> bins(inputs.begin(), inputs.end());
+        state.ResumeTiming();
+
+        for(mabo::binary const& bin : bins)
+        {
+            for(mabo::object const& obj : bin.objects())
+            {
+                for(auto const& sym : obj.symbols())
+                    benchmark::DoNotOptimize(sym.name().data()), ++symbols;
+                for(auto const& sym : obj.imports())
+                    benchmark::DoNotOptimize(sym.name().data()), ++symbols;
+                ++objects;
+            }
+        }
+    }
+    rate(state, "objects/s", objects);
+    rate(state, "symbols/s", symbols);
+    peak_rss(state);
+}
+BENCHMARK(symbols)->Apply(sizes);
+
+void section_data(benchmark::State& state)
+{
+    std::vector<mabo::binary> bins;
+    for(std::string const& file : files(state.range(0)))
+        bins.emplace_back(file);
+
+    size_t bytes = 0;
+    for(auto _ : state)
+    {
+        for(mabo::binary const& bin : bins)
+        {
+            for(mabo::object const& obj : bin.objects())
+            {
+                for(mabo::section const& sec : obj.sections())
+                {
+                    unsigned char sum = 0;
+                    for(char c : sec.data<char>())
+                        sum += c, ++bytes;
+                    benchmark::DoNotOptimize(sum);
+                }
+            }
+        }
+    }
+    state.SetBytesProcessed(bytes);
+    peak_rss(state);
+}
+BENCHMARK(section_data)->Apply(sizes);
+
+void load_dynamic(benchmark::State& state)
+{
+    // the libraries' DT_NEEDED chain is walked again every time
+    std::vector<std::string> inputs = files(state.range(0));
+
+    size_t objects = 0;
+    for(auto _ : state)
+    {
+        mabo::context ctx;
+        for(std::string const& file : inputs)
+            ctx.load_file(file);
+        ctx.load_dynamic();
+        for(mabo::binary const& bin : ctx.binaries())
+            benchmark::DoNotOptimize(bin.name().data()), ++objects;
+    }
+    rate(state, "objects/s", objects);
+    peak_rss(state);
+}
+BENCHMARK(load_dynamic)->Apply(sizes);
+
+// every object of a context loaded once, so the resolver is what is measured
+struct loaded
+{
+    explicit loaded(size_t n)
+    {
+        for(std::string const& file : files(n))
+            ctx.load_file(file);
+
+        for(mabo::binary const& bin : ctx.binaries())
+        {
+            for(mabo::object const& obj : bin.objects())
+            {
+                for(auto const& sym : obj.symbols())
+                    (void)sym, ++symbols;
+                for(auto const& sym : obj.imports())
+                    (void)sym, ++symbols;
+                ++objects;
+            }
+        }
+    }
+
+    mabo::context ctx;
+    size_t objects = 0;
+    size_t symbols = 0;
+};
+
+void dependencies(benchmark::State& state)
+{
+    loaded input(state.range(0));
+    mabo::granularity::type level = mabo::granularity::type(state.range(1));
+
+    size_t runs = 0;
+    for(auto _ : state)
+    {
+        mabo::resolution result = input.ctx.dependencies(true, level);
+        benchmark::DoNotOptimize(result.dependencies.edge_count());
+        ++runs;
+    }
+    rate(state, "objects/s", runs * input.objects);
+    rate(state, "symbols/s", runs * input.symbols);
+    peak_rss(state);
+}
+BENCHMARK(dependencies)->Apply([](benchmark::internal::Benchmark* b)
+{
+    for(int n : {16, 256, 4096})
+        for(int level : {mabo::granularity::BINARY, mabo::granularity::OBJECT, mabo::granularity::SECTION})
+            b->Args({n, level});
+});
+
+void linkline(benchmark::State& state)
+{
+    loaded input(state.range(0));
+    mabo::dependency_graph graph = input.ctx.dependencies(true, mabo::granularity::OBJECT).dependencies;
+
+    size_t nodes = 0;
+    for(auto _ : state)
+    {
+        std::string line = mabo::linkline(graph);
+        benchmark::DoNotOptimize(line.data());
+        nodes += graph.size();
+    }
+    rate(state, "objects/s", nodes);
+    peak_rss(state);
+}
+BENCHMARK(linkline)->Apply(sizes);
+
+void select(benchmark::State& state)
+{
+    std::vector<mabo::binary> bins;
+    for(std::string const& file : files(state.range(0)))
+        bins.emplace_back(file);
+
+    mabo::symbol_columns columns;
+    for(mabo::binary const& bin : bins)
+        for(mabo::object const& obj : bin.objects())
+            columns.add(obj);
+
+    // global defined functions in .text
+    mabo::symbol_filter filter;
+    filter.binds = mabo::bind_bit(STB_GLOBAL);
+    filter.types = mabo::type_bit(STT_FUNC);
+    filter.section = ".text";
+    filter.min_size = 1;
+    filter.imports = false;
+
+    size_t symbols = 0;
+    for(auto _ : state)
+    {
+        std::vector<uint32_t> result = columns.select(filter);
+        benchmark::DoNotOptimize(result.data());
+        symbols += columns.size();
+    }
+    rate(state, "symbols/s", symbols);
+    peak_rss(state);
+}
+BENCHMARK(select)->Apply(sizes);
+
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,61 @@
+#include <mabo/corpus.hpp>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+// writes a synthetic link set, prints the files in link order
+int main(int argc, char* argv[])
+{
+    mabo::corpus_options options;
+    std::string dir;
+
+    struct numeric
+    {
+        char const* name;
+        size_t mabo::corpus_options::* field;
+    };
+    numeric const numerics[] = {
+        {"--objects=", &mabo::corpus_options::objects},
+        {"--symbols=", &mabo::corpus_options::symbols},
+        {"--name-length=", &mabo::corpus_options::name_length},
+        {"--fanout=", &mabo::corpus_options::fanout},
+        {"--loose=", &mabo::corpus_options::loose},
+        {"--archives=", &mabo::corpus_options::archives},
+        {"--shared=", &mabo::corpus_options::shared},
+        {"--shared-fanout=", &mabo::corpus_options::shared_fanout},
+        {"--duplicates=", &mabo::corpus_options::duplicates}
+    };
+
+    for(int i = 1; i < argc; ++i)
+    {
+        char const* arg = argv[i];
+        bool known = false;
+        for(numeric const& n : numerics)
+        {
+            if(!std::strncmp(arg, n.name, std::strlen(n.name)))
+            {
+                options.*n.field = std::strtoul(arg + std::strlen(n.name), 0, 10);
+                known = true;
+            }
+        }
+
+        if(known)
+            continue;
+        else if(!std::strcmp(arg, "--cycles"))
+            options.cycles = true;
+        else if(!std::strncmp(arg, "--seed=", 7))
+            options.seed = std::strtoull(arg + 7, 0, 10);
+        else
+            dir = arg;
+    }
+
+    if(dir.empty())
+    {
+        std::cerr << "usage: " << argv[0] << " [--objects=N] [--symbols=N] [--name-length=N] [--fanout=N] [--loose=N]"
+                  << " [--archives=N] [--shared=N] [--shared-fanout=N] [--duplicates=N] [--cycles] [--seed=N] DIR\n";
+        return 1;
+    }
+
+    for(std::string const& file : mabo::write_corpus(dir, options))
+        std::cout << file << "\n";
+}
@@ -1,13 +1,108 @@
 #include <mabo/binary.hpp>
+#include <mabo/bloat.hpp>
 #include <mabo/context.hpp>
+#include <mabo/gc_sections.hpp>
+#include <mabo/grep.hpp>
 #include <mabo/linkline.hpp>
+#include <mabo/stats.hpp>
+#include <fstream>
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+// mabo grep [-E] [-jN] [--defined|--undefined] pattern files...
+// exits like grep: 0 with matches, 1 without, 2 when a file was unreadable
+int grep(int argc, char* argv[])
+{
+    mabo::grep_options options;
+    std::vector<std::string> files;
+    bool pattern = false;
+    for(const char* arg : ranges::make_iterator_range(argv, argv+argc))
+    {
+        if(!std::strcmp(arg, "-E"))
+            options.regex = true;
+        else if(!std::strncmp(arg, "-j", 2))
+            options.threads = std::strtoul(arg + 2, 0, 10);
+        else if(!std::strcmp(arg, "--defined"))
+            options.undefined = false;
+        else if(!std::strcmp(arg, "--undefined"))
+            options.defined = false;
+        else if(!pattern)
+        {
+            options.pattern = arg;
+            pattern = true;
+        }
+        else
+            files.push_back(arg);
+    }
+
+    mabo::grep_result result = mabo::grep(files, options);
+    for(mabo::grep_match const& match : result.matches)
+    {
+        char kind = match.undefined ? 'U' : match.bind == STB_WEAK ? 'W' : match.bind == STB_LOCAL ? 'L' : 'D';
+        std::cout << match.file;
+        if(!match.member.empty())
+            std::cout << "(" << match.member << ")";
+        std::cout << " " << kind << " " << match.name << "\n";
+    }
+    for(auto const& skipped : result.skipped)
+        std::cerr << "mabo: " << skipped.first << ": " << skipped.second << "\n";
+
+    return !result.matches.empty() ? 0 : result.skipped.empty() ? 1 : 2;
+}
 
 int main(int argc, char* argv[])
 {
+    if(argc > 1 && !std::strcmp(argv[1], "grep"))
+        return grep(argc - 2, argv + 2);
+
     mabo::context ctx;
+    mabo::string_view format = "text";
+    std::string response_file;
+    mabo::granularity::type level = mabo::granularity::BINARY;
+    bool gc_sections = false;
+    size_t bloat = 0;
+    bool demangle = false;
+    bool stats = false;
+    std::string trace_file;
     for(const char* arg : ranges::make_iterator_range(argv+1, argv+argc))
-        ctx.load_file(arg);
+    {
+        // -jN resolves on N threads, -j on all cores
+        if(!std::strncmp(arg, "-j", 2))
+            ctx.threads(std::strtoul(arg + 2, 0, 10));
+        else if(!std::strncmp(arg, "--cache=", 8))
+            ctx.cache(arg + 8);
+        // text, json or count
+        else if(!std::strncmp(arg, "--diagnostics=", 14))
+            format = arg + 14;
+        else if(!std::strncmp(arg, "--response-file=", 16))
+            response_file = arg + 16;
+        else if(!std::strcmp(arg, "--objects"))
+            level = mabo::granularity::OBJECT;
+        else if(!std::strcmp(arg, "--sections"))
+            level = mabo::granularity::SECTION;
+        // bytes --gc-sections would keep and drop
+        else if(!std::strcmp(arg, "--gc-sections"))
+            gc_sections = true;
+        else if(!std::strcmp(arg, "--demangle"))
+            demangle = true;
+        // the N largest symbols, sections, objects and namespaces
+        else if(!std::strcmp(arg, "--bloat"))
+            bloat = 20;
+        else if(!std::strncmp(arg, "--bloat=", 8))
+            bloat = std::strtoul(arg + 8, 0, 10);
+        // counters and phase times on stderr, needs MABO_WITH_STATS
+        else if(!std::strcmp(arg, "--stats"))
+            stats = true;
+        // phases from here on as a Chrome trace, give it before the inputs
+        else if(!std::strncmp(arg, "--trace=", 8))
+        {
+            trace_file = arg + 8;
+            mabo::stats::trace();
+        }
+        else
+            ctx.load_file(arg);
+    }
     ctx.load_dynamic();
 
     for(mabo::binary const& bin : ctx.binaries())
@@ -56,6 +151,79 @@ int main(int argc, char* argv[])
         }
     }
 
+    mabo::resolution result = ctx.dependencies(true, level);
+
+    if(format == "json")
+        result.diagnostics.report(mabo::json_sink(std::cout));
+    else if(format == "count")
+    {
+        for(int kind = 0; kind != mabo::diagnostic::KINDS; ++kind)
+            std::cout << mabo::diagnostic::kind_name(mabo::diagnostic::kind_type(kind)) << " "
+                      << result.diagnostics.count(mabo::diagnostic::kind_type(kind)) << "\n";
+    }
+    else if(demangle)
+    {
+        std::vector<mabo::string_pool::id_type> ids;
+        for(mabo::diagnostic const& d : result.diagnostics)
+            if(!d.symbol.empty())
+                ids.push_back(ctx.names().find(d.symbol));
+        ctx.demangled().demangle(ids, ctx.threads());
+        result.diagnostics.report(mabo::text_sink(std::cout, ctx.demangled()));
+    }
+    else
+        result.diagnostics.report(mabo::text_sink(std::cout));
+
     std::cout << "\ndependencies:\n";
-    std::cout << mabo::linkline(ctx.dependencies(true)) << std::endl;
-}
\ No newline at end of file
+    mabo::linkline(std::cout, result.dependencies);
+    std::cout << std::endl;
+
+    if(!response_file.empty())
+        mabo::linkline_response_file(response_file, result.dependencies);
+
+    if(gc_sections)
+    {
+        mabo::gc_options options;
+        options.whole_archive = true;
+        mabo::gc_report report = mabo::gc_sections(ctx, options);
+
+        std::cout << "\ngc sections:\n";
+        for(mabo::gc_usage const& usage : report.objects)
+            std::cout << usage.name << " " << usage.reachable << " " << usage.unreachable << "\n";
+        for(mabo::gc_usage const& usage : report.archives)
+            std::cout << usage.name << " " << usage.reachable << " " << usage.unreachable << "\n";
+        std::cout << "total " << report.reachable_bytes << " " << report.unreachable_bytes << "\n";
+    }
+
+    if(bloat)
+    {
+        mabo::bloat sizes(bloat);
+        for(mabo::binary const& bin : ctx.binaries())
+            sizes.add(bin);
+        mabo::bloat_report report = sizes.report();
+
+        auto print = [](char const* title, std::vector<mabo::bloat_entry> const& entries)
+        {
+            std::cout << "\n" << title << ":\n";
+            for(mabo::bloat_entry const& entry : entries)
+                std::cout << entry.size << " " << entry.count << " " << (entry.name.empty() ? "(global)" : entry.name) << "\n";
+        };
+        print("largest symbols", report.symbols);
+        print("largest sections", report.sections);
+        print("unattributed", report.unattributed);
+        print("largest objects", report.objects);
+        print("largest namespaces", report.scopes);
+        std::cout << "total " << report.size << " " << report.count << " of " << report.section_size << "\n";
+    }
+
+    if((stats || !trace_file.empty()) && !mabo::stats::enabled())
+        std::cerr << "mabo: built without MABO_WITH_STATS, nothing was recorded\n";
+
+    if(stats)
+        mabo::stats::print(std::cerr);
+
+    if(!trace_file.empty())
+    {
+        std::ofstream out(trace_file);
+        mabo::stats::write_trace(out);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef MABO_BINARY_ARMAP_HPP_INCLUDED
+#define MABO_BINARY_ARMAP_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+#include <mabo/binary.hpp>
+
+#include <cstdint>
+#include <unordered_map>
+
+namespace mabo { namespace detail
+{
+
+// for each armap entry of ar, the position in ar.objects() of the member
+// defining it, none when it isn't one of them; offsets holds offset() of
+// every object in that order
+//
+// members are told apart by where they start in the file, so repeated
+// member names don't matter; each member the index points at is opened once
+inline vector<optional<uint32_t>> armap_objects(mabo::archive const& ar, vector<size_t> const& offsets)
+{
+    std::unordered_map<size_t, uint32_t> positions;
+    for(uint32_t i = 0; i != offsets.size(); ++i)
+        positions.emplace(offsets[i], i);
+
+    auto const& armap = ar.armap();
+    std::unordered_map<size_t, optional<uint32_t>> members;
+    vector<optional<uint32_t>> objects;
+    objects.reserve(armap.size());
+    for(size_t i = 0; i != armap.size(); ++i)
+    {
+        auto it = members.find(armap[i].member);
+        if(it == members.end())
+        {
+            optional<uint32_t> object;
+            if(optional<mabo::object> obj = ar.armap_member(i))
+            {
+                auto p = positions.find(obj->offset());
+                if(p != positions.end())
+                    object = p->second;
+            }
+            it = members.emplace(armap[i].member, object).first;
+        }
+        objects.push_back(it->second);
+    }
+    return objects;
+}
+
+} }
+
+#endif
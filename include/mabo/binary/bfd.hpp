@@ -3,37 +3,108 @@
 
 #include <mabo/config.hpp>
 #include <mabo/utility.hpp>
+#include <mabo/parallel.hpp>
+#include <mabo/binary/dynamic.hpp>
+#include <mabo/binary/search_path.hpp>
+#include <mabo/binary/symbol_hash.hpp>
+#include <mabo/binary/disassembler.hpp>
+#include <mabo/binary/relocation.hpp>
+#include <mabo/stats.hpp>
 
 #include <bfd.h>
+#include <bfdver.h>
 #include <elf.h>
 
 #include <range/v3/view.hpp>
 #include <range/v3/algorithm.hpp>
 
 #include <type_traits>
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <unordered_map>
+
+// binutils 2.34 dropped bfd_get_section_size() and the bfd argument of
+// bfd_section_size(), older ones only have the macros
+#if BFD_VERSION < 234000000
+#undef bfd_section_size
+#define bfd_section_size(sec) bfd_get_section_size(sec)
+#endif
 
 namespace mabo { namespace bfd
 {
 
 struct bfd_initer
 {
-    bfd_initer()
+    bfd_initer() : threads(false)
     {
         bfd_init();
+
+        // libbfd is only safe to use from several threads once it has locks, binutils 2.42+
+#if BFD_VERSION >= 242000000
+        threads = bfd_thread_init(&lock, &unlock, 0);
+#endif
+    }
+
+    bool threads;
+
+private:
+    static std::recursive_mutex& mutex()
+    {
+        static std::recursive_mutex m;
+        return m;
+    }
+
+    static bool lock(void*)
+    {
+        mutex().lock();
+        return true;
+    }
+
+    static bool unlock(void*)
+    {
+        mutex().unlock();
+        return true;
     }
 };
 
 struct bfd_initer_once
 {
     bfd_initer_once()
+    {
+        (void)instance();
+    }
+
+    static bfd_initer const& instance()
     {
         static bfd_initer init;
-        (void)init;
+        return init;
     }
 };
 
+inline bool bfd_threads()
+{
+    return bfd_initer_once::instance().threads;
+}
+
+// whether distinct objects can load their symbols concurrently
+inline bool thread_safe()
+{
+    return bfd_threads();
+}
+
+// whether members of one archive can be opened concurrently, never: they
+// share the archive's bfd, its element cache, file position and refcount
+inline bool archive_thread_safe()
+{
+    return false;
+}
+
 // intrusive shared_ptr with member-backed aliasing
 template<class T, ::bfd* (T::*member) = (::bfd* (T::*))0>
 struct bfd_handle
@@ -130,16 +201,20 @@ private:
 };
 
 struct object;
+struct section;
 
 struct symbol
 {
-    explicit symbol(::asymbol* sym) : sym(sym)
+    explicit symbol(::asymbol* sym, size_t size = 0) : sym(sym), size_(size)
     {
         assert(sym);
     }
 
     bfd::object object() const;
 
+    // the section it is defined in, none for undefined, absolute and common symbols
+    optional<bfd::section> section() const;
+
     string_view name() const
     {
         return sym->name;
@@ -150,6 +225,14 @@ struct symbol
         return sym->section->vma + sym->value;
     }
 
+    // libbfd keeps st_size to itself, so this is how far the symbol extends
+    // to the next one in its section, or the section's end, as inferred by
+    // the object it came from; 0 when unknown
+    size_t size() const
+    {
+        return size_;
+    }
+
     bool global() const
     {
         return !(sym->flags & BSF_LOCAL);
@@ -160,13 +243,34 @@ struct symbol
         return sym->flags & BSF_WEAK;
     }
 
+    // STT_FUNC, STT_OBJECT and so on, as far as libbfd keeps them apart
+    unsigned char type() const
+    {
+        if(sym->flags & BSF_SECTION_SYM)
+            return STT_SECTION;
+        if(sym->flags & BSF_FILE)
+            return STT_FILE;
+        if(sym->flags & BSF_GNU_INDIRECT_FUNCTION)
+            return STT_GNU_IFUNC;
+        if(sym->flags & BSF_THREAD_LOCAL)
+            return STT_TLS;
+        if(sym->flags & BSF_FUNCTION)
+            return STT_FUNC;
+        if(sym->flags & BSF_OBJECT)
+            return STT_OBJECT;
+        return STT_NOTYPE;
+    }
+
 private:
+    friend struct object;
+
     bfd_handle<::asymbol, &asymbol::the_bfd> sym;
+    size_t size_;
 };
 
 struct section
 {
-    explicit section(::asection* sec) : sec(sec)
+    explicit section(::asection* sec) : sec(sec), size_(0)
     {
         assert(sec);
     }
@@ -176,95 +280,91 @@ struct section
         return sec->name;
     }
 
-    template<class T>
-    auto data() const
+    // vma, 0 in relocatable objects
+    uint64_t addr() const
     {
-        static_assert(std::is_trivially_copyable<T>::value, "sections can only be reinterpreted as trivial types");
-
-        #define BUFFER_SIZE size_t(32)
-        struct section_data_range : ranges::view_facade<section_data_range>
-        {
-            section_data_range(asection* sec) : sec(sec)
-            {
-                sz = bfd_get_section_size(sec) / sizeof(T);
-            }
-
-        private:
-            friend ranges::range_access;
-
-            struct cursor
-            {
-                cursor() = default;
-                cursor(::asection* sec, size_t sz, size_t idx) : sec(sec), sz(sz), idx(idx)
-                {
-                    advance(0, true);
-                }
-
-            private:
-                friend ranges::range_access;
-
-                T const& get() const
-                {
-                    return buffer[idx % BUFFER_SIZE];
-                }
-
-                void next()
-                {
-                    advance(1);
-                }
-
-                void prev()
-                {
-                    advance(-1);
-                }
+        return sec->vma;
+    }
 
-                bool equal(cursor const& other) const
-                {
-                    return idx == other.idx;
-                }
+    // bytes it takes up once loaded, data() is empty for .bss and the like
+    uint64_t size() const
+    {
+        return bfd_section_size(sec.get());
+    }
 
-                void advance(ptrdiff_t n, bool init = false)
-                {
-                    size_t old_pos = idx / BUFFER_SIZE * BUFFER_SIZE;
-                    idx += n;
-                    size_t pos = idx / BUFFER_SIZE * BUFFER_SIZE;
-                    size_t bufsz = std::min(BUFFER_SIZE, sz-pos);
+    // the sh_flags libbfd keeps track of: SHF_ALLOC, SHF_WRITE and SHF_EXECINSTR
+    uint64_t flags() const
+    {
+        flagword f = sec->flags;
+        uint64_t result = 0;
+        if(f & SEC_ALLOC)
+            result |= SHF_ALLOC;
+        if((f & SEC_ALLOC) && !(f & SEC_READONLY))
+            result |= SHF_WRITE;
+        if(f & SEC_CODE)
+            result |= SHF_EXECINSTR;
+        return result;
+    }
 
-                    if(!init && pos == old_pos)
-                        return;
+    // libbfd's numbering, names can repeat
+    uint32_t index() const
+    {
+        return uint32_t(sec->index);
+    }
 
-                    if(!bfd_get_section_contents(sec->owner, sec, buffer, pos*sizeof(T), bufsz*sizeof(T)))
-                        throw std::runtime_error("bfd_get_section_contents failed");
-                }
+    // the whole section as a contiguous array, read on first use and kept
+    // with this section and its copies, the range is only valid while one
+    // of them is alive
+    template<class T>
+    auto data() const
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "sections can only be reinterpreted as trivial types");
+        static_assert(alignof(T) == 1, "section contents may be unaligned, read wider types with memcpy");
 
-                ptrdiff_t distance_to(cursor const& other) const
-                {
-                    return other.idx - idx;
-                }
+        bfd_byte const* contents = load();
+        T const* first = reinterpret_cast<T const*>(contents);
+        return ranges::make_iterator_range(first, first + (contents ? size_ / sizeof(T) : 0));
+    }
 
-                asection* sec;
-                size_t sz;
-                size_t idx;
-                T buffer[BUFFER_SIZE];
-            };
+private:
+    bfd_byte const* load() const
+    {
+        if(contents)
+            return contents.get();
 
-            cursor   begin_cursor() const { return cursor(sec, sz, 0);  }
-            cursor   end_cursor()   const { return cursor(sec, sz, sz); }
+        ::asection* s = sec.get();
+        if(!(s->flags & SEC_HAS_CONTENTS) || !bfd_section_size(s))
+            return 0;
 
-            asection* sec;
-            size_t sz;
-        };
-        #undef BUFFER_SIZE
+        // malloc'ed, so aligned for any T, and decompressed if need be
+        bfd_byte* buffer = 0;
+        if(!bfd_malloc_and_get_section(s->owner, s, &buffer))
+        {
+            ::free(buffer);
+            throw std::runtime_error("bfd_malloc_and_get_section failed");
+        }
+        MABO_COUNT(BYTES_READ, bfd_section_size(s));
 
-        return section_data_range(sec.get());
+        size_ = bfd_section_size(s);
+        contents.reset(buffer, ::free);
+        return buffer;
     }
 
-private:
+    friend struct object;
+
     bfd_handle<::asection, &asection::owner> sec;
+    mutable std::shared_ptr<bfd_byte const> contents;
+    mutable bfd_size_type size_;
 };
 
 struct archive;
 
+struct armap_entry
+{
+    string_view name;   // symbol defined by the member
+    size_t member;      // file offset of the member, identifies it
+};
+
 struct object
 {
     explicit object(::bfd* abfd) : abfd(abfd)
@@ -272,11 +372,23 @@ struct object
         assert(abfd);
     }
 
+    // a member opened through an archive handle nothing else holds on to
+    object(::bfd* abfd, bfd_handle<::bfd> const& ar) : ar(ar), abfd(abfd)
+    {
+        assert(abfd);
+    }
+
     string_view name() const
     {
         return abfd->filename;
     }
 
+    // where the object starts in its file, tells archive members apart
+    size_t offset() const
+    {
+        return size_t(abfd->proxy_origin);
+    }
+
     auto sections() const
     {
         struct section_range : ranges::view_facade<section_range>
@@ -332,10 +444,44 @@ struct object
                     ?   ranges::make_iterator_range(symbols_.begin() + symbols_part1, symbols_.begin() + symbols_part2)
                     :   ranges::make_iterator_range(dyn_symbols_.begin() + dyn_symbols_part1, dyn_symbols_.begin() + dyn_symbols_part2)
                 )
-                | ranges::view::transform([](asymbol* sym) { return symbol(sym); })
+                | ranges::view::transform([this](asymbol* sym) { return symbol(sym, size_of(sym)); })
     ;
     }
 
+    // a defined, non-local symbol by name: shared objects are looked up through
+    // their .gnu.hash or .hash like ld.so does, without loading any symbols
+    // unless there is a match, anything else through an index built once
+    optional<symbol> find_symbol(string_view name) const
+    {
+        if(!hashed_)
+            const_cast<object*>(this)->load_hashed();
+
+        if(hashed_->available())
+        {
+            size_t i = hashed_->find(name);
+            if(i == detail::dynamic_symbols::npos)
+                return {};
+
+            if(symbols_.empty() && dyn_symbols_.empty())
+                const_cast<object*>(this)->load_symbols();
+            if(!i || i > dyn_symbols_by_index_.size())
+                return {};
+            return symbol(dyn_symbols_by_index_[i - 1], size_of(dyn_symbols_by_index_[i - 1]));
+        }
+
+        if(symbol_index_.empty())
+        {
+            auto& index = const_cast<object*>(this)->symbol_index_;
+            for(symbol const& sym : symbols())
+                index.emplace(sym.name(), sym.sym.get());
+        }
+
+        auto it = symbol_index_.find(name);
+        if(it == symbol_index_.end())
+            return {};
+        return symbol(it->second, size_of(it->second));
+    }
+
     auto imports() const
     {
         if(symbols_.empty() && dyn_symbols_.empty())
@@ -347,100 +493,239 @@ struct object
                     ?   ranges::make_iterator_range(dyn_symbols_.begin(), dyn_symbols_.begin() + dyn_symbols_part1)
                     :   ranges::make_iterator_range(symbols_.begin(), symbols_.begin() + symbols_part1)
                 )
-                | ranges::view::transform([](asymbol* sym) { return symbol(sym); })
+                | ranges::view::transform([this](asymbol* sym) { return symbol(sym, size_of(sym)); })
         ;
     }
 
-    auto libs() const
+    // the local symbols of the symbol table, none without one
+    auto local_symbols() const
     {
-        // only ELF and Mach-O support this
-        // we only care about ELF for now
-        return elf_dynstr(DT_NEEDED);
+        if(symbols_.empty() && dyn_symbols_.empty())
+            const_cast<object*>(this)->load_symbols();
+
+        return ranges::make_iterator_range(symbols_.begin() + symbols_part2, symbols_.end())
+             | ranges::view::transform([this](asymbol* sym) { return symbol(sym, size_of(sym)); });
     }
 
-    auto link_paths() const
+    // only ELF and Mach-O have this, we only care about ELF for now
+    dynamic_table const& dynamic() const
     {
-        vector<string> paths;
+        if(!dynamic_)
+            const_cast<object*>(this)->load_dynamic();
+        return *dynamic_;
+    }
 
-        // split on :
-        auto split_push =
-            [&](string_view elem)
-            {
-                ranges::for_each(
-                    ranges::view::split(elem, ':'),
-                    [&](auto&& str)
-                    {
-                        auto&& bstr = ranges::view::bounded(str);
-                        paths.emplace_back(bstr.begin(), bstr.end());
-                    }
-                );
-            };
+    auto const& libs() const
+    {
+        // views into .dynstr
+        return dynamic().needed();
+    }
 
-        // RPATH
-        ranges::for_each(elf_dynstr(DT_RPATH), split_push);
+    // e_machine, EM_X86_64 and so on, EM_NONE for formats we do not map
+    uint16_t machine() const
+    {
+        switch(bfd_get_arch(abfd.get()))
+        {
+        case bfd_arch_i386:
+            return bfd_get_mach(abfd.get()) & (bfd_mach_x86_64 | bfd_mach_x64_32) ? EM_X86_64 : EM_386;
+        case bfd_arch_aarch64: return EM_AARCH64;
+        case bfd_arch_arm:     return EM_ARM;
+        case bfd_arch_powerpc: return bits() == 64 ? EM_PPC64 : EM_PPC;
+        case bfd_arch_s390:    return EM_S390;
+        case bfd_arch_sparc:   return bits() == 64 ? EM_SPARCV9 : EM_SPARC;
+        case bfd_arch_mips:    return EM_MIPS;
+        case bfd_arch_riscv:   return EM_RISCV;
+        case bfd_arch_ia64:    return EM_IA_64;
+        default:               return EM_NONE;
+        }
+    }
 
-        // LD_LIBRARY_PATH
-        if(getenv("LD_LIBRARY_PATH"))
-            split_push(string_view(getenv("LD_LIBRARY_PATH")));
+    unsigned bits() const
+    {
+        int size = bfd_get_arch_size(abfd.get());
+        return size > 0 ? size : abfd->arch_info->bits_per_word;
+    }
 
-        // RUNPATH
-        ranges::for_each(elf_dynstr(DT_RUNPATH), split_push);
+    // where ld.so looks for libs() before its cache and default paths,
+    // with $ORIGIN, $LIB and $PLATFORM expanded
+    auto link_paths() const
+    {
+        return detail::search_paths(dynamic(), name(), machine(), bits());
+    }
 
-        // system paths
-        // TODO parse /etc/ld.so.conf instead
-        if(abfd->arch_info->bits_per_word == 64)
+    // decodes every code section, split into functions by the function symbols
+    // in them, on up to `threads` threads when libopcodes can
+    disassembly disassemble(size_t threads = 1) const
+    {
+        detail::code arch;
+        arch.arch = bfd_get_arch(abfd.get());
+        arch.mach = bfd_get_mach(abfd.get());
+        arch.big_endian = bfd_big_endian(abfd.get());
+        arch.abfd = abfd.get();
+
+        // the contents live as long as these
+        vector<bfd::section> loaded;
+        vector<detail::code> sections;
+        std::unordered_map<::asection const*, size_t> index;
+        for(asection* sec = abfd->sections; sec; sec = sec->next)
         {
-            paths.emplace_back("/lib/x86_64-linux-gnu");
-            paths.emplace_back("/usr/lib/x86_64-linux-gnu");
+            if(!(sec->flags & SEC_CODE) || !(sec->flags & SEC_HAS_CONTENTS))
+                continue;
+
+            loaded.emplace_back(sec);
+            auto contents = loaded.back().data<bfd_byte>();
+
+            detail::code c = arch;
+            c.section = sec->name;
+            c.data = contents.begin();
+            c.size = contents.end() - contents.begin();
+            c.address = sec->vma;
+            index.emplace(sec, sections.size());
+            sections.push_back(std::move(c));
         }
-        else
+        if(sections.empty())
+            return {};
+
+        if(symbols_.empty() && dyn_symbols_.empty())
+            const_cast<object*>(this)->load_symbols();
+        for(::asymbol* sym : symbols_.empty() ? dyn_symbols_ : symbols_)
         {
-            paths.emplace_back("/lib/i386-linux-gnu");
-            paths.emplace_back("/usr/lib/i386-linux-gnu");
-            paths.emplace_back("/lib/i686-linux-gnu");
-            paths.emplace_back("/usr/lib/i686-linux-gnu");
-            paths.emplace_back("/lib32");
-            paths.emplace_back("/usr/lib32");
+            if(!(sym->flags & BSF_FUNCTION))
+                continue;
+
+            auto it = index.find(sym->section);
+            if(it != index.end())
+                sections[it->second].functions.emplace_back(symbol(sym).addr(), size_of(sym));
         }
-        paths.emplace_back("/lib");
-        paths.emplace_back("/usr/lib");
 
-        return paths;
+        return detail::disassemble(sections, threads);
+    }
+
+    // relocations applying to sec, read on first use
+    vector<relocation> const& relocations(bfd::section const& sec) const
+    {
+        auto it = relocations_.find(sec.sec.get());
+        if(it == relocations_.end())
+            it = const_cast<object*>(this)->load_relocations(sec.sec.get());
+        return it->second;
+    }
+
+    // all relocations, libbfd reads them through one file handle so
+    // sections are read one after the other whatever `threads` is
+    vector<relocation> relocations(size_t threads = 1) const
+    {
+        (void)threads;
+
+        vector<relocation> result;
+        for(asection* sec = abfd->sections; sec; sec = sec->next)
+        {
+            if(!(sec->flags & SEC_RELOC) || !sec->reloc_count)
+                continue;
+
+            vector<relocation> const& relocs = relocations(bfd::section(sec));
+            result.insert(result.end(), relocs.begin(), relocs.end());
+        }
+        return result;
     }
 
     bool operator==(object const& other) const;
     bool operator<(object const& other) const;
 
 private:
-    vector<string> elf_dynstr(int type) const
+    void load_hashed()
     {
-        vector<string> strings;
+        hashed_.emplace();
+        if(bfd_get_flavour(abfd.get()) != bfd_target_elf_flavour)
+            return;
 
-        auto traverse = [&](auto t)
+        // raw bytes, kept loaded with the object
+        auto bytes = [&](char const* name, char const*& data, size_t& size)
         {
-            if(!section(".dynamic") || !section(".dynstr"))
-                return;
-
-            typedef decltype(t) T;
-            for(T entry : section(".dynamic")->data<T>())
+            if(optional<bfd::section> sec = section(name))
             {
-                if(entry.d_tag == type)
-                {
-                    auto it = section(".dynstr")->data<char>().begin() + entry.d_un.d_val;
-                    string s;
-                    for(; *it; ++it)
-                        s += *it;
-                    strings.push_back(s);
-                }
+                loaded_.push_back(*sec);
+                auto contents = loaded_.back().data<char>();
+                data = contents.begin();
+                size = contents.end() - contents.begin();
             }
         };
 
-        if(abfd->arch_info->bits_per_word == 64)
-            traverse(Elf64_Dyn());
+        char const* strings = 0;
+        size_t strings_size = 0;
+        bytes(".dynsym", hashed_->syms, hashed_->syms_size);
+        bytes(".dynstr", strings, strings_size);
+        bytes(".gnu.hash", hashed_->gnu_hash, hashed_->gnu_hash_size);
+        bytes(".hash", hashed_->hash, hashed_->hash_size);
+        bytes(".gnu.version", hashed_->versym, hashed_->versym_size);
+        hashed_->strings = string_view(strings, strings_size);
+        hashed_->is64 = bits() == 64;
+
+        if(!strings)
+            hashed_->syms = 0;
+    }
+
+    void load_dynamic()
+    {
+        dynamic_.emplace();
+
+        optional<bfd::section> dyn = section(".dynamic");
+        optional<bfd::section> dynstr = section(".dynstr");
+        if(!dyn || !dynstr)
+            return;
+
+        // both stay loaded with the object, so the strings can be views
+        loaded_.push_back(*dynstr);
+        auto strings = loaded_.back().data<char>();
+        loaded_.push_back(*dyn);
+        auto entries = loaded_.back().data<char>();
+        string_view str(strings.begin(), strings.end() - strings.begin());
+
+        if(bits() == 64)
+            *dynamic_ = dynamic_table::parse<Elf64_Dyn>(entries.begin(), entries.end() - entries.begin(), str);
         else
-            traverse(Elf32_Dyn());
+            *dynamic_ = dynamic_table::parse<Elf32_Dyn>(entries.begin(), entries.end() - entries.begin(), str);
+    }
+
+    friend struct archive;
+
+    std::unordered_map<::asection const*, vector<relocation>>::iterator load_relocations(asection* sec)
+    {
+        auto it = relocations_.emplace(sec, vector<relocation>()).first;
+        if(!(sec->flags & SEC_RELOC) || !sec->reloc_count)
+            return it;
+
+        // relocations point into the symbol table in libbfd's order
+        if(symbols_.empty() && dyn_symbols_.empty())
+            load_symbols();
+
+        long size = bfd_get_reloc_upper_bound(abfd.get(), sec);
+        if(size < 0)
+            throw std::runtime_error("bfd_get_reloc_upper_bound failed");
 
-        return strings;
+        vector<arelent*> relents(size / sizeof(arelent*) + 1);
+        long count = bfd_canonicalize_reloc(abfd.get(), sec, relents.data(), symbols_by_index_.data());
+        if(count < 0)
+            throw std::runtime_error("bfd_canonicalize_reloc failed");
+
+        vector<relocation>& result = it->second;
+        result.reserve(count);
+        for(arelent* r : ranges::make_iterator_range(relents.data(), relents.data() + count))
+        {
+            relocation rel{sec->name, r->address, r->howto ? uint32_t(r->howto->type) : 0, int64_t(r->addend), {}, {}, false, uint32_t(sec->index), relocation::npos};
+            if(r->sym_ptr_ptr && *r->sym_ptr_ptr)
+            {
+                asymbol* s = *r->sym_ptr_ptr;
+                rel.local = s->flags & BSF_LOCAL;
+                if(!bfd_is_und_section(s->section) && !bfd_is_abs_section(s->section) && !bfd_is_com_section(s->section))
+                {
+                    rel.target = s->section->name;
+                    rel.target_index = uint32_t(s->section->index);
+                }
+                rel.symbol = (s->flags & BSF_SECTION_SYM) ? rel.target : string_view(s->name);
+            }
+            result.push_back(rel);
+        }
+        return it;
     }
 
     void load_symbols()
@@ -455,6 +740,8 @@ private:
             return !(sym->flags & BSF_LOCAL);
         };
 
+        MABO_PHASE(LOAD_SYMBOLS);
+
         // load normal symbols
         long storage_needed = bfd_get_symtab_upper_bound(abfd.get());
 
@@ -468,9 +755,15 @@ private:
             throw std::runtime_error("bfd_canonicalize_symtab failed");
 
         symbols_.resize(number_of_symbols);
+        MABO_COUNT(SYMBOLS_LOADED, symbols_.size());
+
+        // in the order relocations refer to, null terminated like libbfd's
+        symbols_by_index_ = symbols_;
+        symbols_by_index_.push_back(0);
 
         symbols_part1 = ranges::partition(symbols_, is_import) - symbols_.begin();
         symbols_part2 = ranges::partition(ranges::make_iterator_range(symbols_.begin() + symbols_part1, symbols_.end()), is_global).get_unsafe() - symbols_.begin();
+        infer_sizes(symbols_);
 
         // load dynamic symbols
         storage_needed = bfd_get_dynamic_symtab_upper_bound(abfd.get());
@@ -490,11 +783,57 @@ private:
             throw std::runtime_error("bfd_canonicalize_dynamic_symtab failed");
 
         dyn_symbols_.resize(number_of_symbols);
+        MABO_COUNT(SYMBOLS_LOADED, dyn_symbols_.size());
+
+        // libbfd skips the null symbol, so dynsym index i is at i - 1
+        dyn_symbols_by_index_ = dyn_symbols_;
 
         dyn_symbols_part1 = ranges::partition(dyn_symbols_, is_import) - dyn_symbols_.begin();
         dyn_symbols_part2 = ranges::partition(ranges::make_iterator_range(dyn_symbols_.begin() + dyn_symbols_part1, dyn_symbols_.end()), is_global).get_unsafe() - dyn_symbols_.begin();
+        infer_sizes(dyn_symbols_);
+    }
+
+    // like nm for formats without sizes: a defined symbol extends to the next
+    // address defined in its section, or to the section's end
+    void infer_sizes(vector<::asymbol*> const& syms)
+    {
+        vector<::asymbol*> defined;
+        for(::asymbol* sym : syms)
+        {
+            // common symbols keep their size in the value
+            if(bfd_is_com_section(sym->section))
+                sizes_[sym] = sym->value;
+            else if(!bfd_is_und_section(sym->section) && !bfd_is_abs_section(sym->section) && !(sym->flags & (BSF_SECTION_SYM | BSF_FILE)))
+                defined.push_back(sym);
+        }
+
+        std::sort(defined.begin(), defined.end(), [](::asymbol const* a, ::asymbol const* b)
+        {
+            return a->section != b->section ? std::less<::asection const*>()(a->section, b->section) : a->value < b->value;
+        });
+
+        for(size_t i = 0; i != defined.size(); )
+        {
+            ::asection const* sec = defined[i]->section;
+            bfd_vma value = defined[i]->value;
+
+            size_t next = i;
+            while(next != defined.size() && defined[next]->section == sec && defined[next]->value == value)
+                ++next;
+
+            bfd_vma end = next != defined.size() && defined[next]->section == sec ? defined[next]->value : bfd_section_size(sec);
+            for(; i != next; ++i)
+                sizes_[defined[i]] = end > value ? end - value : 0;
+        }
+    }
+
+    size_t size_of(::asymbol const* sym) const
+    {
+        auto it = sizes_.find(sym);
+        return it != sizes_.end() ? it->second : 0;
     }
 
+    bfd_handle<::bfd> ar;   // closed after abfd, libbfd closes members with their archive
     bfd_handle<::bfd> abfd;
     vector<::asymbol*> symbols_;
     size_t symbols_part1;
@@ -502,6 +841,14 @@ private:
     vector<::asymbol*> dyn_symbols_;
     size_t dyn_symbols_part1;
     size_t dyn_symbols_part2;
+    vector<::asymbol*> symbols_by_index_;
+    vector<::asymbol*> dyn_symbols_by_index_;
+    optional<dynamic_table> dynamic_;
+    optional<detail::dynamic_symbols> hashed_;
+    std::unordered_map<string_view, ::asymbol*> symbol_index_;
+    std::unordered_map<::asymbol const*, size_t> sizes_;
+    std::unordered_map<::asection const*, vector<relocation>> relocations_;
+    vector<bfd::section> loaded_;   // whose contents dynamic_ and hashed_ point into
 };
 
 // collection of objects, but only load as needed
@@ -556,6 +903,91 @@ struct archive
         return ranges::view::bounded(object_range(abfd.get()));
     }
 
+    // all objects in archive order, symbol tables loaded on up to `threads` threads
+    //
+    // members are read through their archive's file handle, which is not
+    // safe to share, so each thread opens the archive again and loads a
+    // contiguous run of members through its own
+    vector<bfd::object> objects(size_t threads) const
+    {
+        threads = bfd_threads() ? thread_count(threads) : 1;
+        if(threads == 1)
+        {
+            vector<bfd::object> objects;
+            for(bfd::object const& obj : this->objects())
+            {
+                objects.push_back(obj);
+                objects.back().load_symbols();
+            }
+            return objects;
+        }
+
+        // walk the member table first, this only reads the member headers
+        size_t count = 0;
+        {
+            bfd_handle<::bfd> member;
+            for(member.reset(bfd_openr_next_archived_file(abfd.get(), 0)); member; member.reset(bfd_openr_next_archived_file(abfd.get(), member.get())))
+                ++count;
+        }
+
+        threads = std::min(threads, count);
+        vector<optional<bfd::object>> loaded(count);
+        parallel_for(threads, threads, [&](size_t t)
+        {
+            size_t first = count * t / threads;
+            size_t last = count * (t + 1) / threads;
+
+            bfd_handle<::bfd> own(bfd_openr(abfd->filename, 0));
+            if(!own || !bfd_check_format(own.get(), bfd_archive))
+                throw std::runtime_error("failed to reopen archive " + name().to_string());
+
+            bfd_handle<::bfd> member;
+            size_t i = 0;
+            for(member.reset(bfd_openr_next_archived_file(own.get(), 0)); member && i != last; member.reset(bfd_openr_next_archived_file(own.get(), member.get())), ++i)
+            {
+                if(i < first || !bfd_check_format(member.get(), bfd_object))
+                    continue;
+
+                bfd::object obj(member.get(), own);
+                obj.load_symbols();
+                loaded[i] = std::move(obj);
+            }
+        });
+
+        vector<bfd::object> objects;
+        objects.reserve(loaded.size());
+        for(optional<bfd::object>& obj : loaded)
+            if(obj)
+                objects.push_back(std::move(*obj));
+        return objects;
+    }
+
+    // archive symbol index, empty if the archive has none
+    vector<armap_entry> armap() const
+    {
+        vector<armap_entry> entries;
+        if(!bfd_has_map(abfd.get()))
+            return entries;
+
+        carsym* sym;
+        for(symindex i = bfd_get_next_mapent(abfd.get(), BFD_NO_MORE_SYMBOLS, &sym); i != BFD_NO_MORE_SYMBOLS; i = bfd_get_next_mapent(abfd.get(), i, &sym))
+        {
+            assert(i == entries.size());
+            entries.push_back(armap_entry{sym->name, size_t(sym->file_offset)});
+        }
+        return entries;
+    }
+
+    // member defining the i-th armap symbol, only that member is opened
+    optional<bfd::object> armap_member(size_t i) const
+    {
+        bfd_handle<::bfd> member(bfd_get_elt_at_index(abfd.get(), i));
+        if(!member || !bfd_check_format(member.get(), bfd_object))
+            return {};
+
+        return bfd::object(member.get());
+    }
+
     bool operator==(archive const& other) const
     {
         return name() == other.name() ;
@@ -578,7 +1010,15 @@ private:
 
 inline bfd::object symbol::object() const
 {
-    return bfd::object(bfd_asymbol_bfd(sym));
+    return bfd::object(bfd_asymbol_bfd(sym.get()));
+}
+
+inline optional<bfd::section> symbol::section() const
+{
+    ::asection* sec = sym->section;
+    if(!sec || bfd_is_und_section(sec) || bfd_is_abs_section(sec) || bfd_is_com_section(sec))
+        return {};
+    return bfd::section(sec);
 }
 
 inline optional<bfd::archive> object::archive() const
@@ -692,6 +1132,15 @@ struct binary : variant<object, archive>
         return ranges::view::bounded(object_range(this));
     }
 
+    // same as objects(), but archives are loaded up front on up to `threads` threads
+    vector<bfd::object> objects(size_t threads) const
+    {
+        if(mabo::holds_alternative<archive>(*this))
+            return mabo::get<archive>(*this).objects(threads);
+        else
+            return vector<bfd::object>(1, mabo::get<object>(*this));
+    }
+
     bool operator==(binary const& other) const
     {
         return name() == other.name() ;
@@ -714,10 +1163,16 @@ private:
         bfd_initer_once init;
         (void)init;
 
-        ::bfd* abfd = bfd_openr(str.to_string().c_str(), NULL);
+        ::bfd* abfd;
+        {
+            MABO_PHASE(OPEN);
+            abfd = bfd_openr(str.to_string().c_str(), NULL);
+        }
         if(!abfd)
             throw std::runtime_error("failed to load binary " + str.to_string());
+        MABO_COUNT(FILES_OPENED, 1);
 
+        MABO_PHASE(CHECK_FORMAT);
         if(bfd_check_format(abfd, bfd_archive))
         {
             return archive(abfd);
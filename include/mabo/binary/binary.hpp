@@ -9,6 +9,10 @@
 #include <mabo/binary/radare2.hpp>
 #endif
 
+#ifdef MABO_WITH_ELF
+#include <mabo/binary/elf.hpp>
+#endif
+
 namespace mabo
 {
 
@@ -19,12 +23,22 @@ namespace mabo
     struct section;
     struct symbol;
 
+    struct armap_entry
+    {
+        string_view name;
+        size_t member;
+    };
+
+    bool thread_safe();
+    bool archive_thread_safe();
+
     struct binary : variant<archive, object>
     {
         binary(string_view file);
         string_view name() const;
 
         auto objects() const;
+        vector<mabo::object> objects(size_t threads) const;
     };
 
     struct archive
@@ -33,6 +47,10 @@ namespace mabo
         string_view name() const;
 
         auto objects() const;
+        vector<mabo::object> objects(size_t threads) const;
+
+        auto armap() const;
+        optional<mabo::object> armap_member(size_t i) const;
     };
 
     struct object
@@ -41,13 +59,35 @@ namespace mabo
         string_view name() const;
         optional<mabo::archive> archive() const;
 
+        // where the object starts in its file, tells archive members apart
+        size_t offset() const;
+
         auto sections() const;
         optional<mabo::section> section(string_view name) const;
 
         auto symbols() const;
         auto imports() const;
-        auto libs() const;
+
+        // the STB_LOCAL symbols of the symbol table: statics, section and file symbols
+        auto local_symbols() const;
+
+        // defined, non-local symbol by name, through .gnu.hash or .hash when there is one
+        optional<mabo::symbol> find_symbol(string_view name) const;
+
+        uint16_t machine() const;
+        unsigned bits() const;
+
+        dynamic_table const& dynamic() const;
+        auto const& libs() const;
         auto link_paths() const;
+
+        // every code section decoded into compact records, split at function symbols
+        disassembly disassemble(size_t threads = 1) const;
+
+        // static relocations against the symbol table, per section on first
+        // use, or all of them with the sections decoded on several threads
+        vector<relocation> const& relocations(mabo::section const& sec) const;
+        vector<relocation> relocations(size_t threads = 1) const;
     };
 
     struct section
@@ -55,6 +95,16 @@ namespace mabo
         section() = delete;
         string_view name() const;
 
+        // load address, size including SHT_NOBITS sections, and SHF_* flags
+        uint64_t addr() const;
+        uint64_t size() const;
+        uint64_t flags() const;
+
+        // position in the object, sections can share a name
+        uint32_t index() const;
+
+        // contiguous T const* range over the section contents, T is a byte
+        // type since the contents may be unaligned
         template<class T>
         auto data() const;
     };
@@ -64,13 +114,22 @@ namespace mabo
         symbol() = delete;
         string_view name() const;
         size_t addr() const;
+        size_t size() const;
         bool global() const;
         bool weak() const;
 
+        // STT_FUNC, STT_OBJECT and so on
+        unsigned char type() const;
+
+        // where it is defined, none for undefined, absolute and common symbols
+        optional<mabo::section> section() const;
+
         // remove?
         mabo::object object() const;
     };
 
+#elif defined(MABO_WITH_ELF)
+    using namespace elf;
 #else
     using namespace bfd;
 #endif
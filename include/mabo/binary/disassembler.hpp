@@ -0,0 +1,388 @@
+#ifndef MABO_BINARY_DISASSEMBLER_HPP_INCLUDED
+#define MABO_BINARY_DISASSEMBLER_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+#include <mabo/parallel.hpp>
+#include <mabo/string_pool.hpp>
+
+#include <bfd.h>
+#include <bfdver.h>
+#include <dis-asm.h>
+#include <elf.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace mabo
+{
+
+// one decoded instruction
+struct instruction
+{
+    enum flag_type
+    {
+        BRANCH      = 1,
+        CONDITIONAL = 2,
+        CALL        = 4,
+        REFERENCE   = 8,    // target is an address the instruction refers to, not a branch
+        INVALID     = 16    // undecodable byte, length is 1
+    };
+
+    uint64_t address;
+    uint64_t target;        // 0 when there is none
+    uint32_t mnemonic;      // see mnemonic()
+    uint8_t length;
+    uint8_t flags;
+};
+
+// a function, or the padding after one, and its instructions
+struct code_range
+{
+    uint64_t address;
+    uint64_t size;
+    uint32_t first;         // index into disassembly::instructions
+    uint32_t count;
+    string_view section;    // the code section it is in, valid while its object is
+};
+
+struct disassembly
+{
+    vector<instruction> instructions;   // by section, then by address
+    vector<code_range> functions;
+};
+
+namespace detail
+{
+
+// mnemonics are interned process wide, so ids compare across objects
+inline string_pool& mnemonics()
+{
+    static string_pool pool;
+    return pool;
+}
+
+}
+
+inline string_view mnemonic(uint32_t id)
+{
+    return detail::mnemonics()[id];
+}
+
+namespace detail
+{
+
+// older libopcodes keeps decoder state in globals
+inline bool disassembler_thread_safe()
+{
+    return BFD_VERSION >= 242000000;
+}
+
+// libopcodes architecture of an e_machine
+inline bool disassembler_arch(uint16_t machine, unsigned bits, bfd_architecture& arch, unsigned long& mach)
+{
+    switch(machine)
+    {
+    case EM_X86_64:  arch = bfd_arch_i386;    mach = bits == 64 ? bfd_mach_x86_64 : bfd_mach_x64_32; return true;
+    case EM_386:     arch = bfd_arch_i386;    mach = bfd_mach_i386_i386; return true;
+    case EM_AARCH64: arch = bfd_arch_aarch64; mach = bfd_mach_aarch64; return true;
+    case EM_ARM:     arch = bfd_arch_arm;     mach = bfd_mach_arm_unknown; return true;
+    case EM_PPC64:   arch = bfd_arch_powerpc; mach = bfd_mach_ppc64; return true;
+    case EM_PPC:     arch = bfd_arch_powerpc; mach = bfd_mach_ppc; return true;
+    case EM_S390:    arch = bfd_arch_s390;    mach = bits == 64 ? bfd_mach_s390_64 : bfd_mach_s390_31; return true;
+    case EM_RISCV:   arch = bfd_arch_riscv;   mach = bits == 64 ? bfd_mach_riscv64 : bfd_mach_riscv32; return true;
+    default:         return false;
+    }
+}
+
+// what a backend hands the disassembler for each code section: the code,
+// where it is loaded and where functions start and end
+struct code
+{
+    bfd_architecture arch;
+    unsigned long mach;
+    bool big_endian;
+    ::bfd* abfd;                            // may be null
+
+    string_view section;
+    bfd_byte const* data;
+    size_t size;
+    uint64_t address;
+
+    vector<pair<uint64_t, uint64_t>> functions;     // address and size, size 0 when unknown
+};
+
+// one libopcodes instance, decodes the instructions of a range of a section
+struct decoder
+{
+    explicit decoder(code const& c)
+    {
+#if BFD_VERSION >= 239000000
+        init_disassemble_info(&info, this, &decoder::print, &decoder::print_styled);
+#else
+        init_disassemble_info(&info, this, &decoder::print);
+#endif
+        info.arch = c.arch;
+        info.mach = c.mach;
+        info.endian = c.big_endian ? BFD_ENDIAN_BIG : BFD_ENDIAN_LITTLE;
+        info.print_address_func = &decoder::print_address;
+        select(c);
+        disassemble_init_for_target(&info);
+
+        decode = disassembler(c.arch, c.big_endian, c.mach, c.abfd);
+        if(!decode)
+            throw std::runtime_error("no disassembler for this architecture");
+        text.reserve(64);
+    }
+
+    decoder(decoder const&) = delete;
+    decoder& operator=(decoder const&) = delete;
+
+    ~decoder()
+    {
+#if BFD_VERSION >= 232000000
+        disassemble_free_target(&info);
+#endif
+    }
+
+    // the section run() decodes from, all of one object's share the architecture
+    void select(code const& c)
+    {
+        info.buffer = const_cast<bfd_byte*>(c.data);
+        info.buffer_length = c.size;
+        info.buffer_vma = c.address;
+    }
+
+    void run(uint64_t first, uint64_t last, vector<instruction>& out)
+    {
+        for(uint64_t pc = first; pc < last; )
+        {
+            text.clear();
+            address = 0;
+            has_address = false;
+            info.insn_info_valid = 0;
+            info.target = 0;
+
+            int length = decode(pc, &info);
+
+            instruction insn{pc, 0, 0, 1, 0};
+            if(length <= 0 || uint64_t(length) > last - pc)
+                insn.flags = instruction::INVALID;
+            else
+            {
+                insn.length = uint8_t(std::min(length, 255));
+                classify(insn);
+            }
+            insn.mnemonic = intern(mnemonic_text());
+            out.push_back(insn);
+            pc += insn.length;
+        }
+    }
+
+private:
+    // the pool locks, most mnemonics are found in this decoder's own cache
+    uint32_t intern(string_view m)
+    {
+        key.assign(m.data(), m.size());
+        auto it = cache.find(key);
+        if(it == cache.end())
+            it = cache.emplace(key, mnemonics().intern(m)).first;
+        return it->second;
+    }
+
+    void classify(instruction& insn) const
+    {
+        if(info.insn_info_valid)
+        {
+            switch(info.insn_type)
+            {
+            case dis_condbranch: insn.flags = instruction::BRANCH | instruction::CONDITIONAL; break;
+            case dis_branch:     insn.flags = instruction::BRANCH; break;
+            case dis_condjsr:    insn.flags = instruction::CALL | instruction::CONDITIONAL; break;
+            case dis_jsr:        insn.flags = instruction::CALL; break;
+            default:             break;
+            }
+            if(insn.flags && info.target)
+                insn.target = info.target;
+        }
+        else if(info.arch == bfd_arch_i386)
+        {
+            // the x86 decoder doesn't fill in insn_type
+            string_view m = mnemonic_text();
+            if(m.substr(0, 4) == "call")
+                insn.flags = instruction::CALL;
+            else if(m.substr(0, 3) == "jmp")
+                insn.flags = instruction::BRANCH;
+            else if((!m.empty() && m[0] == 'j') || m.substr(0, 4) == "loop")
+                insn.flags = instruction::BRANCH | instruction::CONDITIONAL;
+        }
+
+        if(!insn.target && has_address)
+        {
+            insn.target = address;
+            if(!insn.flags)
+                insn.flags = instruction::REFERENCE;
+        }
+    }
+
+    // the first word of the text, with any x86 prefixes in front of it
+    string_view mnemonic_text() const
+    {
+        static char const* const prefixes[] = {
+            "rep", "repz", "repnz", "repe", "repne", "lock", "notrack", "bnd",
+            "xacquire", "xrelease", "data16", "data32", "addr16", "addr32",
+            "cs", "ds", "es", "fs", "gs", "ss"
+        };
+
+        string_view s = text;
+        size_t first = s.find_first_not_of(" \t");
+        if(first == string_view::npos)
+            return "(bad)";
+
+        size_t last = first;
+        for(;;)
+        {
+            size_t end = std::min(s.find_first_of(" \t", last), s.size());
+            string_view word = s.substr(last, end - last);
+            bool prefix = std::any_of(std::begin(prefixes), std::end(prefixes), [&](char const* p) { return word == p; });
+
+            size_t next = s.find_first_not_of(" \t", end);
+            if(!prefix || next == string_view::npos)
+                return s.substr(first, end - first);
+            last = next;
+        }
+    }
+
+    void append(char const* format, va_list args)
+    {
+        char buffer[256];
+        int n = std::vsnprintf(buffer, sizeof(buffer), format, args);
+        if(n > 0)
+            text.append(buffer, std::min<size_t>(n, sizeof(buffer) - 1));
+    }
+
+    static int print(void* stream, char const* format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        static_cast<decoder*>(stream)->append(format, args);
+        va_end(args);
+        return 0;
+    }
+
+#if BFD_VERSION >= 239000000
+    static int print_styled(void* stream, enum disassembler_style, char const* format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        static_cast<decoder*>(stream)->append(format, args);
+        va_end(args);
+        return 0;
+    }
+#endif
+
+    static void print_address(bfd_vma addr, disassemble_info* info)
+    {
+        decoder* self = static_cast<decoder*>(info->stream);
+        self->address = addr;
+        self->has_address = true;
+    }
+
+    disassemble_info info;
+    disassembler_ftype decode;
+    string text;
+    uint64_t address;
+    bool has_address;
+    string key;
+    std::unordered_map<string, uint32_t> cache;
+};
+
+// a piece of a section between two function bounds
+struct code_piece
+{
+    size_t section;
+    uint64_t first;
+    uint64_t last;
+};
+
+// splits each section at function starts and ends, so decoding resyncs
+// after padding and data, and decodes the pieces on up to `threads` threads
+inline disassembly disassemble(vector<code> const& sections, size_t threads)
+{
+    vector<code_piece> pieces;
+    for(size_t s = 0; s != sections.size(); ++s)
+    {
+        code const& c = sections[s];
+        uint64_t const first = c.address;
+        uint64_t const last = c.address + c.size;
+        if(first == last)
+            continue;
+
+        vector<uint64_t> bounds{first, last};
+        for(pair<uint64_t, uint64_t> const& f : c.functions)
+        {
+            if(f.first > first && f.first < last)
+                bounds.push_back(f.first);
+            if(f.second && f.first + f.second > first && f.first + f.second < last)
+                bounds.push_back(f.first + f.second);
+        }
+        std::sort(bounds.begin(), bounds.end());
+        bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+        for(size_t i = 0; i + 1 != bounds.size(); ++i)
+            pieces.push_back(code_piece{s, bounds[i], bounds[i + 1]});
+    }
+
+    disassembly result;
+    if(pieces.empty())
+        return result;
+
+    vector<vector<instruction>> decoded(pieces.size());
+
+    if(!disassembler_thread_safe())
+        threads = 1;
+    threads = std::min(thread_count(threads), pieces.size());
+
+    // one decoder per thread, pieces are handed out in order
+    vector<std::unique_ptr<decoder>> decoders(threads);
+    std::atomic<size_t> next(0);
+    parallel_for(decoders.size(), decoders.size(), [&](size_t t)
+    {
+        size_t current = pieces[0].section;
+        decoders[t].reset(new decoder(sections[current]));
+        for(size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < pieces.size(); )
+        {
+            if(pieces[i].section != current)
+                decoders[t]->select(sections[current = pieces[i].section]);
+            decoders[t]->run(pieces[i].first, pieces[i].last, decoded[i]);
+        }
+    });
+
+    size_t total = 0;
+    for(vector<instruction> const& piece : decoded)
+        total += piece.size();
+    if(total > uint32_t(-1))
+        throw std::length_error("too many instructions");
+
+    result.instructions.reserve(total);
+    result.functions.reserve(pieces.size());
+    for(size_t i = 0; i != pieces.size(); ++i)
+    {
+        code_piece const& p = pieces[i];
+        result.functions.push_back(code_range{p.first, p.last - p.first, uint32_t(result.instructions.size()), uint32_t(decoded[i].size()), sections[p.section].section});
+        result.instructions.insert(result.instructions.end(), decoded[i].begin(), decoded[i].end());
+        vector<instruction>().swap(decoded[i]);
+    }
+    return result;
+}
+
+}
+
+}
+
+#endif
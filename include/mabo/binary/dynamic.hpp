@@ -0,0 +1,147 @@
+#ifndef MABO_BINARY_DYNAMIC_HPP_INCLUDED
+#define MABO_BINARY_DYNAMIC_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+
+#include <elf.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace mabo
+{
+
+// one entry of an ELF .dynamic section
+struct dynamic_entry
+{
+    int64_t tag;
+    uint64_t value;
+    string_view str;    // for string valued tags, points into .dynstr
+};
+
+// the .dynamic section of an ELF object, parsed once in a single pass
+// strings are views into the object's .dynstr and live as long as the object
+struct dynamic_table
+{
+    dynamic_table() : flags_(0), flags_1_(0)
+    {
+    }
+
+    // Dyn is Elf32_Dyn or Elf64_Dyn, stops at DT_NULL
+    template<class Dyn>
+    static dynamic_table parse(char const* data, size_t size, string_view dynstr)
+    {
+        dynamic_table table;
+        for(size_t i = 0; i + sizeof(Dyn) <= size; i += sizeof(Dyn))
+        {
+            Dyn dyn;
+            std::memcpy(&dyn, data + i, sizeof(dyn));
+            if(dyn.d_tag == DT_NULL)
+                break;
+
+            dynamic_entry entry{int64_t(dyn.d_tag), uint64_t(dyn.d_un.d_val), {}};
+            if(is_string(entry.tag) && entry.value < dynstr.size())
+            {
+                char const* s = dynstr.data() + entry.value;
+                entry.str = string_view(s, strnlen(s, dynstr.size() - entry.value));
+            }
+            table.add(entry);
+        }
+        return table;
+    }
+
+    vector<dynamic_entry> const& entries() const
+    {
+        return entries_;
+    }
+
+    bool empty() const
+    {
+        return entries_.empty();
+    }
+
+    // value of the first entry with this tag
+    optional<uint64_t> value(int64_t tag) const
+    {
+        for(dynamic_entry const& entry : entries_)
+            if(entry.tag == tag)
+                return entry.value;
+        return {};
+    }
+
+    vector<string_view> const& needed() const
+    {
+        return needed_;
+    }
+
+    string_view soname() const
+    {
+        return soname_;
+    }
+
+    vector<string_view> const& rpath() const
+    {
+        return rpath_;
+    }
+
+    vector<string_view> const& runpath() const
+    {
+        return runpath_;
+    }
+
+    uint64_t flags() const
+    {
+        return flags_;
+    }
+
+    uint64_t flags_1() const
+    {
+        return flags_1_;
+    }
+
+private:
+    static bool is_string(int64_t tag)
+    {
+        switch(tag)
+        {
+        case DT_NEEDED:
+        case DT_SONAME:
+        case DT_RPATH:
+        case DT_RUNPATH:
+        case DT_AUXILIARY:
+        case DT_FILTER:
+        case DT_CONFIG:
+        case DT_DEPAUDIT:
+        case DT_AUDIT:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    void add(dynamic_entry const& entry)
+    {
+        switch(entry.tag)
+        {
+        case DT_NEEDED:  needed_.push_back(entry.str); break;
+        case DT_SONAME:  soname_ = entry.str; break;
+        case DT_RPATH:   rpath_.push_back(entry.str); break;
+        case DT_RUNPATH: runpath_.push_back(entry.str); break;
+        case DT_FLAGS:   flags_ = entry.value; break;
+        case DT_FLAGS_1: flags_1_ = entry.value; break;
+        }
+        entries_.push_back(entry);
+    }
+
+    vector<dynamic_entry> entries_;
+    vector<string_view> needed_;
+    string_view soname_;
+    vector<string_view> rpath_;
+    vector<string_view> runpath_;
+    uint64_t flags_;
+    uint64_t flags_1_;
+};
+
+}
+
+#endif
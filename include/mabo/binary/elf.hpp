@@ -0,0 +1,1481 @@
+#ifndef MABO_BINARY_ELF_HPP_INCLUDED
+#define MABO_BINARY_ELF_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+#include <mabo/utility.hpp>
+#include <mabo/parallel.hpp>
+#include <mabo/binary/dynamic.hpp>
+#include <mabo/binary/search_path.hpp>
+#include <mabo/binary/symbol_hash.hpp>
+#include <mabo/binary/disassembler.hpp>
+#include <mabo/binary/relocation.hpp>
+#include <mabo/stats.hpp>
+
+#include <elf.h>
+#include <ar.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <range/v3/view.hpp>
+#include <range/v3/algorithm.hpp>
+
+#include <type_traits>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <stdexcept>
+
+namespace mabo { namespace detail { namespace elf
+{
+
+// read-only mapping of a whole file, shared by all objects that view into it
+struct mapped_file
+{
+    explicit mapped_file(string_view path) : path(path.to_string()), data_(0), size_(0)
+    {
+        MABO_PHASE(OPEN);
+        int fd = ::open(this->path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0)
+            throw std::runtime_error("failed to load binary " + this->path);
+
+        struct stat st;
+        if(::fstat(fd, &st) < 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("failed to load binary " + this->path);
+        }
+
+        size_ = st.st_size;
+        if(size_)
+        {
+            void* p = ::mmap(0, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(p == MAP_FAILED)
+            {
+                ::close(fd);
+                throw std::runtime_error("failed to map binary " + this->path);
+            }
+            data_ = static_cast<char const*>(p);
+        }
+        ::close(fd);
+
+        MABO_COUNT(FILES_OPENED, 1);
+        MABO_COUNT(BYTES_READ, size_);
+    }
+
+    mapped_file(mapped_file const&) = delete;
+    mapped_file& operator=(mapped_file const&) = delete;
+
+    ~mapped_file()
+    {
+        if(data_)
+            ::munmap(const_cast<char*>(data_), size_);
+    }
+
+    string_view name() const
+    {
+        return path;
+    }
+
+    char const* data() const
+    {
+        return data_;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+private:
+    string path;
+    char const* data_;
+    size_t size_;
+};
+
+struct armap_entry
+{
+    string_view name;   // symbol defined by the member
+    size_t member;      // file offset of the member, identifies it
+};
+
+// unaligned-safe read, archive members are only 2-byte aligned
+template<class T>
+T read(char const* p)
+{
+    T t;
+    std::memcpy(&t, p, sizeof(T));
+    return t;
+}
+
+struct elf32
+{
+    typedef Elf32_Ehdr ehdr;
+    typedef Elf32_Shdr shdr;
+    typedef Elf32_Sym  sym;
+    typedef Elf32_Dyn  dyn;
+    typedef Elf32_Rel  rel;
+    typedef Elf32_Rela rela;
+
+    static unsigned char bind(unsigned char info) { return ELF32_ST_BIND(info); }
+    static unsigned char type(unsigned char info) { return ELF32_ST_TYPE(info); }
+    static uint32_t r_sym(uint64_t info) { return ELF32_R_SYM(info); }
+    static uint32_t r_type(uint64_t info) { return ELF32_R_TYPE(info); }
+};
+
+struct elf64
+{
+    typedef Elf64_Ehdr ehdr;
+    typedef Elf64_Shdr shdr;
+    typedef Elf64_Sym  sym;
+    typedef Elf64_Dyn  dyn;
+    typedef Elf64_Rel  rel;
+    typedef Elf64_Rela rela;
+
+    static unsigned char bind(unsigned char info) { return ELF64_ST_BIND(info); }
+    static unsigned char type(unsigned char info) { return ELF64_ST_TYPE(info); }
+    static uint32_t r_sym(uint64_t info) { return ELF64_R_SYM(info); }
+    static uint32_t r_type(uint64_t info) { return ELF64_R_TYPE(info); }
+};
+
+inline uint64_t big_endian(char const* p, size_t n)
+{
+    uint64_t value = 0;
+    for(size_t i = 0; i != n; ++i)
+        value = (value << 8) | (unsigned char)p[i];
+    return value;
+}
+
+inline bool is_elf(char const* data, size_t size)
+{
+    return size >= EI_NIDENT && !std::memcmp(data, ELFMAG, SELFMAG);
+}
+
+inline bool is_archive(char const* data, size_t size)
+{
+    return size >= SARMAG && !std::memcmp(data, ARMAG, SARMAG);
+}
+
+// ELF of a class and byte order image can read, archive members that are not
+// are skipped rather than failing the whole archive
+inline bool is_native_elf(char const* data, size_t size)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    unsigned char order = ELFDATA2LSB;
+#else
+    unsigned char order = ELFDATA2MSB;
+#endif
+    return is_elf(data, size)
+        && (data[EI_CLASS] == ELFCLASS32 || data[EI_CLASS] == ELFCLASS64)
+        && data[EI_DATA] == order;
+}
+
+// NUL-terminated strings inside a string table, never read past its end
+struct string_table
+{
+    string_table() : data(0), size(0) {}
+    string_table(char const* data, size_t size) : data(data), size(size) {}
+
+    string_view operator[](size_t offset) const
+    {
+        if(offset >= size)
+            return string_view();
+
+        char const* s = data + offset;
+        return string_view(s, ::strnlen(s, size - offset));
+    }
+
+    char const* data;
+    size_t size;
+};
+
+struct section_info
+{
+    string_view name;
+    uint32_t type;
+    uint32_t link;
+    uint32_t info;
+    uint64_t flags;
+    uint64_t addr;
+    uint64_t entsize;
+    char const* data;
+    size_t size;
+    uint64_t memsize;       // sh_size, also for SHT_NOBITS
+};
+
+struct symbol_entry
+{
+    // defined in sections[shndx]
+    bool in_section() const
+    {
+        return shndx != SHN_UNDEF && !reserved;
+    }
+
+    uint32_t name;
+    unsigned char bind;
+    unsigned char type;
+    bool reserved;          // shndx is SHN_ABS, SHN_COMMON and the like
+    uint32_t shndx;         // SHN_XINDEX resolved through SHT_SYMTAB_SHNDX
+    uint64_t value;
+    uint64_t size;
+};
+
+struct symbol_table
+{
+    symbol_table() : entries(0), count(0), entsize(0), xindex(0), xindex_count(0) {}
+
+    template<class Elf>
+    symbol_entry entry(size_t i) const
+    {
+        typename Elf::sym sym = read<typename Elf::sym>(entries + i * entsize);
+
+        symbol_entry e;
+        e.name = sym.st_name;
+        e.bind = Elf::bind(sym.st_info);
+        e.type = Elf::type(sym.st_info);
+        e.shndx = sym.st_shndx;
+        e.reserved = e.shndx >= SHN_LORESERVE;
+        e.value = sym.st_value;
+        e.size = sym.st_size;
+
+        if(e.shndx == SHN_XINDEX && i < xindex_count)
+        {
+            e.shndx = read<uint32_t>(xindex + i * sizeof(uint32_t));
+            e.reserved = false;
+        }
+        return e;
+    }
+
+    char const* entries;
+    size_t count;
+    size_t entsize;
+    string_table strings;
+    char const* xindex;     // SHT_SYMTAB_SHNDX entries, one per symbol
+    size_t xindex_count;
+};
+
+struct archive_image;
+
+// one ELF file, either standalone or an archive member
+struct image
+{
+    image(std::shared_ptr<mapped_file const> file, std::shared_ptr<archive_image const> ar, string_view name, char const* base, size_t size)
+    : file(std::move(file))
+    , ar(std::move(ar))
+    , name(name)
+    , base(base)
+    , size(size)
+    {
+        if(!is_elf(base, size))
+            throw std::runtime_error("unsupported file type");
+
+        if(base[EI_CLASS] != ELFCLASS32 && base[EI_CLASS] != ELFCLASS64)
+            throw std::runtime_error("unsupported ELF class");
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        if(base[EI_DATA] != ELFDATA2LSB)
+#else
+        if(base[EI_DATA] != ELFDATA2MSB)
+#endif
+            throw std::runtime_error("unsupported ELF byte order");
+
+        is64 = base[EI_CLASS] == ELFCLASS64;
+        if(size < (is64 ? sizeof(Elf64_Ehdr) : sizeof(Elf32_Ehdr)))
+            throw std::runtime_error("truncated ELF header");
+        machine = read<uint16_t>(base + offsetof(Elf64_Ehdr, e_machine));
+        if(is64)
+            load_sections(elf64());
+        else
+            load_sections(elf32());
+    }
+
+    template<class F>
+    auto visit(F&& f) const -> decltype(f(elf64()))
+    {
+        return is64 ? f(elf64()) : f(elf32());
+    }
+
+    symbol_entry entry(symbol_table const& table, size_t i) const
+    {
+        return is64 ? table.entry<elf64>(i) : table.entry<elf32>(i);
+    }
+
+    section_info const* find_section(string_view section_name) const
+    {
+        for(section_info const& sec : sections)
+            if(sec.name == section_name)
+                return &sec;
+        return 0;
+    }
+
+    section_info const* find_section(uint32_t type) const
+    {
+        for(section_info const& sec : sections)
+            if(sec.type == type)
+                return &sec;
+        return 0;
+    }
+
+    // sec has to be one of sections
+    symbol_table table_of(section_info const& sec) const
+    {
+        if(sec.link >= sections.size())
+            throw std::runtime_error("malformed ELF symbol table");
+
+        symbol_table table;
+        table.entsize = sec.entsize ? sec.entsize : (is64 ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym));
+        if(table.entsize < (is64 ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym)))
+            throw std::runtime_error("malformed ELF symbol table");
+
+        table.entries = sec.data;
+        table.count = sec.size / table.entsize;
+        table.strings = string_table(sections[sec.link].data, sections[sec.link].size);
+
+        uint32_t index = &sec - sections.data();
+        for(section_info const& shndx : sections)
+        {
+            if(shndx.type == SHT_SYMTAB_SHNDX && shndx.link == index)
+            {
+                table.xindex = shndx.data;
+                table.xindex_count = shndx.size / sizeof(uint32_t);
+                break;
+            }
+        }
+        return table;
+    }
+
+    // the lazily loaded parts are filled in once, by whichever thread gets there first
+
+    dynamic_table const& dynamic() const
+    {
+        std::call_once(dynamic_once, [this]()
+        {
+            section_info const* dyn = find_section(SHT_DYNAMIC);
+            if(dyn && dyn->link < sections.size())
+            {
+                section_info const& dynstr = sections[dyn->link];
+                string_view strings(dynstr.data, dynstr.size);
+                dynamic_ = is64
+                         ? dynamic_table::parse<elf64::dyn>(dyn->data, dyn->size, strings)
+                         : dynamic_table::parse<elf32::dyn>(dyn->data, dyn->size, strings);
+            }
+        });
+        return dynamic_;
+    }
+
+    // .dynsym with its .gnu.hash or .hash, straight from the mapping
+    dynamic_symbols const& hashed_symbols() const
+    {
+        std::call_once(hashed_once, [this]()
+        {
+            section_info const* dynsym = find_section(SHT_DYNSYM);
+            if(!dynsym || dynsym->link >= sections.size())
+                return;
+
+            hashed_.syms = dynsym->data;
+            hashed_.syms_size = dynsym->size;
+            hashed_.strings = string_view(sections[dynsym->link].data, sections[dynsym->link].size);
+            hashed_.is64 = is64;
+
+            if(section_info const* gnu_hash = find_section(SHT_GNU_HASH))
+            {
+                hashed_.gnu_hash = gnu_hash->data;
+                hashed_.gnu_hash_size = gnu_hash->size;
+            }
+            if(section_info const* hash = find_section(SHT_HASH))
+            {
+                hashed_.hash = hash->data;
+                hashed_.hash_size = hash->size;
+            }
+            if(section_info const* versym = find_section(SHT_GNU_versym))
+            {
+                hashed_.versym = versym->data;
+                hashed_.versym_size = versym->size;
+            }
+        });
+        return hashed_;
+    }
+
+    // relocations against .symtab applying to section i, decoded once on first use
+    vector<relocation> const& relocations(size_t i) const
+    {
+        {
+            std::lock_guard<std::mutex> lock(relocations_mutex);
+            index_relocations();
+            if(relocations_[i])
+                return *relocations_[i];
+        }
+
+        // decoded outside the lock, sections are independent
+        std::unique_ptr<vector<relocation>> decoded(new vector<relocation>(is64 ? decode_relocations<elf64>(i) : decode_relocations<elf32>(i)));
+
+        std::lock_guard<std::mutex> lock(relocations_mutex);
+        if(!relocations_[i])
+            relocations_[i] = std::move(decoded);
+        return *relocations_[i];
+    }
+
+    // the sections relocations apply to
+    vector<size_t> relocated_sections() const
+    {
+        std::lock_guard<std::mutex> lock(relocations_mutex);
+        index_relocations();
+
+        vector<size_t> result;
+        for(size_t i = 0; i != relocation_sections_.size(); ++i)
+            if(!relocation_sections_[i].empty())
+                result.push_back(i);
+        return result;
+    }
+
+    void load_symbols()
+    {
+        std::call_once(symbols_once, [this]()
+        {
+            MABO_PHASE(LOAD_SYMBOLS);
+            load_table(SHT_SYMTAB, symtab, symbols_, symbols_part1, symbols_part2);
+            load_table(SHT_DYNSYM, dynsym, dyn_symbols_, dyn_symbols_part1, dyn_symbols_part2);
+            MABO_COUNT(SYMBOLS_LOADED, symbols_.size() + dyn_symbols_.size());
+        });
+    }
+
+    std::shared_ptr<mapped_file const> file;
+    std::shared_ptr<archive_image const> ar;
+    string_view name;
+    char const* base;
+    size_t size;
+    bool is64;
+    uint16_t machine;
+
+    vector<section_info> sections;
+
+    mutable std::once_flag dynamic_once;
+    mutable dynamic_table dynamic_;
+    mutable std::once_flag hashed_once;
+    mutable dynamic_symbols hashed_;
+
+    mutable std::mutex relocations_mutex;
+    mutable vector<vector<uint32_t>> relocation_sections_;
+    mutable vector<std::unique_ptr<vector<relocation>>> relocations_;
+
+    // name to index in the table symbols() uses, for objects without a hash table
+    std::once_flag symbol_index_once;
+    std::unordered_map<string_view, uint32_t> symbol_index;
+
+    std::once_flag symbols_once;
+    symbol_table symtab;
+    vector<uint32_t> symbols_;
+    size_t symbols_part1;
+    size_t symbols_part2;
+    symbol_table dynsym;
+    vector<uint32_t> dyn_symbols_;
+    size_t dyn_symbols_part1;
+    size_t dyn_symbols_part2;
+
+private:
+    template<class Elf>
+    void load_sections(Elf)
+    {
+        typedef typename Elf::ehdr ehdr_type;
+        typedef typename Elf::shdr shdr_type;
+
+        if(size < sizeof(ehdr_type))
+            throw std::runtime_error("truncated ELF header");
+
+        ehdr_type ehdr = read<ehdr_type>(base);
+        if(!ehdr.e_shoff)
+            return;
+
+        if(ehdr.e_shentsize < sizeof(shdr_type) || ehdr.e_shoff > size || size - ehdr.e_shoff < sizeof(shdr_type))
+            throw std::runtime_error("malformed ELF section table");
+
+        // extended numbering lives in the first section header
+        shdr_type first = read<shdr_type>(base + ehdr.e_shoff);
+        size_t shnum = ehdr.e_shnum ? ehdr.e_shnum : first.sh_size;
+        size_t shstrndx = ehdr.e_shstrndx == SHN_XINDEX ? first.sh_link : ehdr.e_shstrndx;
+
+        if(shnum > (size - ehdr.e_shoff) / ehdr.e_shentsize)
+            throw std::runtime_error("malformed ELF section table");
+
+        sections.resize(shnum);
+        for(size_t i = 0; i != shnum; ++i)
+        {
+            shdr_type shdr = read<shdr_type>(base + ehdr.e_shoff + i * ehdr.e_shentsize);
+            section_info& sec = sections[i];
+
+            sec.type = shdr.sh_type;
+            sec.link = shdr.sh_link;
+            sec.info = shdr.sh_info;
+            sec.flags = shdr.sh_flags;
+            sec.addr = shdr.sh_addr;
+            sec.entsize = shdr.sh_entsize;
+            sec.data = base;
+            sec.size = 0;
+            sec.memsize = shdr.sh_type == SHT_NULL ? 0 : shdr.sh_size;
+            name_offsets.push_back(shdr.sh_name);
+
+            if(shdr.sh_type != SHT_NOBITS && shdr.sh_type != SHT_NULL)
+            {
+                if(shdr.sh_offset > size || shdr.sh_size > size - shdr.sh_offset)
+                    throw std::runtime_error("malformed ELF section header");
+
+                sec.data = base + shdr.sh_offset;
+                sec.size = shdr.sh_size;
+            }
+        }
+
+        // names are resolved once all headers are in
+        if(shstrndx < shnum)
+        {
+            string_table shstrtab(sections[shstrndx].data, sections[shstrndx].size);
+            for(size_t i = 0; i != shnum; ++i)
+                sections[i].name = shstrtab[name_offsets[i]];
+        }
+        name_offsets.clear();
+        name_offsets.shrink_to_fit();
+    }
+
+    // which relocation sections apply to each section, called with relocations_mutex held
+    void index_relocations() const
+    {
+        if(!relocations_.empty())
+            return;
+
+        relocation_sections_.resize(sections.size());
+        for(uint32_t i = 0; i != sections.size(); ++i)
+        {
+            section_info const& sec = sections[i];
+
+            // only the static relocations of relocatable objects or --emit-relocs links,
+            // the dynamic ones refer to .dynsym and apply to the loaded image
+            if((sec.type == SHT_RELA || sec.type == SHT_REL) && sec.size && sec.info < sections.size()
+               && sec.link < sections.size() && sections[sec.link].type == SHT_SYMTAB)
+                relocation_sections_[sec.info].push_back(i);
+        }
+        relocations_.resize(sections.size());
+    }
+
+    template<class Elf>
+    vector<relocation> decode_relocations(size_t target) const
+    {
+        vector<relocation> result;
+        for(uint32_t index : relocation_sections_[target])
+        {
+            section_info const& sec = sections[index];
+            symbol_table table = table_of(sections[sec.link]);
+            bool rela = sec.type == SHT_RELA;
+            size_t min_size = rela ? sizeof(typename Elf::rela) : sizeof(typename Elf::rel);
+            size_t entsize = sec.entsize ? sec.entsize : min_size;
+            if(entsize < min_size)
+                throw std::runtime_error("malformed ELF relocation section");
+
+            result.reserve(result.size() + sec.size / entsize);
+            for(size_t offset = 0; offset + entsize <= sec.size; offset += entsize)
+            {
+                relocation rel{sections[target].name, 0, 0, 0, {}, {}, false, uint32_t(target), relocation::npos};
+                uint64_t info;
+                if(rela)
+                {
+                    typename Elf::rela r = read<typename Elf::rela>(sec.data + offset);
+                    rel.offset = r.r_offset;
+                    rel.addend = r.r_addend;
+                    info = r.r_info;
+                }
+                else
+                {
+                    typename Elf::rel r = read<typename Elf::rel>(sec.data + offset);
+                    rel.offset = r.r_offset;
+                    info = r.r_info;
+                }
+                rel.type = Elf::r_type(info);
+
+                uint32_t sym = Elf::r_sym(info);
+                if(sym && sym < table.count)
+                {
+                    symbol_entry e = entry(table, sym);
+                    rel.local = e.bind == STB_LOCAL;
+                    if(e.in_section() && e.shndx < sections.size())
+                    {
+                        rel.target = sections[e.shndx].name;
+                        rel.target_index = e.shndx;
+                    }
+                    rel.symbol = e.type == STT_SECTION ? rel.target : table.strings[e.name];
+                }
+                result.push_back(rel);
+            }
+        }
+        return result;
+    }
+
+    void load_table(uint32_t type, symbol_table& table, vector<uint32_t>& indices, size_t& part1, size_t& part2)
+    {
+        part1 = part2 = 0;
+        indices.clear();
+
+        section_info const* sec = find_section(type);
+        if(!sec || sec->link >= sections.size())
+            return;
+
+        table = table_of(*sec);
+
+        // skip the reserved null symbol
+        indices.reserve(table.count);
+        for(uint32_t i = 1; i < table.count; ++i)
+            indices.push_back(i);
+
+        // same partitioning as libbfd: imports, then globals, then locals
+        auto is_import = [&](uint32_t i)
+        {
+            return entry(table, i).shndx == SHN_UNDEF;
+        };
+        auto is_global = [&](uint32_t i)
+        {
+            return entry(table, i).bind != STB_LOCAL;
+        };
+
+        part1 = std::partition(indices.begin(), indices.end(), is_import) - indices.begin();
+        part2 = std::partition(indices.begin() + part1, indices.end(), is_global) - indices.begin();
+    }
+
+    vector<uint32_t> name_offsets;
+};
+
+// member table of an ar archive, in the GNU or BSD flavour
+struct archive_image
+{
+    struct member
+    {
+        string_view name;
+        size_t header;  // offset of the ar header, identifies the member
+        size_t next;    // offset of the next ar header
+        char const* data;
+        size_t size;
+    };
+
+    explicit archive_image(std::shared_ptr<mapped_file const> file) : file(std::move(file))
+    {
+        if(!is_archive(this->file->data(), this->file->size()))
+            throw std::runtime_error("unsupported file type");
+
+        // the long name table always precedes regular members
+        member m;
+        for(size_t offset = SARMAG; read_member(offset, m); offset = m.next)
+        {
+            if(m.name == "//")
+            {
+                longnames = string_view(m.data, m.size);
+                break;
+            }
+            if(!special(m.name))
+                break;
+        }
+    }
+
+    // parsed on first use, most clients never need it
+    vector<armap_entry> const& armap() const
+    {
+        std::call_once(armap_once, [this]()
+        {
+            member m;
+            for(size_t offset = SARMAG; read_member(offset, m) && special(m.name); offset = m.next)
+            {
+                if(m.name == "/")
+                    load_gnu_armap(m, 4);
+                else if(m.name == "/SYM64/")
+                    load_gnu_armap(m, 8);
+                else if(m.name == "__.SYMDEF" || m.name == "__.SYMDEF SORTED")
+                    load_bsd_armap(m);
+            }
+        });
+        return armap_;
+    }
+
+    // special members hold the symbol index or long names, never objects
+    static bool special(string_view name)
+    {
+        return name == "/" || name == "//" || name == "/SYM64/"
+            || name == "__.SYMDEF" || name == "__.SYMDEF SORTED";
+    }
+
+    bool read_member(size_t offset, member& m) const
+    {
+        char const* data = file->data();
+        size_t size = file->size();
+
+        if(offset >= size || size - offset < sizeof(ar_hdr))
+            return false;
+
+        ar_hdr hdr = read<ar_hdr>(data + offset);
+        if(std::memcmp(hdr.ar_fmag, ARFMAG, sizeof(hdr.ar_fmag)))
+            throw std::runtime_error("malformed archive member header");
+
+        size_t member_size = decimal(hdr.ar_size, sizeof(hdr.ar_size));
+        size_t start = offset + sizeof(ar_hdr);
+        if(member_size > size - start)
+            throw std::runtime_error("truncated archive member");
+
+        m.header = offset;
+        m.data = data + start;
+        m.size = member_size;
+        m.next = start + member_size + (member_size & 1);
+
+        string_view raw(data + offset, sizeof(hdr.ar_name));
+        raw = raw.substr(0, raw.find_last_not_of(' ') + 1);
+
+        if(raw == "/" || raw == "//" || raw == "/SYM64/")
+        {
+            m.name = raw;
+        }
+        else if(raw.size() > 1 && raw[0] == '/')
+        {
+            // GNU long name, "/\n" terminated
+            size_t pos = decimal(raw.data() + 1, raw.size() - 1);
+            if(pos >= longnames.size())
+                throw std::runtime_error("malformed archive long name");
+
+            string_view name = longnames.substr(pos);
+            m.name = name.substr(0, name.find('\n'));
+            if(!m.name.empty() && m.name.back() == '/')
+                m.name.remove_suffix(1);
+        }
+        else if(raw.size() > 3 && raw.substr(0, 3) == "#1/")
+        {
+            // BSD long name, stored in front of the member data
+            size_t len = decimal(raw.data() + 3, raw.size() - 3);
+            if(len > m.size)
+                throw std::runtime_error("malformed archive long name");
+
+            m.name = string_view(m.data, ::strnlen(m.data, len));
+            m.data += len;
+            m.size -= len;
+        }
+        else
+        {
+            m.name = raw;
+            if(!m.name.empty() && m.name.back() == '/')
+                m.name.remove_suffix(1);
+        }
+
+        return true;
+    }
+
+    std::shared_ptr<mapped_file const> file;
+    string_view longnames;
+
+private:
+    // big-endian count and member offsets followed by the names
+    void load_gnu_armap(member const& m, size_t width) const
+    {
+        if(m.size < width)
+            throw std::runtime_error("malformed archive symbol index");
+
+        size_t count = big_endian(m.data, width);
+        if(count > (m.size - width) / width)
+            throw std::runtime_error("malformed archive symbol index");
+
+        string_table names(m.data + width * (count + 1), m.size - width * (count + 1));
+        size_t name = 0;
+
+        armap_.reserve(armap_.size() + count);
+        for(size_t i = 0; i != count; ++i)
+        {
+            string_view sym = names[name];
+            armap_.push_back(armap_entry{sym, big_endian(m.data + width * (i + 1), width)});
+            name += sym.size() + 1;
+        }
+    }
+
+    // byte size and ranlib entries, then byte size and the string table, all native-endian
+    void load_bsd_armap(member const& m) const
+    {
+        if(m.size < 4)
+            throw std::runtime_error("malformed archive symbol index");
+
+        size_t ranlib_size = read<uint32_t>(m.data);
+        if(ranlib_size > m.size - 4 || m.size - 4 - ranlib_size < 4)
+            throw std::runtime_error("malformed archive symbol index");
+
+        char const* ranlib = m.data + 4;
+        size_t strings_size = read<uint32_t>(ranlib + ranlib_size);
+        if(strings_size > m.size - 8 - ranlib_size)
+            throw std::runtime_error("malformed archive symbol index");
+
+        string_table names(ranlib + ranlib_size + 4, strings_size);
+
+        armap_.reserve(armap_.size() + ranlib_size / 8);
+        for(size_t i = 0; i + 8 <= ranlib_size; i += 8)
+            armap_.push_back(armap_entry{names[read<uint32_t>(ranlib + i)], read<uint32_t>(ranlib + i + 4)});
+    }
+
+    mutable std::once_flag armap_once;
+    mutable vector<armap_entry> armap_;
+
+    static size_t decimal(char const* p, size_t n)
+    {
+        size_t value = 0;
+        for(size_t i = 0; i != n && p[i] >= '0' && p[i] <= '9'; ++i)
+            value = value * 10 + (p[i] - '0');
+        return value;
+    }
+};
+
+} } }
+
+namespace mabo { namespace elf
+{
+
+using detail::elf::armap_entry;
+
+// whether distinct objects can load their symbols concurrently
+inline bool thread_safe()
+{
+    return true;
+}
+
+// whether members of one archive can be opened concurrently
+inline bool archive_thread_safe()
+{
+    return true;
+}
+
+struct object;
+struct section;
+
+// points into the mapped symbol table, keeps its object alive
+struct symbol
+{
+    symbol(std::shared_ptr<detail::elf::image> img, detail::elf::symbol_table const* table, uint32_t index) : img(std::move(img)), table(table), index(index)
+    {
+        assert(this->img && table);
+    }
+
+    elf::object object() const;
+
+    // the section it is defined in, none for undefined, absolute and common symbols
+    optional<elf::section> section() const;
+
+    string_view name() const
+    {
+        return table->strings[entry().name];
+    }
+
+    size_t addr() const
+    {
+        return entry().value;
+    }
+
+    size_t size() const
+    {
+        return entry().size;
+    }
+
+    bool global() const
+    {
+        return entry().bind != STB_LOCAL;
+    }
+
+    bool weak() const
+    {
+        return entry().bind == STB_WEAK;
+    }
+
+    // STT_FUNC, STT_OBJECT and so on
+    unsigned char type() const
+    {
+        return entry().type;
+    }
+
+private:
+    friend struct object;
+
+    detail::elf::symbol_entry entry() const
+    {
+        return img->entry(*table, index);
+    }
+
+    std::shared_ptr<detail::elf::image> img;
+    detail::elf::symbol_table const* table;
+    uint32_t index;
+};
+
+struct section
+{
+    section(std::shared_ptr<detail::elf::image> img, detail::elf::section_info const* sec) : img(std::move(img)), sec(sec)
+    {
+        assert(sec);
+    }
+
+    string_view name() const
+    {
+        return sec->name;
+    }
+
+    // sh_addr, 0 in relocatable objects
+    uint64_t addr() const
+    {
+        return sec->addr;
+    }
+
+    // bytes it takes up once loaded, data() is empty for .bss and the like
+    uint64_t size() const
+    {
+        return sec->memsize;
+    }
+
+    // sh_flags, SHF_ALLOC and so on
+    uint64_t flags() const
+    {
+        return sec->flags;
+    }
+
+    // the section header index, names can repeat
+    uint32_t index() const
+    {
+        return uint32_t(sec - img->sections.data());
+    }
+
+    // the bytes in place, archive members are only 2-byte aligned and
+    // sh_offset needn't be aligned either, so wider types go through read<T>
+    template<class T>
+    auto data() const
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "sections can only be reinterpreted as trivial types");
+        static_assert(alignof(T) == 1, "section contents may be unaligned, read wider types with memcpy");
+
+        T const* first = reinterpret_cast<T const*>(sec->data);
+        return ranges::make_iterator_range(first, first + sec->size / sizeof(T));
+    }
+
+private:
+    friend struct object;
+
+    std::shared_ptr<detail::elf::image> img;
+    detail::elf::section_info const* sec;
+};
+
+struct archive;
+
+struct object
+{
+    explicit object(std::shared_ptr<detail::elf::image> img) : img(std::move(img))
+    {
+        assert(this->img);
+    }
+
+    string_view name() const
+    {
+        return img->name;
+    }
+
+    // where the object starts in its file, tells archive members apart
+    size_t offset() const
+    {
+        return img->base - img->file->data();
+    }
+
+    auto sections() const
+    {
+        std::shared_ptr<detail::elf::image> owner = img;
+        return ranges::make_iterator_range(img->sections.cbegin(), img->sections.cend())
+             | ranges::view::transform([owner](detail::elf::section_info const& sec) { return elf::section(owner, &sec); });
+    }
+
+    optional<elf::section> section(string_view name) const
+    {
+        detail::elf::section_info const* sec = img->find_section(name);
+        if(sec)
+            return elf::section(img, sec);
+        else
+            return {};
+    }
+
+    optional<elf::archive> archive() const;
+
+    auto symbols() const
+    {
+        std::shared_ptr<detail::elf::image> img = this->img;
+        img->load_symbols();
+
+        // pick one, prefer symtab over dynsym
+        bool use_symtab = img->symbols_part2 - img->symbols_part1;
+        detail::elf::symbol_table const* table = use_symtab ? &img->symtab : &img->dynsym;
+
+        return  (
+                    use_symtab
+                    ?   ranges::make_iterator_range(img->symbols_.cbegin() + img->symbols_part1, img->symbols_.cbegin() + img->symbols_part2)
+                    :   ranges::make_iterator_range(img->dyn_symbols_.cbegin() + img->dyn_symbols_part1, img->dyn_symbols_.cbegin() + img->dyn_symbols_part2)
+                )
+                | ranges::view::transform([img, table](uint32_t i) { return symbol(img, table, i); })
+        ;
+    }
+
+    // a defined, non-local symbol by name: shared objects are looked up through
+    // their .gnu.hash or .hash like ld.so does, without loading any symbols
+    // unless there is a match, anything else through an index built once
+    optional<symbol> find_symbol(string_view name) const
+    {
+        detail::dynamic_symbols const& hashed = img->hashed_symbols();
+        if(hashed.available())
+        {
+            size_t i = hashed.find(name);
+            if(i == detail::dynamic_symbols::npos)
+                return {};
+
+            img->load_symbols();
+            return symbol(img, &img->dynsym, i);
+        }
+
+        img->load_symbols();
+        bool use_symtab = img->symbols_part2 - img->symbols_part1;
+        detail::elf::symbol_table const* table = use_symtab ? &img->symtab : &img->dynsym;
+
+        std::call_once(img->symbol_index_once, [this]()
+        {
+            for(symbol const& sym : symbols())
+                img->symbol_index.emplace(sym.name(), sym.index);
+        });
+
+        auto it = img->symbol_index.find(name);
+        if(it == img->symbol_index.end())
+            return {};
+        return symbol(img, table, it->second);
+    }
+
+    auto imports() const
+    {
+        std::shared_ptr<detail::elf::image> img = this->img;
+        img->load_symbols();
+
+        // pick one, prefer dynsym over symtab
+        bool use_dynsym = img->dyn_symbols_part1;
+        detail::elf::symbol_table const* table = use_dynsym ? &img->dynsym : &img->symtab;
+
+        return  (
+                    use_dynsym
+                    ?   ranges::make_iterator_range(img->dyn_symbols_.cbegin(), img->dyn_symbols_.cbegin() + img->dyn_symbols_part1)
+                    :   ranges::make_iterator_range(img->symbols_.cbegin(), img->symbols_.cbegin() + img->symbols_part1)
+                )
+                | ranges::view::transform([img, table](uint32_t i) { return symbol(img, table, i); })
+        ;
+    }
+
+    // the STB_LOCAL symbols of .symtab, none without one
+    auto local_symbols() const
+    {
+        std::shared_ptr<detail::elf::image> img = this->img;
+        img->load_symbols();
+
+        detail::elf::symbol_table const* table = &img->symtab;
+        return ranges::make_iterator_range(img->symbols_.cbegin() + img->symbols_part2, img->symbols_.cend())
+             | ranges::view::transform([img, table](uint32_t i) { return symbol(img, table, i); });
+    }
+
+    dynamic_table const& dynamic() const
+    {
+        return img->dynamic();
+    }
+
+    auto const& libs() const
+    {
+        // views into .dynstr
+        return dynamic().needed();
+    }
+
+    // e_machine, EM_X86_64 and so on
+    uint16_t machine() const
+    {
+        return img->machine;
+    }
+
+    unsigned bits() const
+    {
+        return img->is64 ? 64 : 32;
+    }
+
+    // where ld.so looks for libs() before its cache and default paths,
+    // with $ORIGIN, $LIB and $PLATFORM expanded
+    auto link_paths() const
+    {
+        return detail::search_paths(dynamic(), name(), machine(), bits());
+    }
+
+    // decodes every code section, split into functions by the STT_FUNC symbols
+    // of the symbol table, or the dynamic one when stripped, on up to
+    // `threads` threads
+    disassembly disassemble(size_t threads = 1) const
+    {
+        detail::code arch;
+        if(!detail::disassembler_arch(machine(), bits(), arch.arch, arch.mach))
+            throw std::runtime_error("no disassembler for this architecture");
+        arch.big_endian = img->base[EI_DATA] == ELFDATA2MSB;
+        arch.abfd = 0;
+
+        // section index to its entry in sections
+        vector<detail::code> sections;
+        std::unordered_map<uint32_t, size_t> index;
+        for(uint32_t i = 0; i != img->sections.size(); ++i)
+        {
+            detail::elf::section_info const& sec = img->sections[i];
+            if(!(sec.flags & SHF_EXECINSTR) || sec.type == SHT_NOBITS || !sec.size)
+                continue;
+
+            detail::code c = arch;
+            c.section = sec.name;
+            c.data = reinterpret_cast<bfd_byte const*>(sec.data);
+            c.size = sec.size;
+            c.address = sec.addr;
+            index.emplace(i, sections.size());
+            sections.push_back(std::move(c));
+        }
+        if(sections.empty())
+            return {};
+
+        img->load_symbols();
+        detail::elf::symbol_table const& table = img->symtab.count ? img->symtab : img->dynsym;
+        for(size_t i = 1; i < table.count; ++i)
+        {
+            detail::elf::symbol_entry e = img->entry(table, i);
+            if(e.type != STT_FUNC || !e.in_section())
+                continue;
+
+            auto it = index.find(e.shndx);
+            if(it != index.end())
+                sections[it->second].functions.emplace_back(e.value, e.size);
+        }
+
+        return detail::disassemble(sections, threads);
+    }
+
+    // relocations applying to sec, decoded on first use
+    vector<relocation> const& relocations(elf::section const& sec) const
+    {
+        return img->relocations(sec.sec - img->sections.data());
+    }
+
+    // all relocations, sections are decoded concurrently on up to `threads` threads
+    vector<relocation> relocations(size_t threads = 1) const
+    {
+        vector<size_t> targets = img->relocated_sections();
+
+        parallel_for(targets.size(), threads, [&](size_t i)
+        {
+            (void)img->relocations(targets[i]);
+        });
+
+        vector<relocation> result;
+        for(size_t i : targets)
+            result.insert(result.end(), img->relocations(i).begin(), img->relocations(i).end());
+        return result;
+    }
+
+    bool operator==(object const& other) const;
+    bool operator<(object const& other) const;
+
+private:
+    std::shared_ptr<detail::elf::image> img;
+};
+
+// collection of objects, members are only parsed as they are reached
+struct archive
+{
+    explicit archive(std::shared_ptr<detail::elf::archive_image const> ar) : ar(std::move(ar))
+    {
+        assert(this->ar);
+    }
+
+    string_view name() const
+    {
+        return ar->file->name();
+    }
+
+    auto objects() const
+    {
+        struct object_range : ranges::view_facade<object_range>
+        {
+            object_range() = default;
+            object_range(std::shared_ptr<detail::elf::archive_image const> ar) : ar(std::move(ar)), offset(SARMAG)
+            {
+                next();
+            }
+
+        private:
+            friend ranges::range_access;
+
+            elf::object get() const
+            {
+                return *current;
+            }
+
+            bool done() const
+            {
+                return !current;
+            }
+
+            void next()
+            {
+                current = {};
+
+                detail::elf::archive_image::member m;
+                while(ar->read_member(offset, m))
+                {
+                    offset = m.next;
+                    if(!detail::elf::archive_image::special(m.name) && detail::elf::is_native_elf(m.data, m.size))
+                    {
+                        current = elf::object(std::make_shared<detail::elf::image>(ar->file, ar, m.name, m.data, m.size));
+                        break;
+                    }
+                }
+            }
+
+            std::shared_ptr<detail::elf::archive_image const> ar;
+            size_t offset;
+            optional<elf::object> current;
+        };
+
+        return ranges::view::bounded(object_range(ar));
+    }
+
+    // all objects in archive order, symbol tables loaded on up to `threads` threads
+    vector<elf::object> objects(size_t threads) const
+    {
+        // walk the member table first, this only reads the member headers
+        vector<detail::elf::archive_image::member> members;
+        detail::elf::archive_image::member m;
+        for(size_t offset = SARMAG; ar->read_member(offset, m); offset = m.next)
+            if(!detail::elf::archive_image::special(m.name) && detail::elf::is_native_elf(m.data, m.size))
+                members.push_back(m);
+
+        vector<std::shared_ptr<detail::elf::image>> images(members.size());
+        parallel_for(members.size(), threads, [&](size_t i)
+        {
+            images[i] = std::make_shared<detail::elf::image>(ar->file, ar, members[i].name, members[i].data, members[i].size);
+            images[i]->load_symbols();
+        });
+
+        vector<elf::object> objects;
+        objects.reserve(images.size());
+        for(std::shared_ptr<detail::elf::image>& img : images)
+            objects.emplace_back(std::move(img));
+        return objects;
+    }
+
+    // archive symbol index, empty if the archive has none
+    vector<armap_entry> const& armap() const
+    {
+        return ar->armap();
+    }
+
+    // member defining the i-th armap symbol, only that member is parsed
+    optional<elf::object> armap_member(size_t i) const
+    {
+        detail::elf::archive_image::member m;
+        if(!ar->read_member(ar->armap().at(i).member, m) || detail::elf::archive_image::special(m.name) || !detail::elf::is_native_elf(m.data, m.size))
+            return {};
+
+        return elf::object(std::make_shared<detail::elf::image>(ar->file, ar, m.name, m.data, m.size));
+    }
+
+    bool operator==(archive const& other) const
+    {
+        return name() == other.name() ;
+    }
+
+    bool operator<(archive const& other) const
+    {
+        return name() < other.name();
+    }
+
+    friend size_t hash_value(archive const& self)
+    {
+        return std::hash<string_view>()(self.name());
+    }
+
+private:
+    std::shared_ptr<detail::elf::archive_image const> ar;
+};
+
+inline elf::object symbol::object() const
+{
+    return elf::object(img);
+}
+
+inline optional<elf::section> symbol::section() const
+{
+    detail::elf::symbol_entry e = entry();
+    if(!e.in_section() || e.shndx >= img->sections.size())
+        return {};
+    return elf::section(img, &img->sections[e.shndx]);
+}
+
+inline optional<elf::archive> object::archive() const
+{
+    if(img->ar)
+        return elf::archive(img->ar);
+    else
+        return {};
+}
+
+inline bool object::operator==(object const& other) const
+{
+    return archive() == other.archive()
+        && name() == other.name() ;
+}
+
+inline bool object::operator<(object const& other) const
+{
+    if(archive() == other.archive())
+        return name() < other.name();
+    else
+        return archive() < other.archive();
+}
+
+inline size_t hash_value(object const& self)
+{
+    if(self.archive())
+        return std::hash<string>()(self.archive()->name().to_string() + "(" + self.name().to_string() + ")");
+    else
+        return std::hash<string_view>()(self.name());
+}
+
+struct binary : variant<object, archive>
+{
+    typedef variant<object, archive> variant_type;
+
+    binary(string_view file) : variant_type(load_file(file))
+    {
+    }
+
+    binary(variant_type const& variant) : variant_type(variant)
+    {
+    }
+
+    string_view name() const
+    {
+        return mabo::visit(
+            [&](auto&& o) { return o.name(); },
+            *this
+        );
+    }
+
+    auto objects() const
+    {
+        struct object_range : ranges::view_facade<object_range>
+        {
+            object_range() = default;
+            object_range(variant<object, archive> const* bin) : bin(bin)
+            {
+                if(mabo::holds_alternative<archive>(*bin))
+                {
+                    rng = mabo::get<archive>(*bin).objects();
+                    first = rng.begin();
+                    if(first == rng.end())
+                        this->bin = 0;
+                }
+            }
+
+        private:
+            friend ranges::range_access;
+
+            elf::object get() const
+            {
+                if(mabo::holds_alternative<object>(*bin))
+                {
+                    return mabo::get<object>(*bin);
+                }
+                else
+                {
+                    return *first;
+                }
+            }
+
+            bool done() const
+            {
+                return !bin;
+            }
+
+            void next()
+            {
+                if(holds_alternative<object>(*bin))
+                {
+                    bin = 0;
+                }
+                else
+                {
+                    ++first;
+                    if(first == rng.end())
+                    {
+                        bin = 0;
+                    }
+                }
+            }
+
+            variant<object, archive> const* bin;
+            decltype(std::declval<archive>().objects()) rng;
+            decltype(rng.begin()) first;
+        };
+
+        return ranges::view::bounded(object_range(this));
+    }
+
+    // same as objects(), but archives are loaded up front on up to `threads` threads
+    vector<elf::object> objects(size_t threads) const
+    {
+        if(mabo::holds_alternative<archive>(*this))
+            return mabo::get<archive>(*this).objects(threads);
+        else
+            return vector<elf::object>(1, mabo::get<object>(*this));
+    }
+
+    bool operator==(binary const& other) const
+    {
+        return name() == other.name() ;
+    }
+
+    bool operator<(binary const& other) const
+    {
+        return name() < other.name();
+    }
+
+    friend size_t hash_value(binary const& self)
+    {
+        return std::hash<string_view>()(self.name());
+    }
+
+private:
+    variant_type load_file(string_view str)
+    {
+        auto file = std::make_shared<detail::elf::mapped_file>(str);
+
+        MABO_PHASE(CHECK_FORMAT);
+        if(detail::elf::is_archive(file->data(), file->size()))
+        {
+            return archive(std::make_shared<detail::elf::archive_image>(file));
+        }
+        else if(detail::elf::is_elf(file->data(), file->size()))
+        {
+            return object(std::make_shared<detail::elf::image>(file, nullptr, file->name(), file->data(), file->size()));
+        }
+
+        throw std::runtime_error("unsupported file type");
+    }
+};
+
+}
+
+}
+
+namespace std
+{
+    template<> struct hash<::mabo::elf::object> : mabo::detail::hash_value {};
+    template<> struct hash<::mabo::elf::archive> : mabo::detail::hash_value {};
+    template<> struct hash<::mabo::elf::binary> : mabo::detail::hash_value {};
+}
+
+#endif
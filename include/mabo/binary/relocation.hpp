@@ -0,0 +1,30 @@
+#ifndef MABO_BINARY_RELOCATION_HPP_INCLUDED
+#define MABO_BINARY_RELOCATION_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+
+#include <cstdint>
+
+namespace mabo
+{
+
+// one relocation against the symbol table, strings are views into the
+// object and live as long as it does
+struct relocation
+{
+    string_view section;    // the section it applies to
+    uint64_t offset;        // where in that section, an address in linked files
+    uint32_t type;          // r_type, architecture specific
+    int64_t addend;         // 0 for REL, the addend is in the section then
+    string_view symbol;     // referenced symbol, the section name for section symbols
+    string_view target;     // section the symbol is defined in, empty when undefined
+    bool local;             // the symbol is local to the object
+    uint32_t section_index; // section::index() of section
+    uint32_t target_index;  // section::index() of target, npos when undefined
+
+    static const uint32_t npos = uint32_t(-1);
+};
+
+}
+
+#endif
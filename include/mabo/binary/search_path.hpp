@@ -0,0 +1,224 @@
+#ifndef MABO_BINARY_SEARCH_PATH_HPP_INCLUDED
+#define MABO_BINARY_SEARCH_PATH_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+#include <mabo/binary/dynamic.hpp>
+
+#include <elf.h>
+#include <sys/auxv.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+
+namespace mabo { namespace detail
+{
+
+// debian style multiarch tuple, null where there is no common one
+inline char const* multiarch(uint16_t machine, unsigned bits)
+{
+    switch(machine)
+    {
+    case EM_X86_64:  return bits == 64 ? "x86_64-linux-gnu" : "x86_64-linux-gnux32";
+    case EM_386:     return "i386-linux-gnu";
+    case EM_AARCH64: return "aarch64-linux-gnu";
+    case EM_ARM:     return "arm-linux-gnueabihf";
+    case EM_PPC64:   return "powerpc64le-linux-gnu";
+    case EM_S390:    return bits == 64 ? "s390x-linux-gnu" : 0;
+    case EM_RISCV:   return bits == 64 ? "riscv64-linux-gnu" : 0;
+    default:         return 0;
+    }
+}
+
+inline bool is_directory(string const& path)
+{
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// what ld.so substitutes for $LIB
+inline string lib_dir(uint16_t machine, unsigned bits)
+{
+    if(char const* tuple = multiarch(machine, bits))
+    {
+        string dir = string("lib/") + tuple;
+        if(is_directory("/" + dir))
+            return dir;
+    }
+
+    if(bits == 64 && is_directory("/lib64"))
+        return "lib64";
+    return "lib";
+}
+
+// what ld.so substitutes for $PLATFORM
+inline string platform(uint16_t machine, unsigned bits)
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+#  if defined(__x86_64__)
+    bool host = machine == EM_X86_64 && bits == 64;
+#  elif defined(__i386__)
+    bool host = machine == EM_386;
+#  else
+    bool host = machine == EM_AARCH64;
+#  endif
+    if(host)
+        if(char const* p = reinterpret_cast<char const*>(::getauxval(AT_PLATFORM)))
+            return p;
+#endif
+
+    switch(machine)
+    {
+    case EM_X86_64:  return "x86_64";
+    case EM_386:     return "i686";
+    case EM_AARCH64: return "aarch64";
+    default:         return "";
+    }
+}
+
+inline string origin(string_view file)
+{
+    string path = file.to_string();
+    if(char* p = ::realpath(path.c_str(), 0))
+    {
+        path = p;
+        std::free(p);
+    }
+
+    size_t slash = path.rfind('/');
+    if(slash == string::npos)
+        return ".";
+    return slash ? path.substr(0, slash) : "/";
+}
+
+// expands $ORIGIN, $LIB and $PLATFORM, also in their ${} forms
+struct dst_expander
+{
+    dst_expander(string_view file, uint16_t machine, unsigned bits)
+    : file(file), machine(machine), bits(bits)
+    {
+    }
+
+    string operator()(string_view path)
+    {
+        string result;
+        while(!path.empty())
+        {
+            size_t dollar = path.find('$');
+            result.append(path.data(), std::min(dollar, path.size()));
+            if(dollar == string_view::npos)
+                break;
+
+            path.remove_prefix(dollar + 1);
+            bool braced = !path.empty() && path[0] == '{';
+            if(braced)
+                path.remove_prefix(1);
+
+            size_t len = 0;
+            while(len != path.size() && (std::isalnum(static_cast<unsigned char>(path[len])) || path[len] == '_'))
+                ++len;
+
+            string_view token = path.substr(0, len);
+            bool closed = !braced || (len != path.size() && path[len] == '}');
+            if(closed && token == "ORIGIN")
+                result += value(origin_, [&] { return detail::origin(file); });
+            else if(closed && token == "LIB")
+                result += value(lib_, [&] { return lib_dir(machine, bits); });
+            else if(closed && token == "PLATFORM")
+                result += value(platform_, [&] { return platform(machine, bits); });
+            else
+            {
+                // unknown, kept as written
+                result += braced ? "${" : "$";
+                continue;
+            }
+            path.remove_prefix(len + braced);
+        }
+        return result;
+    }
+
+private:
+    template<class F>
+    static string const& value(optional<string>& cached, F&& f)
+    {
+        if(!cached)
+            cached = f();
+        return *cached;
+    }
+
+    string_view file;
+    uint16_t machine;
+    unsigned bits;
+    optional<string> origin_;
+    optional<string> lib_;
+    optional<string> platform_;
+};
+
+// splits a colon separated list of directories, expanding each
+template<class Expand>
+void split_paths(string_view elem, Expand& expand, vector<string>& paths)
+{
+    while(!elem.empty())
+    {
+        size_t pos = std::min(elem.find(':'), elem.size());
+        if(pos)
+            paths.push_back(expand(elem.substr(0, pos)));
+        elem.remove_prefix(std::min(pos + 1, elem.size()));
+    }
+}
+
+// the directories an object names itself, what search_paths() puts around
+// LD_LIBRARY_PATH: DT_RPATH unless there is a DT_RUNPATH, and DT_RUNPATH
+struct object_paths
+{
+    vector<string> rpath;
+    vector<string> runpath;
+};
+
+inline object_paths own_paths(dynamic_table const& dynamic, dst_expander& expand)
+{
+    object_paths paths;
+    if(dynamic.runpath().empty())
+        for(string_view rpath : dynamic.rpath())
+            split_paths(rpath, expand, paths.rpath);
+
+    for(string_view runpath : dynamic.runpath())
+        split_paths(runpath, expand, paths.runpath);
+    return paths;
+}
+
+inline object_paths own_paths(dynamic_table const& dynamic, string_view file, uint16_t machine, unsigned bits)
+{
+    dst_expander expand(file, machine, bits);
+    return own_paths(dynamic, expand);
+}
+
+// the object specific part of the ld.so search path, in search order:
+// rpath, LD_LIBRARY_PATH, runpath; the environment is read on every call
+template<class Rpath, class Runpath>
+vector<string> search_paths(Rpath const& rpath, Runpath const& runpath, dst_expander& expand)
+{
+    vector<string> paths;
+    for(auto const& dir : rpath)
+        paths.emplace_back(dir.data(), dir.size());
+
+    if(char const* env = std::getenv("LD_LIBRARY_PATH"))
+        split_paths(env, expand, paths);
+
+    for(auto const& dir : runpath)
+        paths.emplace_back(dir.data(), dir.size());
+    return paths;
+}
+
+inline vector<string> search_paths(dynamic_table const& dynamic, string_view file, uint16_t machine, unsigned bits)
+{
+    dst_expander expand(file, machine, bits);
+    object_paths own = own_paths(dynamic, expand);
+    return search_paths(own.rpath, own.runpath, expand);
+}
+
+} }
+
+#endif
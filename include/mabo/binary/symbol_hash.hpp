@@ -0,0 +1,200 @@
+#ifndef MABO_BINARY_SYMBOL_HASH_HPP_INCLUDED
+#define MABO_BINARY_SYMBOL_HASH_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+#include <mabo/stats.hpp>
+
+#include <elf.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace mabo { namespace detail
+{
+
+inline uint32_t gnu_hash(string_view name)
+{
+    uint32_t h = 5381;
+    for(char c : name)
+        h = h * 33 + static_cast<unsigned char>(c);
+    return h;
+}
+
+inline uint32_t sysv_hash(string_view name)
+{
+    uint32_t h = 0;
+    for(char c : name)
+    {
+        h = (h << 4) + static_cast<unsigned char>(c);
+        uint32_t g = h & 0xf0000000;
+        if(g)
+            h ^= g >> 24;
+        h &= ~g;
+    }
+    return h;
+}
+
+// the raw dynamic symbol table of a shared object with its .gnu.hash or .hash,
+// lets a name be looked up the way ld.so does without loading any symbols
+struct dynamic_symbols
+{
+    static const size_t npos = size_t(-1);
+
+    dynamic_symbols()
+    : gnu_hash(0), gnu_hash_size(0), hash(0), hash_size(0), syms(0), syms_size(0), versym(0), versym_size(0), is64(false)
+    {
+    }
+
+    bool available() const
+    {
+        return syms && (gnu_hash || hash);
+    }
+
+    // dynsym index of the defined, non-local symbol called name, or npos
+    size_t find(string_view name) const
+    {
+        if(!syms)
+            return npos;
+        MABO_COUNT(HASH_LOOKUPS, 1);
+        if(gnu_hash)
+            return is64 ? find_gnu<Elf64_Sym, uint64_t>(name) : find_gnu<Elf32_Sym, uint32_t>(name);
+        if(hash)
+            return is64 ? find_sysv<Elf64_Sym>(name) : find_sysv<Elf32_Sym>(name);
+        return npos;
+    }
+
+    char const* gnu_hash;
+    size_t gnu_hash_size;
+    char const* hash;
+    size_t hash_size;
+    char const* syms;
+    size_t syms_size;
+    string_view strings;
+    char const* versym;
+    size_t versym_size;
+    bool is64;
+
+private:
+    template<class T>
+    static T read(char const* p)
+    {
+        T t;
+        std::memcpy(&t, p, sizeof(t));
+        return t;
+    }
+
+    enum match_type
+    {
+        NO_MATCH,
+        HIDDEN_MATCH,
+        MATCH
+    };
+
+    // hidden versions only count when there is nothing else
+    template<class Sym>
+    match_type match(size_t i, string_view name) const
+    {
+        if((i + 1) * sizeof(Sym) > syms_size)
+            return NO_MATCH;
+
+        Sym sym = read<Sym>(syms + i * sizeof(Sym));
+        if(sym.st_shndx == SHN_UNDEF || ELF64_ST_BIND(sym.st_info) == STB_LOCAL || sym.st_name >= strings.size())
+            return NO_MATCH;
+
+        char const* s = strings.data() + sym.st_name;
+        size_t left = strings.size() - sym.st_name;
+        if(name.size() >= left || std::memcmp(s, name.data(), name.size()) || s[name.size()])
+            return NO_MATCH;
+
+        if(versym && (i + 1) * sizeof(uint16_t) <= versym_size && (read<uint16_t>(versym + i * sizeof(uint16_t)) & 0x8000))
+            return HIDDEN_MATCH;
+        return MATCH;
+    }
+
+    template<class Sym, class Word>
+    size_t find_gnu(string_view name) const
+    {
+        if(gnu_hash_size < 16)
+            return npos;
+
+        uint32_t nbuckets = read<uint32_t>(gnu_hash);
+        uint32_t symoffset = read<uint32_t>(gnu_hash + 4);
+        uint32_t bloom_size = read<uint32_t>(gnu_hash + 8);
+        uint32_t bloom_shift = read<uint32_t>(gnu_hash + 12);
+
+        size_t bloom = 16;
+        size_t buckets = bloom + size_t(bloom_size) * sizeof(Word);
+        size_t chains = buckets + size_t(nbuckets) * 4;
+        if(!nbuckets || !bloom_size || chains > gnu_hash_size)
+            return npos;
+
+        uint32_t h = detail::gnu_hash(name);
+        unsigned const bits = sizeof(Word) * 8;
+
+        // most lookups end here
+        Word word = read<Word>(gnu_hash + bloom + ((h / bits) % bloom_size) * sizeof(Word));
+        Word mask = (Word(1) << (h % bits)) | (Word(1) << ((h >> bloom_shift) % bits));
+        if((word & mask) != mask)
+            return npos;
+
+        uint32_t i = read<uint32_t>(gnu_hash + buckets + (h % nbuckets) * 4);
+        if(i < symoffset)
+            return npos;
+
+        size_t hidden = npos;
+        for(;; ++i)
+        {
+            size_t chain = chains + size_t(i - symoffset) * 4;
+            if(chain + 4 > gnu_hash_size)
+                break;
+
+            uint32_t h2 = read<uint32_t>(gnu_hash + chain);
+            if((h2 | 1) == (h | 1))
+            {
+                match_type m = match<Sym>(i, name);
+                if(m == MATCH)
+                    return i;
+                if(m == HIDDEN_MATCH && hidden == npos)
+                    hidden = i;
+            }
+
+            // the low bit ends the chain
+            if(h2 & 1)
+                break;
+        }
+        return hidden;
+    }
+
+    template<class Sym>
+    size_t find_sysv(string_view name) const
+    {
+        if(hash_size < 8)
+            return npos;
+
+        uint32_t nbucket = read<uint32_t>(hash);
+        uint32_t nchain = read<uint32_t>(hash + 4);
+        if(!nbucket || 8 + (size_t(nbucket) + nchain) * 4 > hash_size)
+            return npos;
+
+        char const* buckets = hash + 8;
+        char const* chains = buckets + size_t(nbucket) * 4;
+
+        size_t hidden = npos;
+        size_t steps = 0;
+        for(uint32_t i = read<uint32_t>(buckets + (sysv_hash(name) % nbucket) * 4);
+            i != STN_UNDEF && i < nchain && steps <= nchain;
+            i = read<uint32_t>(chains + size_t(i) * 4), ++steps)
+        {
+            match_type m = match<Sym>(i, name);
+            if(m == MATCH)
+                return i;
+            if(m == HIDDEN_MATCH && hidden == npos)
+                hidden = i;
+        }
+        return hidden;
+    }
+};
+
+} }
+
+#endif
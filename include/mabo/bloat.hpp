@@ -0,0 +1,261 @@
+#ifndef MABO_BLOAT_HPP_INCLUDED
+#define MABO_BLOAT_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+#include <mabo/binary.hpp>
+#include <mabo/demangle.hpp>
+
+#include <elf.h>
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+
+namespace mabo
+{
+
+// one line of a bloat report
+struct bloat_entry
+{
+    string name;
+    uint64_t size;
+    uint64_t count;     // symbols
+};
+
+struct bloat_report
+{
+    // largest first, at most the top entries of each
+    vector<bloat_entry> symbols;        // demangled
+    vector<bloat_entry> sections;       // allocated bytes, whether symbols cover them or not
+    vector<bloat_entry> unattributed;   // per section name, the bytes no symbol covers
+    vector<bloat_entry> objects;        // archive members as archive(member)
+    vector<bloat_entry> scopes;         // namespaces and classes, see detail::demangled_scope
+
+    uint64_t size;              // bytes of the symbols
+    uint64_t count;
+    uint64_t section_size;      // bytes of the allocated sections, size plus what is unattributed
+};
+
+// sizes up the defined symbols, local ones included, and the allocated
+// sections of the objects streamed through add()
+//
+// sizes come from st_size, or the distance to the next symbol or the end of
+// the section when it is 0, aliases are counted once; what the symbols of a
+// section leave uncovered is reported as unattributed; only the largest
+// symbols and objects are kept, and one total per section name and scope,
+// so memory doesn't grow with the input
+struct bloat
+{
+    explicit bloat(size_t top = 20) : top(top), size(0), count(0), section_size(0)
+    {
+    }
+
+    void add(binary const& bin)
+    {
+        for(object const& obj : bin.objects())
+            add(obj);
+    }
+
+    void add(object const& obj)
+    {
+        syms.clear();
+        sections.clear();
+        section_index.clear();
+
+        // by index, names can repeat
+        for(auto const& sec : obj.sections())
+        {
+            if(!(sec.flags() & SHF_ALLOC) || !sec.size())
+                continue;
+            section_index.emplace(sec.index(), uint32_t(sections.size()));
+            sections.push_back(section_range{sec.name(), sec.addr() + sec.size(), sec.size(), 0});
+        }
+
+        // statics take up space too, and sizes inferred from the next
+        // symbol must not span over them
+        auto add_symbols = [&](auto&& rng)
+        {
+            for(auto const& sym : rng)
+            {
+                auto sec = sym.section();
+                if(sym.name().empty() || !sec || sym.type() == STT_SECTION || sym.type() == STT_FILE)
+                    continue;
+
+                auto it = section_index.find(sec->index());
+                if(it != section_index.end())
+                    syms.push_back(sized{it->second, sym.addr(), sym.size(), sym.name()});
+            }
+        };
+        add_symbols(obj.symbols());
+        add_symbols(obj.local_symbols());
+
+        std::sort(syms.begin(), syms.end(), [](sized const& a, sized const& b)
+        {
+            if(a.section != b.section)
+                return a.section < b.section;
+            if(a.addr != b.addr)
+                return a.addr < b.addr;
+            return a.size > b.size;
+        });
+
+        uint64_t object_size = 0;
+        uint64_t object_count = 0;
+        for(size_t i = 0; i != syms.size(); ++i)
+        {
+            sized const& sym = syms[i];
+            if(i && syms[i - 1].section == sym.section && syms[i - 1].addr == sym.addr)
+                continue;
+
+            uint64_t bytes = sym.size;
+            if(!bytes)
+            {
+                size_t next = i + 1;
+                while(next != syms.size() && syms[next].section == sym.section && syms[next].addr == sym.addr)
+                    ++next;
+
+                uint64_t end = next != syms.size() && syms[next].section == sym.section ? syms[next].addr : sections[sym.section].end;
+                bytes = end > sym.addr ? end - sym.addr : 0;
+            }
+
+            string_view demangled = demangle(sym.name);
+            sections[sym.section].covered += bytes;
+            ++sections[sym.section].count;
+            total(scope_totals, detail::demangled_scope(demangled), bytes);
+            keep(largest_symbols, demangled, bytes, 1);
+
+            object_size += bytes;
+            ++object_count;
+        }
+
+        size += object_size;
+        count += object_count;
+
+        for(section_range const& sec : sections)
+        {
+            total(section_totals, sec.name, sec.size, sec.count);
+            section_size += sec.size;
+            if(sec.covered < sec.size)
+                total(unattributed_totals, sec.name, sec.size - sec.covered, 0);
+        }
+
+        if(heap_accepts(largest_objects, object_size))
+        {
+            optional<archive> ar = obj.archive();
+            keep(largest_objects, ar ? ar->name().to_string() + "(" + obj.name().to_string() + ")" : obj.name().to_string(), object_size, object_count);
+        }
+    }
+
+    bloat_report report() const
+    {
+        bloat_report result;
+        result.symbols = sorted(largest_symbols);
+        result.objects = sorted(largest_objects);
+        result.sections = sorted(section_totals);
+        result.unattributed = sorted(unattributed_totals);
+        result.scopes = sorted(scope_totals);
+        result.size = size;
+        result.count = count;
+        result.section_size = section_size;
+        return result;
+    }
+
+private:
+    struct sized
+    {
+        uint32_t section;
+        uint64_t addr;
+        uint64_t size;
+        string_view name;
+    };
+
+    struct section_range
+    {
+        string_view name;
+        uint64_t end;
+        uint64_t size;
+        uint64_t covered;   // by symbols, aliases once
+        uint64_t count;
+    };
+
+    struct smaller
+    {
+        bool operator()(bloat_entry const& a, bloat_entry const& b) const
+        {
+            return a.size > b.size;
+        }
+    };
+
+    // the smallest of the top entries on top
+    typedef std::priority_queue<bloat_entry, vector<bloat_entry>, smaller> heap;
+
+    void total(std::unordered_map<string, pair<uint64_t, uint64_t>>& totals, string_view name, uint64_t bytes, uint64_t n = 1)
+    {
+        key.assign(name.data(), name.size());
+        auto it = totals.find(key);
+        if(it == totals.end())
+            it = totals.emplace(key, pair<uint64_t, uint64_t>(0, 0)).first;
+        it->second.first += bytes;
+        it->second.second += n;
+    }
+
+    bool heap_accepts(heap const& h, uint64_t bytes) const
+    {
+        return top && (h.size() < top || h.top().size < bytes);
+    }
+
+    void keep(heap& h, string_view name, uint64_t bytes, uint64_t n)
+    {
+        if(!heap_accepts(h, bytes))
+            return;
+        h.push(bloat_entry{name.to_string(), bytes, n});
+        if(h.size() > top)
+            h.pop();
+    }
+
+    static vector<bloat_entry> sorted(heap h)
+    {
+        vector<bloat_entry> result;
+        for(; !h.empty(); h.pop())
+            result.push_back(h.top());
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+
+    vector<bloat_entry> sorted(std::unordered_map<string, pair<uint64_t, uint64_t>> const& totals) const
+    {
+        heap h;
+        for(auto const& t : totals)
+        {
+            if(heap_accepts(h, t.second.first))
+            {
+                h.push(bloat_entry{t.first, t.second.first, t.second.second});
+                if(h.size() > top)
+                    h.pop();
+            }
+        }
+        return sorted(std::move(h));
+    }
+
+    size_t top;
+    uint64_t size;
+    uint64_t count;
+    uint64_t section_size;
+
+    detail::demangler demangle;
+    heap largest_symbols;
+    heap largest_objects;
+    std::unordered_map<string, pair<uint64_t, uint64_t>> section_totals;
+    std::unordered_map<string, pair<uint64_t, uint64_t>> unattributed_totals;
+    std::unordered_map<string, pair<uint64_t, uint64_t>> scope_totals;
+
+    // reused between objects
+    string key;
+    vector<sized> syms;
+    vector<section_range> sections;
+    std::unordered_map<uint32_t, uint32_t> section_index;
+};
+
+}
+
+#endif
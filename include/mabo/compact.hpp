@@ -0,0 +1,489 @@
+#ifndef MABO_COMPACT_HPP_INCLUDED
+#define MABO_COMPACT_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+#include <mabo/binary.hpp>
+#include <mabo/parallel.hpp>
+#include <mabo/string_table.hpp>
+#include <mabo/binary/armap.hpp>
+#include <mabo/binary/search_path.hpp>
+
+#include <range/v3/view.hpp>
+
+#include <memory>
+#include <unordered_map>
+
+namespace mabo
+{
+
+// what compact_symbol::flags() holds
+enum compact_flag
+{
+    COMPACT_GLOBAL  = 1,
+    COMPACT_WEAK    = 2,
+    COMPACT_IMPORT  = 4     // undefined, one of the object's imports()
+};
+
+namespace detail { namespace compact
+{
+
+// strings are offsets into tables::strings, nul terminated
+
+struct symbol_record
+{
+    uint64_t addr;
+    uint64_t size;
+    uint32_t name;
+    uint32_t section;       // index into the object's sections, npos for none
+    uint32_t flags;
+    uint8_t type;           // STT_*
+};
+
+struct section_record
+{
+    uint64_t addr;
+    uint64_t size;
+    uint64_t flags;
+    uint32_t name;
+};
+
+// RPATH and RUNPATH are what the object names itself, like in the symbol
+// cache, LD_LIBRARY_PATH is added when the paths are asked for
+enum list
+{
+    SECTIONS,
+    SYMBOLS,
+    LOCALS,
+    IMPORTS,
+    LIBS,
+    RPATH,
+    RUNPATH,
+    LISTS
+};
+
+// SECTIONS index tables::sections, SYMBOLS, LOCALS and IMPORTS tables::symbols,
+// LIBS, RPATH and RUNPATH tables::refs
+struct object_record
+{
+    uint32_t name;
+    uint16_t machine;
+    uint16_t bits;
+    uint32_t first[LISTS];
+    uint32_t count[LISTS];
+};
+
+// an archive index entry, object indexes tables::objects
+struct armap_record
+{
+    uint32_t name;
+    uint32_t object;
+};
+
+static const uint32_t npos = uint32_t(-1);
+
+// everything extracted from one binary
+struct tables
+{
+    uint32_t name;
+    bool archive;
+    vector<object_record> objects;
+    vector<armap_record> armap;
+    vector<section_record> sections;
+    vector<symbol_record> symbols;
+    vector<uint32_t> refs;
+    vector<char> strings;
+
+    char const* str(uint32_t offset) const
+    {
+        return strings.data() + offset;
+    }
+};
+
+struct writer
+{
+    explicit writer(tables& out) : out(out), strings("compact binary")
+    {
+    }
+
+    uint32_t str(string_view s)
+    {
+        return strings.add(out.strings, s);
+    }
+
+    void add(mabo::object const& obj)
+    {
+        object_record o;
+        o.name = str(obj.name());
+        o.machine = obj.machine();
+        o.bits = obj.bits();
+
+        std::unordered_map<string_view, uint32_t> index;
+        o.first[SECTIONS] = out.sections.size();
+        for(mabo::section const& sec : obj.sections())
+        {
+            // duplicate names resolve to the first section
+            index.emplace(sec.name(), uint32_t(out.sections.size()) - o.first[SECTIONS]);
+            out.sections.push_back(section_record{sec.addr(), sec.size(), sec.flags(), str(sec.name())});
+        }
+        o.count[SECTIONS] = out.sections.size() - o.first[SECTIONS];
+
+        auto add_symbols = [&](list l, auto&& rng, uint32_t flags)
+        {
+            o.first[l] = out.symbols.size();
+            for(auto const& sym : rng)
+            {
+                uint32_t section = npos;
+                if(auto sec = sym.section())
+                {
+                    auto it = index.find(sec->name());
+                    if(it != index.end())
+                        section = it->second;
+                }
+
+                uint32_t f = flags;
+                if(sym.global())
+                    f |= COMPACT_GLOBAL;
+                if(sym.weak())
+                    f |= COMPACT_WEAK;
+                out.symbols.push_back(symbol_record{sym.addr(), sym.size(), str(sym.name()), section, f, sym.type()});
+            }
+            o.count[l] = out.symbols.size() - o.first[l];
+        };
+        add_symbols(SYMBOLS, obj.symbols(), 0);
+        add_symbols(LOCALS, obj.local_symbols(), 0);
+        add_symbols(IMPORTS, obj.imports(), COMPACT_IMPORT);
+
+        auto add_strings = [&](list l, auto&& rng)
+        {
+            o.first[l] = out.refs.size();
+            for(string_view s : rng)
+                out.refs.push_back(str(s));
+            o.count[l] = out.refs.size() - o.first[l];
+        };
+        add_strings(LIBS, obj.libs());
+
+        // the environment is left out, it may differ when the paths are used
+        detail::object_paths own = detail::own_paths(obj.dynamic(), obj.name(), obj.machine(), obj.bits());
+        add_strings(RPATH, own.rpath);
+        add_strings(RUNPATH, own.runpath);
+
+        out.objects.push_back(o);
+        object_offsets.push_back(obj.offset());
+    }
+
+    // the index entries pointing at objects added in file order
+    void add_armap(mabo::archive const& ar)
+    {
+        auto const& armap = ar.armap();
+        vector<optional<uint32_t>> objects = detail::armap_objects(ar, object_offsets);
+        for(size_t i = 0; i != armap.size(); ++i)
+            if(objects[i])
+                out.armap.push_back(armap_record{str(armap[i].name), *objects[i]});
+    }
+
+    tables& out;
+    string_table_writer strings;
+    vector<size_t> object_offsets;  // offset() of each object added
+};
+
+} }
+
+struct compact_section
+{
+    string_view name() const
+    {
+        return t->str(r->name);
+    }
+
+    uint64_t addr() const
+    {
+        return r->addr;
+    }
+
+    uint64_t size() const
+    {
+        return r->size;
+    }
+
+    uint64_t flags() const
+    {
+        return r->flags;
+    }
+
+    detail::compact::section_record const* r;
+    detail::compact::tables const* t;
+};
+
+struct compact_symbol
+{
+    string_view name() const
+    {
+        return t->str(r->name);
+    }
+
+    uint64_t addr() const
+    {
+        return r->addr;
+    }
+
+    uint64_t size() const
+    {
+        return r->size;
+    }
+
+    // compact_flag bits
+    uint32_t flags() const
+    {
+        return r->flags;
+    }
+
+    bool global() const
+    {
+        return r->flags & COMPACT_GLOBAL;
+    }
+
+    bool weak() const
+    {
+        return r->flags & COMPACT_WEAK;
+    }
+
+    unsigned char type() const
+    {
+        return r->type;
+    }
+
+    optional<compact_section> section() const
+    {
+        if(r->section == detail::compact::npos)
+            return {};
+        return compact_section{&t->sections[first_section + r->section], t};
+    }
+
+    detail::compact::symbol_record const* r;
+    detail::compact::tables const* t;
+    uint32_t first_section;
+};
+
+namespace detail { namespace compact
+{
+
+struct to_section
+{
+    compact_section operator()(section_record const& r) const
+    {
+        return compact_section{&r, t};
+    }
+
+    tables const* t;
+};
+
+struct to_symbol
+{
+    compact_symbol operator()(symbol_record const& r) const
+    {
+        return compact_symbol{&r, t, first_section};
+    }
+
+    tables const* t;
+    uint32_t first_section;
+};
+
+struct to_string
+{
+    string_view operator()(uint32_t offset) const
+    {
+        return t->str(offset);
+    }
+
+    tables const* t;
+};
+
+} }
+
+// one object of a compact_binary, with the same accessors as mabo::object
+// for what was extracted
+struct compact_object
+{
+    string_view name() const
+    {
+        return t->str(o->name);
+    }
+
+    // the archive it is a member of, empty when it isn't one
+    string_view archive() const
+    {
+        return t->archive ? t->str(t->name) : string_view();
+    }
+
+    uint16_t machine() const
+    {
+        return o->machine;
+    }
+
+    unsigned bits() const
+    {
+        return o->bits;
+    }
+
+    auto sections() const
+    {
+        return records(t->sections, detail::compact::SECTIONS) | ranges::view::transform(detail::compact::to_section{t});
+    }
+
+    optional<compact_section> section(string_view name) const
+    {
+        for(compact_section sec : sections())
+            if(sec.name() == name)
+                return sec;
+        return {};
+    }
+
+    auto symbols() const
+    {
+        return records(t->symbols, detail::compact::SYMBOLS) | ranges::view::transform(detail::compact::to_symbol{t, o->first[detail::compact::SECTIONS]});
+    }
+
+    auto local_symbols() const
+    {
+        return records(t->symbols, detail::compact::LOCALS) | ranges::view::transform(detail::compact::to_symbol{t, o->first[detail::compact::SECTIONS]});
+    }
+
+    auto imports() const
+    {
+        return records(t->symbols, detail::compact::IMPORTS) | ranges::view::transform(detail::compact::to_symbol{t, o->first[detail::compact::SECTIONS]});
+    }
+
+    auto libs() const
+    {
+        return records(t->refs, detail::compact::LIBS) | ranges::view::transform(detail::compact::to_string{t});
+    }
+
+    // like object::link_paths(), with LD_LIBRARY_PATH as it is now
+    vector<string> link_paths() const
+    {
+        detail::dst_expander expand(t->str(t->name), machine(), bits());
+        detail::compact::to_string str{t};
+        return detail::search_paths(records(t->refs, detail::compact::RPATH) | ranges::view::transform(str), records(t->refs, detail::compact::RUNPATH) | ranges::view::transform(str), expand);
+    }
+
+    detail::compact::object_record const* o;
+    detail::compact::tables const* t;
+
+private:
+    template<class T>
+    ranges::iterator_range<T const*> records(vector<T> const& v, detail::compact::list l) const
+    {
+        return ranges::make_iterator_range(v.data() + o->first[l], v.data() + o->first[l] + o->count[l]);
+    }
+};
+
+struct compact_armap_entry
+{
+    string_view name;   // symbol defined by the member
+    size_t member;      // index of the object defining it
+};
+
+// owned snapshot of a binary's objects, sections, symbols, DT_NEEDED entries,
+// search paths and archive index, without the backend's handles behind it
+//
+// symbols and sections are fixed size records over one deduplicated string
+// table, so what a snapshot holds grows with the symbol data rather than
+// with libbfd's per-object state; copies share the tables
+struct compact_binary
+{
+    // the file is closed again once it has been extracted
+    explicit compact_binary(string_view file) : compact_binary(mabo::binary(file))
+    {
+    }
+
+    explicit compact_binary(mabo::binary const& bin) : t(std::make_shared<detail::compact::tables>())
+    {
+        detail::compact::tables& out = *t;
+        detail::compact::writer w(out);
+        out.name = w.str(bin.name());
+        out.archive = mabo::holds_alternative<mabo::archive>(bin);
+        for(mabo::object const& obj : bin.objects())
+            w.add(obj);
+        if(out.archive)
+            w.add_armap(mabo::get<mabo::archive>(bin));
+
+        out.objects.shrink_to_fit();
+        out.armap.shrink_to_fit();
+        out.sections.shrink_to_fit();
+        out.symbols.shrink_to_fit();
+        out.refs.shrink_to_fit();
+        out.strings.shrink_to_fit();
+    }
+
+    string_view name() const
+    {
+        return t->str(t->name);
+    }
+
+    bool archive() const
+    {
+        return t->archive;
+    }
+
+    auto objects() const
+    {
+        detail::compact::tables const* t = this->t.get();
+        return ranges::make_iterator_range(t->objects.data(), t->objects.data() + t->objects.size())
+             | ranges::view::transform([t](detail::compact::object_record const& o)
+        {
+            return compact_object{&o, t};
+        });
+    }
+
+    compact_object object(size_t i) const
+    {
+        return compact_object{&t->objects[i], t.get()};
+    }
+
+    // the archive's symbol index, member is an index for object(); empty
+    // unless it is an archive with one
+    vector<compact_armap_entry> armap() const
+    {
+        vector<compact_armap_entry> entries;
+        entries.reserve(t->armap.size());
+        for(detail::compact::armap_record const& r : t->armap)
+            entries.push_back(compact_armap_entry{t->str(r.name), r.object});
+        return entries;
+    }
+
+    // bytes held by the tables
+    size_t memory() const
+    {
+        return sizeof(*t)
+             + t->objects.capacity() * sizeof(detail::compact::object_record)
+             + t->armap.capacity() * sizeof(detail::compact::armap_record)
+             + t->sections.capacity() * sizeof(detail::compact::section_record)
+             + t->symbols.capacity() * sizeof(detail::compact::symbol_record)
+             + t->refs.capacity() * sizeof(uint32_t)
+             + t->strings.capacity();
+    }
+
+private:
+    std::shared_ptr<detail::compact::tables> t;
+};
+
+// snapshots of files in order, extracted on up to `threads` threads when the
+// backend allows it; at most one file per thread is open at a time
+inline vector<compact_binary> load_compact(vector<string> const& files, size_t threads = 1)
+{
+    vector<optional<compact_binary>> loaded(files.size());
+    parallel_for(files.size(), thread_safe() ? threads : 1, [&](size_t i)
+    {
+        loaded[i] = compact_binary(files[i]);
+    });
+
+    vector<compact_binary> result;
+    result.reserve(loaded.size());
+    for(optional<compact_binary>& bin : loaded)
+        result.push_back(std::move(*bin));
+    return result;
+}
+
+}
+
+#endif
@@ -3,12 +3,28 @@
 
 #include <mabo/config.hpp>
 #include <mabo/binary.hpp>
+#include <mabo/compact.hpp>
+#include <mabo/demangle.hpp>
+#include <mabo/dependency_graph.hpp>
+#include <mabo/diagnostics.hpp>
+#include <mabo/parallel.hpp>
+#include <mabo/stats.hpp>
+#include <mabo/string_pool.hpp>
+#include <mabo/symbol_cache.hpp>
+#include <mabo/library_resolver.hpp>
 
 #include <range/v3/view.hpp>
+#include <range/v3/algorithm.hpp>
 
-#include <fstream>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <iostream>
-#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -18,16 +34,28 @@ namespace mabo
 namespace detail
 {
 
+struct symbol_ref
+{
+    string_pool::id_type name;
+    bool weak;
+};
+
+// interned symbols of one object, extracted before resolution
+struct object_symbols
+{
+    vector<symbol_ref> symbols;
+    vector<symbol_ref> imports;
+};
+
+// resolution state of one interned symbol name
 struct symbol_status
 {
-    symbol_status(string_view s)
-    : name(s.to_string())
-    , state(NONE)
+    symbol_status()
+    : node(dependency_graph::npos), state(NONE)
     {
     }
 
-    string name;
-    mutable optional<mabo::binary> object;
+    dependency_graph::node_id node;
     enum type
     {
         NONE    = 0,
@@ -35,180 +63,1019 @@ struct symbol_status
         DEFINED = 2,
         WEAK    = 4
     };
-    mutable int state;
+    int state;
+};
+
+// a symbol defined in, or referenced from, a section of an object
+struct section_symbol
+{
+    uint32_t section;   // index into object_sections::sections
+    string_pool::id_type name;
+    bool weak;
+};
+
+// what section granularity needs of one linked object
+struct object_sections
+{
+    vector<pair<uint32_t, string_view>> sections;   // index() and name, in the order first seen
+    vector<section_symbol> definitions;
+    vector<section_symbol> references;
+    vector<pair<uint32_t, uint32_t>> local;     // relocations against local symbols
+};
+
+// a CIE or FDE of an .eh_frame section, [offset, end); cie is the offset
+// of the CIE an FDE belongs to and the record's own offset for a CIE
+struct eh_record
+{
+    uint64_t offset;
+    uint64_t end;
+    uint64_t cie;
+};
+
+// the records of an .eh_frame in host byte order, up to the first malformed one
+inline vector<eh_record> eh_records(unsigned char const* data, size_t size)
+{
+    vector<eh_record> records;
+    for(uint64_t offset = 0; offset + 4 <= size; )
+    {
+        uint32_t length32;
+        std::memcpy(&length32, data + offset, 4);
+
+        // the 64-bit format has an escape, then 8 byte length and CIE pointer
+        uint64_t length = length32;
+        uint64_t header = 4;
+        uint64_t id_size = 4;
+        if(length32 == 0xffffffff)
+        {
+            if(offset + 12 > size)
+                break;
+            std::memcpy(&length, data + offset + 4, 8);
+            header = 12;
+            id_size = 8;
+        }
+
+        // a terminator
+        if(!length)
+        {
+            offset += header;
+            continue;
+        }
+
+        uint64_t id_at = offset + header;
+        if(length > size || length < id_size || id_at + length > size)
+            break;
+
+        uint64_t id = 0;
+        if(id_size == 4)
+        {
+            uint32_t id32;
+            std::memcpy(&id32, data + id_at, 4);
+            id = id32;
+        }
+        else
+            std::memcpy(&id, data + id_at, 8);
+
+        // an FDE points back at its CIE relative to the pointer itself
+        if(id > id_at)
+            break;
+        records.push_back(eh_record{offset, id_at + length, id ? id_at - id : offset});
+        offset = id_at + length;
+    }
+    return records;
+}
+
+inline bool c_identifier(string_view name)
+{
+    if(name.empty() || std::isdigit(static_cast<unsigned char>(name[0])))
+        return false;
+    for(char c : name)
+    {
+        if(!std::isalnum(static_cast<unsigned char>(c)) && c != '_')
+            return false;
+    }
+    return true;
+}
+
+// ld defines __start_X and __stop_X for sections named X if X could be a
+// C identifier, a reference to them keeps all those sections; empty for
+// other symbols
+inline string_view start_stop_section(string_view symbol)
+{
+    string_view name;
+    if(symbol.substr(0, 8) == "__start_")
+        name = symbol.substr(8);
+    else if(symbol.substr(0, 7) == "__stop_")
+        name = symbol.substr(7);
+    return c_identifier(name) ? name : string_view();
+}
 
-    bool operator==(symbol_status const& other) const
+// a file given to the context, opened the first time something needs more
+// than its cache entry; graph nodes made from it share it
+struct input
+{
+    explicit input(string path) : path(std::move(path))
     {
-        return name == other.name;
     }
 
-    bool operator<(symbol_status const& other) const
+    binary const& open()
     {
-        return name < other.name;
+        std::call_once(opened, [this]()
+        {
+            bin.emplace(path);
+        });
+        return *bin;
     }
 
-    friend size_t hash_value(symbol_status const& self)
+    // the file's objects, sections, symbols and index, extracted once without
+    // keeping the file open; open() opens it again when more is needed
+    compact_binary const& snapshot()
     {
-        return std::hash<string>()(self.name);
+        std::call_once(snapshotted, [this]()
+        {
+            compact.emplace(path);
+        });
+        return *compact;
     }
+
+    // an object by its position in objects() when it is known, by name
+    // otherwise, the file's only object unless it is an archive
+    object const& member(string_view name, size_t position = npos)
+    {
+        binary const& b = open();
+        std::call_once(listed, [&]()
+        {
+            for(object const& obj : b.objects())
+                objects.push_back(obj);
+            for(size_t i = 0; i != objects.size(); ++i)
+                index.emplace(objects[i].name(), i);
+        });
+
+        if(!mabo::holds_alternative<mabo::archive>(b) && !objects.empty())
+            return objects.front();
+        if(position < objects.size())
+            return objects[position];
+
+        auto it = index.find(name);
+        if(it == index.end())
+            throw std::runtime_error("no member " + name.to_string() + " in " + path);
+        return objects[it->second];
+    }
+
+    string const path;
+
+    static const size_t npos = size_t(-1);
+
+private:
+    std::once_flag opened;
+    optional<binary> bin;
+    std::once_flag snapshotted;
+    optional<compact_binary> compact;
+    std::once_flag listed;
+    vector<object> objects;
+    std::unordered_map<string_view, size_t> index;
 };
 
-}
+struct open_input
+{
+    binary operator()() const
+    {
+        return in->open();
+    }
 
-}
+    std::shared_ptr<input> in;
+};
+
+struct open_member
+{
+    binary operator()() const
+    {
+        return binary(in->member(name, position));
+    }
 
-namespace std
+    std::shared_ptr<input> in;
+    string name;
+    size_t position;
+};
+
+struct to_binary
 {
-    template<> struct hash<::mabo::detail::symbol_status> : mabo::detail::hash_value {};
+    binary const& operator()(std::shared_ptr<input> const& in) const
+    {
+        return in->open();
+    }
+};
+
 }
 
-namespace mabo
+// what the nodes of the dependency graph are
+struct granularity
+{
+    enum type
+    {
+        BINARY,
+        OBJECT,
+        SECTION     // sections of the linked objects, all allocated ones and any
+                    // other with relocations, edges come from relocations
+    };
+};
+
+// a node of the section graph, told apart by position rather than by name
+struct section_key
 {
+    uint32_t object;    // the linked object, in link order
+    uint32_t index;     // section::index() in it
+};
+
+// what dependencies() returns, the graph and what was found while building it
+struct resolution
+{
+    dependency_graph dependencies;
+    mabo::diagnostics diagnostics;
+    vector<section_key> sections;   // per node at section granularity, empty otherwise
+};
 
 struct context
 {
+    // with a cache the file is only opened when its entry is missing or stale,
+    // in compact mode it is snapshotted and closed, otherwise it is opened here
     void load_file(string_view str)
     {
-        binaries_.emplace_back(str);
-        loaded_.insert(str.to_string());
+        inputs_.push_back(std::make_shared<detail::input>(str.to_string()));
+        if(compact_)
+            inputs_.back()->snapshot();
+        else if(!cache_)
+            inputs_.back()->open();
+        mark_loaded(str.to_string());
     }
 
+    // loads the shared library closure breadth first, the order ld.so loads it in,
+    // each level is resolved and opened concurrently and appended in a fixed order
     void load_dynamic()
     {
-        for(binary const& bin : binaries_)
+        MABO_PHASE(LOAD_DYNAMIC);
+        size_t threads = thread_safe() ? thread_count(threads_) : 1;
+
+        vector<detail::input*> level;
+        for(std::shared_ptr<detail::input> const& in : inputs_)
+            level.push_back(in.get());
+
+        while(!level.empty())
         {
-            load_dynamic(bin);
+            vector<vector<pair<string, optional<string>>>> needed(level.size());
+            parallel_for(level.size(), threads, [&](size_t i)
+            {
+                needed[i] = this->needed(*level[i]);
+            });
+
+            // symlinked or repeated sonames are only loaded once
+            vector<string> files;
+            for(auto const& libs : needed)
+            {
+                for(auto const& lib : libs)
+                {
+                    if(!lib.second)
+                        std::cerr << "dynamic library " << lib.first
+                                  << " not found"
+                                  << std::endl;
+                    else if(mark_loaded(*lib.second))
+                        files.push_back(*lib.second);
+                }
+            }
+
+            // opened, unless cached, by needed() on the next level
+            level.clear();
+            for(string& file : files)
+            {
+                inputs_.push_back(std::make_shared<detail::input>(std::move(file)));
+                level.push_back(inputs_.back().get());
+            }
         }
     }
 
+    // opens the inputs that were not opened yet
     auto binaries() const
     {
-        return ranges::view::const_(binaries_);
+        return inputs_ | ranges::view::transform(detail::to_binary{});
+    }
+
+    // threads used to load and resolve, 0 means one per core
+    void threads(size_t n)
+    {
+        threads_ = n;
+    }
+
+    size_t threads() const
+    {
+        return threads_;
+    }
+
+    // serve symbols, imports and libs from an on-disk cache in dir,
+    // files not cached yet or changed since are read and written back
+    void cache(string_view dir)
+    {
+        cache_.emplace(dir);
+    }
+
+    // keep compact snapshots of inputs instead of open files, set before
+    // loading; the cache is still used first when there is one, section
+    // granularity reopens the linked objects for their relocations
+    void compact(bool on)
+    {
+        compact_ = on;
+    }
+
+    // finds the libs() of loaded objects for load_dynamic()
+    library_resolver& resolver()
+    {
+        return resolver_;
+    }
+
+    // every symbol name seen by the resolver, interned once per context
+    string_pool const& names() const
+    {
+        return names_;
+    }
+
+    // demangled forms of names(), shared by everything printing or grouping them
+    demangle_cache& demangled() const
+    {
+        return demangled_;
     }
 
-    auto dependencies(bool whole_archive = false, bool object_granularity = false) const
+    resolution dependencies(bool whole_archive = false, bool object_granularity = false) const
     {
+        return dependencies(whole_archive, object_granularity ? granularity::OBJECT : granularity::BINARY);
+    }
+
+    resolution dependencies(bool whole_archive, granularity::type level) const
+    {
+        using detail::input;
         using detail::symbol_status;
+        using detail::object_symbols;
+
+        MABO_PHASE(RESOLVE);
+
+        // indexed by interned name id
+        vector<symbol_status> symbols(names_.size());
+        resolution result;
+        dependency_graph::builder graph;
+        mabo::diagnostics& diagnostics = result.diagnostics;
 
-        std::unordered_set<symbol_status> symbols;
-        std::unordered_map<binary, std::unordered_set<binary>> dependencies;
-        std::unordered_set<object> not_referenced;
+        // objects linked in, for section granularity
+        vector<mabo::object> linked;
 
-        for(mabo::binary const& bin : binaries())
+        // binary granularity has one node per input file, section granularity
+        // resolves objects and builds its graph afterwards; obj is null for
+        // objects only known from the cache or a snapshot, their nodes open
+        // them on demand, by position in the file when it is known
+        std::unordered_map<input const*, dependency_graph::node_id> binary_nodes;
+        std::unordered_map<input const*, bool> archives;
+        auto node = [&](std::shared_ptr<input> const& in, string_view name, mabo::object const* obj, size_t position)
         {
-            for(mabo::object const& obj : bin.objects())
+            if(level == granularity::SECTION)
             {
-                binary bin_obj = object_granularity ? binary(obj) : bin;
+                linked.push_back(obj ? *obj : in->member(name, position));
+                return graph.add_node(binary(linked.back()));
+            }
+            if(level == granularity::OBJECT)
+            {
+                if(obj)
+                    return graph.add_node(binary(*obj));
+                return graph.add_node(name, detail::open_member{in, name.to_string(), position});
+            }
+
+            auto it = binary_nodes.find(in.get());
+            if(it == binary_nodes.end())
+                it = binary_nodes.emplace(in.get(), graph.add_node(in->path, detail::open_input{in}, {}, archives[in.get()])).first;
+            return it->second;
+        };
+
+        // diagnostics name objects through the pool, like symbols
+        auto name_of = [&](string_view name)
+        {
+            return names_[names_.intern(name)];
+        };
+
+        // in link order, same named members of an archive are distinct
+        vector<string_view> not_referenced;
+
+        auto status = [&](string_pool::id_type id) -> symbol_status&
+        {
+            if(id >= symbols.size())
+                symbols.resize(id + 1);
+            return symbols[id];
+        };
 
-                if(!whole_archive && obj.archive())
+        auto undefined = [&](string_pool::id_type id)
+        {
+            return id < symbols.size() && (symbols[id].state & symbol_status::UNDEF);
+        };
+
+        // safe to run concurrently for distinct objects, names_ is thread-safe
+        // takes an object, a compact_object or a symbol_cache::record
+        auto extract = [&](auto const& obj)
+        {
+            object_symbols syms;
+            for(auto const& sym : obj.symbols())
+                syms.symbols.push_back(detail::symbol_ref{names_.intern(sym.name()), sym.weak()});
+            for(auto const& sym : obj.imports())
+                syms.imports.push_back(detail::symbol_ref{names_.intern(sym.name()), sym.weak()});
+            return syms;
+        };
+
+        // link-order semantics, always runs on this thread in order
+        auto resolve = [&](dependency_graph::node_id bin_obj, object_symbols const& syms)
+        {
+            for(detail::symbol_ref const& sym : syms.symbols)
+            {
+                symbol_status& st = status(sym.name);
+
+                if(st.state & symbol_status::UNDEF)
+                    graph.add_edge(st.node, bin_obj);
+
+                if(st.state == symbol_status::DEFINED)
+                    diagnostics.add(diagnostic{diagnostic::MULTIPLE_DEFINITION, names_[sym.name], name_of(graph.name(bin_obj)), name_of(graph.name(st.node))});
+
+                st.state &= ~symbol_status::UNDEF;
+                st.state |= symbol_status::DEFINED;
+                if(sym.weak)
+                    st.state |= symbol_status::WEAK;
+                st.node = bin_obj;
+            }
+
+            for(detail::symbol_ref const& sym : syms.imports)
+            {
+                symbol_status& st = status(sym.name);
+
+                if(st.state & symbol_status::DEFINED)
                 {
-                    bool referenced = false;
-                    for(mabo::symbol const& sym : obj.symbols())
+                    graph.add_edge(bin_obj, st.node);
+                }
+                else
+                {
+                    st.state = symbol_status::UNDEF;
+                    st.node = bin_obj;
+                }
+                if(sym.weak)
+                    st.state |= symbol_status::WEAK;
+            }
+        };
+
+        // archive members without --whole-archive are only linked in when referenced
+        auto resolve_member = [&](std::shared_ptr<input> const& in, string_view name, mabo::object const* obj, size_t position, object_symbols const& syms)
+        {
+            if(ranges::any_of(syms.symbols, [&](detail::symbol_ref const& sym) { return undefined(sym.name); }))
+                resolve(node(in, name, obj, position), syms);
+            else
+                not_referenced.push_back(name_of(name));
+        };
+
+        // the member defining armap[index], opened or read from the cache or
+        // a snapshot, which also know its position in the file
+        struct member
+        {
+            size_t index;
+            bool found;
+            string_view name;
+            optional<mabo::object> obj;
+            object_symbols syms;
+            size_t position;
+        };
+
+        // open(m) fills in m, on several threads when concurrent is set;
+        // name(i) names the member of armap[i] without loading it
+        auto pull_members = [&](std::shared_ptr<input> const& in, auto const& armap, auto&& open, auto&& name, bool concurrent, size_t threads)
+        {
+            vector<string_pool::id_type> armap_ids;
+            armap_ids.reserve(armap.size());
+            for(auto const& entry : armap)
+                armap_ids.push_back(names_.intern(entry.name));
+
+            // like a linker, only open the members defining a currently undefined symbol,
+            // and rescan the index until it stops pulling in new members; members are
+            // told apart by their offset, names can repeat
+            std::unordered_set<size_t> pulled;
+            for(bool progress = true; progress; )
+            {
+                progress = false;
+
+                // the members wanted at the start of a pass are opened and extracted
+                // up front, the pass itself still decides in index order what is
+                // pulled; one pulled earlier can define what a later one was wanted
+                // for, or need a member nobody wanted yet, which is opened then
+                vector<member> wanted;
+                std::unordered_map<size_t, size_t> prepared;
+                if(threads != 1)
+                {
+                    for(size_t i = 0; i != armap.size(); ++i)
                     {
-                        auto it = symbols.find(sym.name());
-                        if(it != symbols.end() && (it->state & symbol_status::UNDEF))
-                        {
-                            referenced = true;
-                            break;
-                        }
+                        if(undefined(armap_ids[i]) && !pulled.count(armap[i].member) && prepared.emplace(armap[i].member, wanted.size()).second)
+                            wanted.push_back(member{i, false, {}, {}, {}, input::npos});
                     }
-                    if(!referenced)
+
+                    MABO_PHASE(EXTRACT);
+                    parallel_for(wanted.size(), concurrent ? threads : 1, [&](size_t j)
                     {
-                        not_referenced.insert(obj);
+                        open(wanted[j]);
+                    });
+                }
+
+                for(size_t i = 0; i != armap.size(); ++i)
+                {
+                    if(!undefined(armap_ids[i]) || pulled.count(armap[i].member))
                         continue;
+
+                    pulled.insert(armap[i].member);
+                    auto it = prepared.find(armap[i].member);
+                    member late{i, false, {}, {}, {}, input::npos};
+                    if(it == prepared.end())
+                        open(late);
+
+                    member const& m = it == prepared.end() ? late : wanted[it->second];
+                    if(m.found)
+                    {
+                        resolve_member(in, m.name, m.obj ? &*m.obj : nullptr, m.position, m.syms);
+                        progress = true;
                     }
                 }
+            }
 
-                for(mabo::symbol const& sym : obj.symbols())
-                {
-                    auto it = symbols.insert(sym.name()).first;
+            // the members in the index that were not pulled in, members defining
+            // nothing are never looked at
+            for(size_t i = 0; i != armap.size(); ++i)
+            {
+                if(!pulled.insert(armap[i].member).second)
+                    continue;
+                if(optional<string_view> n = name(i))
+                    not_referenced.push_back(*n);
+            }
+        };
 
-                    if(it->state & symbol_status::UNDEF)
-                        dependencies[*it->object].emplace(bin_obj);
+        // an archive with an index, through the cache when it has the archive,
+        // or the snapshot in compact mode
+        auto pull = [&](std::shared_ptr<input> const& in, symbol_cache::entry const* cached, size_t threads)
+        {
+            if(!cached && compact_)
+            {
+                compact_binary const& snapshot = in->snapshot();
+                vector<compact_armap_entry> const armap = snapshot.armap();
+                auto open = [&](member& m)
+                {
+                    compact_object obj = snapshot.object(armap[m.index].member);
+                    m.found = true;
+                    m.name = obj.name();
+                    m.syms = extract(obj);
+                    m.position = armap[m.index].member;
+                };
+                auto name = [&](size_t i) -> optional<string_view>
+                {
+                    return name_of(snapshot.object(armap[i].member).name());
+                };
+                pull_members(in, armap, open, name, true, threads);
+                return;
+            }
 
-                    if(it->state == symbol_status::DEFINED)
-                        std::cout << "multiple definitions of symbol " << sym.name()
-                                  << " defined in " << bin_obj.name()
-                                  << ", previous definition in " << it->object->name()
-                                  << std::endl;
+            if(cached)
+            {
+                auto const& armap = cached->armap();
+                auto open = [&](member& m)
+                {
+                    symbol_cache::record record = cached->at(armap[m.index].member);
+                    m.found = true;
+                    m.name = record.name();
+                    m.syms = extract(record);
+                    m.position = armap[m.index].member;
+                };
+                auto name = [&](size_t i) -> optional<string_view>
+                {
+                    return name_of(cached->at(armap[i].member).name());
+                };
+                pull_members(in, armap, open, name, true, threads);
+                return;
+            }
 
-                    it->state &= ~symbol_status::UNDEF;
-                    it->state |= symbol_status::DEFINED;
-                    if(sym.weak())
-                        it->state |= symbol_status::WEAK;
-                    it->object = bin_obj;
+            mabo::archive const& ar = mabo::get<mabo::archive>(in->open());
+            auto const& armap = ar.armap();
+            auto open = [&](member& m)
+            {
+                m.obj = ar.armap_member(m.index);
+                m.found = bool(m.obj);
+                if(m.obj)
+                {
+                    m.name = m.obj->name();
+                    m.syms = extract(*m.obj);
                 }
+            };
+            auto name = [&](size_t i) -> optional<string_view>
+            {
+                // opened but not loaded, only to name it
+                if(optional<mabo::object> obj = ar.armap_member(i))
+                    return name_of(obj->name());
+                return {};
+            };
+            // libbfd shares the archive's handle between its members
+            pull_members(in, armap, open, name, archive_thread_safe(), threads);
+        };
+
+        // an object, cache record or snapshot to resolve, or an archive to pull
+        // members from through its index, in link order
+        struct step
+        {
+            std::shared_ptr<input> in;
+            symbol_cache::entry const* cached;
+            bool member;
+            bool pull;
+            optional<mabo::object> obj;
+            optional<symbol_cache::record> record;
+            optional<compact_object> compact;
+            size_t position;
+            object_symbols syms;
+        };
+
+        size_t threads = thread_count(threads_);
+        vector<std::shared_ptr<symbol_cache::entry const>> entries = cached(threads);
+
+        auto prepare = [&](step& s)
+        {
+            if(s.record)
+                s.syms = extract(*s.record);
+            else if(s.compact)
+                s.syms = extract(*s.compact);
+            else if(s.obj)
+                s.syms = extract(*s.obj);
+        };
+
+        auto run = [&](step const& s)
+        {
+            if(s.pull)
+            {
+                pull(s.in, s.cached, threads);
+                return;
+            }
+
+            // the object of a cached file that is no archive is named after the
+            // file as it was given this time
+            mabo::object const* obj = s.obj ? &*s.obj : nullptr;
+            string_view name = obj ? obj->name() : s.compact ? s.compact->name() : s.cached->archive() ? s.record->name() : string_view(s.in->path);
+            if(s.member)
+                resolve_member(s.in, name, obj, s.position, s.syms);
+            else
+                resolve(node(s.in, name, obj, s.position), s.syms);
+        };
+
+        // on one thread every step runs as soon as it is found, nothing is preloaded
+        vector<step> steps;
+        auto add = [&](step s)
+        {
+            if(threads == 1)
+            {
+                prepare(s);
+                run(s);
+            }
+            else
+                steps.push_back(std::move(s));
+        };
 
-                for(mabo::symbol const& sym : obj.imports())
+        for(size_t i = 0; i != inputs_.size(); ++i)
+        {
+            std::shared_ptr<input> const& in = inputs_[i];
+            symbol_cache::entry const* cached = entries[i].get();
+
+            // which members are needed depends on the resolution so far
+            // told to binary nodes from the cache, snapshot or open file
+            if(cached)
+            {
+                archives[in.get()] = cached->archive();
+                bool member = !whole_archive && cached->archive();
+                if(member && !cached->armap().empty())
+                    add(step{in, cached, true, true, {}, {}, {}, input::npos, {}});
+                else
                 {
-                    auto it = symbols.insert(sym.name()).first;
+                    size_t position = 0;
+                    for(symbol_cache::record const& record : cached->records())
+                        add(step{in, cached, member, false, {}, record, {}, position++, {}});
+                }
+                continue;
+            }
 
-                    if(it->state & symbol_status::DEFINED)
-                    {
-                        dependencies[bin_obj].emplace(*it->object);
-                    }
-                    else
-                    {
-                        it->state = symbol_status::UNDEF;
-                        it->object = bin_obj;
-                    }
-                    if(sym.weak())
-                        it->state |= symbol_status::WEAK;
+            // snapshots are taken when the file is loaded
+            if(compact_)
+            {
+                compact_binary const& snapshot = in->snapshot();
+                archives[in.get()] = snapshot.archive();
+                bool member = !whole_archive && snapshot.archive();
+                if(member && !snapshot.armap().empty())
+                    add(step{in, nullptr, true, true, {}, {}, {}, input::npos, {}});
+                else
+                {
+                    size_t position = 0;
+                    for(compact_object obj : snapshot.objects())
+                        add(step{in, nullptr, member, false, {}, {}, obj, position++, {}});
                 }
+                continue;
+            }
+
+            binary const& bin = in->open();
+            archives[in.get()] = mabo::holds_alternative<mabo::archive>(bin);
+            bool member = !whole_archive && mabo::holds_alternative<mabo::archive>(bin);
+            if(member && !mabo::get<mabo::archive>(bin).armap().empty())
+                add(step{in, nullptr, true, true, {}, {}, {}, input::npos, {}});
+            else if(threads == 1)
+            {
+                for(mabo::object const& obj : bin.objects())
+                    add(step{in, nullptr, member, false, obj, {}, {}, input::npos, {}});
+            }
+            else
+            {
+                for(mabo::object& obj : bin.objects(threads))
+                    add(step{in, nullptr, member, false, std::move(obj), {}, {}, input::npos, {}});
+            }
+        }
+
+        if(threads != 1)
+        {
+            // libbfd may not be able to load symbol tables concurrently
+            if(!thread_safe())
+            {
+                for(step const& s : steps)
+                    if(s.obj)
+                        (void)s.obj->symbols();
             }
+
+            {
+                MABO_PHASE(EXTRACT);
+                parallel_for(steps.size(), threads, [&](size_t i)
+                {
+                    prepare(steps[i]);
+                });
+            }
+
+            for(step const& s : steps)
+                run(s);
         }
 
-        for(auto&& sym : symbols)
+        for(string_pool::id_type id = 0; id != symbols.size(); ++id)
         {
-            if(sym.state == symbol_status::UNDEF)
-                std::cout << "undefined symbol " << sym.name << " in object " << sym.object->name() << std::endl;
+            if(symbols[id].state == symbol_status::UNDEF)
+                diagnostics.add(diagnostic{diagnostic::UNDEFINED_SYMBOL, names_[id], name_of(graph.name(symbols[id].node)), {}});
         }
 
-        for(mabo::object const& obj : not_referenced)
+        for(string_view name : not_referenced)
         {
-            std::cout << "unused object: " << obj.name() << std::endl;
+            diagnostics.add(diagnostic{diagnostic::UNUSED_OBJECT, {}, name, {}});
         }
 
-        return dependencies;
+        result.dependencies = level == granularity::SECTION ? section_graph(linked, threads, result.sections) : graph.build();
+        return result;
     }
 
 private:
-    void load_dynamic(binary const& bin)
+    // section -> section edges of the linked objects through their relocations,
+    // a reference to a global symbol goes to the section of its first strong
+    // definition; code depends on the LSDA and personality routine its FDE in
+    // .eh_frame names, and a reference to __start_X or __stop_X on every
+    // section X; keys gets the position of each node
+    dependency_graph section_graph(vector<object> const& linked, size_t threads, vector<section_key>& keys) const
     {
-        for(object const& obj : bin.objects())
+        using detail::object_sections;
+        using detail::section_symbol;
+
+        vector<object_sections> extracted(linked.size());
+        parallel_for(linked.size(), thread_safe() ? threads : 1, [&](size_t i)
         {
-            for(string_view lib : obj.libs())
+            object_sections& out = extracted[i];
+
+            // by section index, COMDAT groups and assembler output can
+            // repeat a name within one object
+            std::unordered_map<uint32_t, uint32_t> index;
+            auto section = [&](uint32_t sec, string_view name)
+            {
+                auto it = index.emplace(sec, uint32_t(out.sections.size()));
+                if(it.second)
+                    out.sections.emplace_back(sec, name);
+                return it.first->second;
+            };
+
+            // from is the section depending on what rel refers to
+            auto refer = [&](uint32_t from, relocation const& rel)
+            {
+                if(!rel.local)
+                    out.references.push_back(section_symbol{from, names_.intern(rel.symbol), false});
+                else if(rel.target_index != relocation::npos)
+                    out.local.emplace_back(from, section(rel.target_index, rel.target));
+            };
+
+            // every allocated section is a node, referenced or not
+            std::unordered_map<uint32_t, vector<relocation>> eh_frames;
+            for(auto const& sec : linked[i].sections())
             {
-                bool found = false;
-                for(string_view path : obj.link_paths())
+                if(sec.flags() & SHF_ALLOC)
+                    section(sec.index(), sec.name());
+                if(sec.name() == ".eh_frame")
+                    eh_frames[sec.index()];
+            }
+
+            for(auto const& sym : linked[i].symbols())
+            {
+                if(auto sec = sym.section())
+                    out.definitions.push_back(section_symbol{section(sec->index(), sec->name()), names_.intern(sym.name()), sym.weak()});
+            }
+
+            for(relocation const& rel : linked[i].relocations())
+            {
+                refer(section(rel.section_index, rel.section), rel);
+
+                auto eh = eh_frames.find(rel.section_index);
+                if(eh != eh_frames.end())
+                    eh->second.push_back(rel);
+            }
+
+            // the first relocation of an FDE is its pc_begin, the code it
+            // covers, the others and those of its CIE are what that code
+            // needs to unwind: the LSDA and the personality routine
+            for(auto const& sec : linked[i].sections())
+            {
+                auto eh = eh_frames.find(sec.index());
+                if(eh == eh_frames.end() || eh->second.empty())
+                    continue;
+
+                vector<relocation>& rels = eh->second;
+                std::sort(rels.begin(), rels.end(), [](relocation const& a, relocation const& b)
+                {
+                    return a.offset < b.offset;
+                });
+                auto in = [&](detail::eh_record const& r)
                 {
-                    // TODO: check compatible arch
-                    std::string file = path.to_string();
-                    file += "/";
-                    file.insert(file.end(), lib.begin(), lib.end());
-                    std::ifstream ifs(file);
-                    if(ifs)
+                    auto first = std::lower_bound(rels.begin(), rels.end(), r.offset, [](relocation const& rel, uint64_t offset)
                     {
-                        if(loaded_.find(file) == loaded_.end())
-                        {
-                            load_file(file);
-                            load_dynamic(binaries_.back());
-                        }
-                        found = true;
-                        break;
+                        return rel.offset < offset;
+                    });
+                    auto last = std::lower_bound(first, rels.end(), r.end, [](relocation const& rel, uint64_t offset)
+                    {
+                        return rel.offset < offset;
+                    });
+                    return ranges::make_iterator_range(first, last);
+                };
+
+                auto data = sec.data<unsigned char>();
+                vector<detail::eh_record> records = detail::eh_records(data.begin(), data.end() - data.begin());
+                std::unordered_map<uint64_t, detail::eh_record const*> cies;
+                for(detail::eh_record const& r : records)
+                {
+                    if(r.cie == r.offset)
+                        cies.emplace(r.offset, &r);
+                }
+
+                for(detail::eh_record const& r : records)
+                {
+                    auto fde = in(r);
+                    if(r.cie == r.offset || fde.empty() || fde.begin()->target_index == relocation::npos)
+                        continue;
+
+                    uint32_t code = section(fde.begin()->target_index, fde.begin()->target);
+                    for(relocation const& rel : ranges::make_iterator_range(fde.begin() + 1, fde.end()))
+                        refer(code, rel);
+
+                    auto cie = cies.find(r.cie);
+                    if(cie != cies.end())
+                    {
+                        for(relocation const& rel : in(*cie->second))
+                            refer(code, rel);
                     }
                 }
+            }
+        });
 
-                if(!found)
-                    std::cerr << "dynamic library " << lib
-                              << " not found"
-                              << std::endl;
+        dependency_graph::builder graph;
+        vector<vector<dependency_graph::node_id>> nodes(linked.size());
+        vector<dependency_graph::node_id> defined(names_.size(), dependency_graph::node_id(dependency_graph::npos));
+        vector<bool> weak(names_.size());
+        std::unordered_map<string_view, vector<dependency_graph::node_id>> start_stop;
+
+        for(size_t i = 0; i != linked.size(); ++i)
+        {
+            // one node per section even where object and section names repeat
+            for(pair<uint32_t, string_view> const& sec : extracted[i].sections)
+            {
+                nodes[i].push_back(graph.add_distinct_node(binary(linked[i]), sec.second));
+                keys.push_back(section_key{uint32_t(i), sec.first});
+                if(detail::c_identifier(sec.second))
+                    start_stop[sec.second].push_back(nodes[i].back());
+            }
+
+            for(section_symbol const& def : extracted[i].definitions)
+            {
+                if(defined[def.name] == dependency_graph::npos || (weak[def.name] && !def.weak))
+                {
+                    defined[def.name] = nodes[i][def.section];
+                    weak[def.name] = def.weak;
+                }
             }
         }
+
+        for(size_t i = 0; i != linked.size(); ++i)
+        {
+            for(section_symbol const& ref : extracted[i].references)
+            {
+                if(defined[ref.name] != dependency_graph::npos)
+                    graph.add_edge(nodes[i][ref.section], defined[ref.name]);
+                else if(!start_stop.empty())
+                {
+                    auto it = start_stop.find(detail::start_stop_section(names_[ref.name]));
+                    if(it != start_stop.end())
+                    {
+                        for(dependency_graph::node_id sec : it->second)
+                            graph.add_edge(nodes[i][ref.section], sec);
+                    }
+                }
+            }
+
+            for(pair<uint32_t, uint32_t> const& local : extracted[i].local)
+            {
+                if(local.first != local.second)
+                    graph.add_edge(nodes[i][local.first], nodes[i][local.second]);
+            }
+        }
+
+        return graph.build();
+    }
+
+    // cache entries of all inputs in order, null where caching is off or failed
+    vector<std::shared_ptr<symbol_cache::entry const>> cached(size_t threads) const
+    {
+        vector<std::shared_ptr<symbol_cache::entry const>> entries(inputs_.size());
+        if(!cache_)
+            return entries;
+
+        // filling a cold cache reads every symbol table
+        parallel_for(inputs_.size(), thread_safe() ? threads : 1, [&](size_t i)
+        {
+            entries[i] = cached(*inputs_[i]);
+        });
+        return entries;
+    }
+
+    // the stamp is checked before the file is opened, a hit never opens it
+    std::shared_ptr<symbol_cache::entry const> cached(detail::input& in) const
+    {
+        if(!cache_)
+            return {};
+
+        std::shared_ptr<symbol_cache::entry const> entry = cache_->find(in.path);
+        if(!entry)
+            entry = cache_->store(in.open());
+        return entry;
+    }
+
+    // the libs() of every object of in with the file each resolves to
+    vector<pair<string, optional<string>>> needed(detail::input& in) const
+    {
+        vector<pair<string, optional<string>>> libs;
+        if(std::shared_ptr<symbol_cache::entry const> entry = cached(in))
+        {
+            for(symbol_cache::record const& record : entry->records())
+                needed(record, libs);
+        }
+        else if(compact_)
+        {
+            for(compact_object obj : in.snapshot().objects())
+                needed(obj, libs);
+        }
+        else
+        {
+            for(object const& obj : in.open().objects())
+                needed(obj, libs);
+        }
+        return libs;
+    }
+
+    // takes an object, a compact_object or a symbol_cache::record
+    template<class Object>
+    void needed(Object const& obj, vector<pair<string, optional<string>>>& libs) const
+    {
+        auto paths = obj.link_paths();
+        for(string_view lib : obj.libs())
+            libs.emplace_back(lib.to_string(), resolver_.find(lib, paths, obj.machine(), obj.bits()));
+    }
+
+    // false if the file, or another name for it, was loaded before
+    bool mark_loaded(string const& file)
+    {
+        struct stat st;
+        if(::stat(file.c_str(), &st) < 0)
+            return loaded_paths_.insert(file).second;
+        return loaded_.insert(std::make_pair(st.st_dev, st.st_ino)).second;
     }
 
-    std::list<binary> binaries_;
-    std::unordered_set<string> loaded_;
+    vector<std::shared_ptr<detail::input>> inputs_;
+    std::set<pair<dev_t, ino_t>> loaded_;
+    std::unordered_set<string> loaded_paths_;
+    size_t threads_ = 1;
+    mutable string_pool names_;
+    mutable demangle_cache demangled_{names_};
+    optional<symbol_cache> cache_;
+    bool compact_ = false;
+    library_resolver resolver_;
 };
 
 }
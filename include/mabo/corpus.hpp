@@ -0,0 +1,558 @@
+#ifndef MABO_CORPUS_HPP_INCLUDED
+#define MABO_CORPUS_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+#include <mabo/binary/symbol_hash.hpp>
+
+#include <elf.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace mabo
+{
+
+// shape of a synthetic link set for scaling tests, see write_corpus()
+struct corpus_options
+{
+    corpus_options()
+    : objects(1000), symbols(16), name_length(24), fanout(4), loose(1), archives(4),
+      shared(2), shared_fanout(1), duplicates(0), cycles(false), seed(1)
+    {
+    }
+
+    size_t objects;         // relocatable objects, loose or archive members
+    size_t symbols;         // global functions each object and shared library defines
+    size_t name_length;     // symbol names are padded to at least this
+    size_t fanout;          // symbols each object imports from other objects
+    size_t loose;           // objects written as plain .o files, the rest go into archives
+    size_t archives;
+    size_t shared;          // shared libraries, each one needing the next
+    size_t shared_fanout;   // symbols each object imports from shared libraries
+    size_t duplicates;      // objects also defining the first symbol of the next one
+    bool cycles;            // a quarter of the imports point backwards
+    uint64_t seed;
+};
+
+namespace detail { namespace corpus
+{
+
+// splitmix64, the same stream on every platform
+struct random
+{
+    explicit random(uint64_t seed) : state(seed)
+    {
+    }
+
+    uint64_t operator()()
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    // in [0, n)
+    size_t below(size_t n)
+    {
+        return size_t((*this)() % n);
+    }
+
+    uint64_t state;
+};
+
+inline string symbol_name(char kind, size_t file, size_t index, size_t length)
+{
+    string name = kind + std::to_string(file) + "_" + std::to_string(index);
+    if(name.size() < length)
+        name.append(length - name.size(), 'x');
+    return name;
+}
+
+template<class T>
+void put(string& out, T const& value)
+{
+    out.append(reinterpret_cast<char const*>(&value), sizeof(value));
+}
+
+inline void align(string& out, size_t alignment)
+{
+    out.append((alignment - out.size() % alignment) % alignment, '\0');
+}
+
+// NUL-terminated strings, offset 0 is the empty string
+struct string_table
+{
+    string_table() : data(1, '\0')
+    {
+    }
+
+    uint32_t add(string_view s)
+    {
+        uint32_t offset = uint32_t(data.size());
+        data.append(s.data(), s.size());
+        data += '\0';
+        return offset;
+    }
+
+    string data;
+};
+
+inline Elf64_Ehdr header(uint16_t type)
+{
+    Elf64_Ehdr ehdr;
+    std::memset(&ehdr, 0, sizeof(ehdr));
+    std::memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    ehdr.e_type = type;
+    ehdr.e_machine = EM_X86_64;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+    ehdr.e_shentsize = sizeof(Elf64_Shdr);
+    return ehdr;
+}
+
+inline Elf64_Shdr section_header(uint32_t name, uint32_t type, uint64_t flags, uint64_t offset, uint64_t size,
+                                 uint32_t link = 0, uint32_t info = 0, uint64_t align = 1, uint64_t entsize = 0)
+{
+    Elf64_Shdr shdr;
+    shdr.sh_name = name;
+    shdr.sh_type = type;
+    shdr.sh_flags = flags;
+    shdr.sh_addr = flags & SHF_ALLOC ? offset : 0;
+    shdr.sh_offset = offset;
+    shdr.sh_size = size;
+    shdr.sh_link = link;
+    shdr.sh_info = info;
+    shdr.sh_addralign = align;
+    shdr.sh_entsize = entsize;
+    return shdr;
+}
+
+inline Elf64_Sym symbol(uint32_t name, unsigned char bind, unsigned char type, uint16_t shndx, uint64_t value, uint64_t size)
+{
+    Elf64_Sym sym;
+    sym.st_name = name;
+    sym.st_info = ELF64_ST_INFO(bind, type);
+    sym.st_other = STV_DEFAULT;
+    sym.st_shndx = shndx;
+    sym.st_value = value;
+    sym.st_size = size;
+    return sym;
+}
+
+// a function per definition calling its share of the imports, then returning
+inline void text(vector<string> const& definitions, size_t imports, string& code, vector<pair<uint64_t, uint64_t>>& functions, vector<pair<uint64_t, size_t>>& calls)
+{
+    for(size_t i = 0; i != definitions.size(); ++i)
+    {
+        uint64_t start = code.size();
+        for(size_t j = i; j < imports; j += definitions.size())
+        {
+            calls.emplace_back(code.size() + 1, j);
+            code += "\xe8";
+            code.append(4, '\0');
+        }
+        code += "\xc3";
+        functions.emplace_back(start, code.size() - start);
+        align(code, 16);
+    }
+}
+
+// an x86-64 ET_REL with .text, its relocations and a symbol table
+inline string relocatable(vector<string> const& definitions, vector<string> const& imports)
+{
+    enum { TEXT = 1, RELA, SYMTAB, STRTAB, SHSTRTAB, NOTE, COUNT };
+
+    string code;
+    vector<pair<uint64_t, uint64_t>> functions;
+    vector<pair<uint64_t, size_t>> calls;
+    text(definitions, imports.size(), code, functions, calls);
+
+    // locals first: the null and the section symbol
+    string_table strtab;
+    vector<Elf64_Sym> syms;
+    syms.push_back(symbol(0, STB_LOCAL, STT_NOTYPE, SHN_UNDEF, 0, 0));
+    syms.push_back(symbol(0, STB_LOCAL, STT_SECTION, TEXT, 0, 0));
+    uint32_t const first_global = uint32_t(syms.size());
+    for(size_t i = 0; i != definitions.size(); ++i)
+        syms.push_back(symbol(strtab.add(definitions[i]), STB_GLOBAL, STT_FUNC, TEXT, functions[i].first, functions[i].second));
+    uint32_t const first_import = uint32_t(syms.size());
+    for(string const& name : imports)
+        syms.push_back(symbol(strtab.add(name), STB_GLOBAL, STT_NOTYPE, SHN_UNDEF, 0, 0));
+
+    vector<Elf64_Rela> relocations;
+    for(pair<uint64_t, size_t> const& call : calls)
+    {
+        Elf64_Rela rela;
+        rela.r_offset = call.first;
+        rela.r_info = ELF64_R_INFO(first_import + call.second, R_X86_64_PLT32);
+        rela.r_addend = -4;
+        relocations.push_back(rela);
+    }
+
+    string_table shstrtab;
+    uint32_t names[COUNT] = {0};
+    names[TEXT] = shstrtab.add(".text");
+    names[RELA] = shstrtab.add(".rela.text");
+    names[SYMTAB] = shstrtab.add(".symtab");
+    names[STRTAB] = shstrtab.add(".strtab");
+    names[SHSTRTAB] = shstrtab.add(".shstrtab");
+    names[NOTE] = shstrtab.add(".note.GNU-stack");
+
+    string out(sizeof(Elf64_Ehdr), '\0');
+    vector<Elf64_Shdr> shdrs(COUNT);
+    std::memset(&shdrs[0], 0, sizeof(Elf64_Shdr));
+
+    align(out, 16);
+    shdrs[TEXT] = section_header(names[TEXT], SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, out.size(), code.size(), 0, 0, 16);
+    shdrs[TEXT].sh_addr = 0;
+    out += code;
+
+    align(out, 8);
+    shdrs[RELA] = section_header(names[RELA], SHT_RELA, SHF_INFO_LINK, out.size(), relocations.size() * sizeof(Elf64_Rela), SYMTAB, TEXT, 8, sizeof(Elf64_Rela));
+    for(Elf64_Rela const& rela : relocations)
+        put(out, rela);
+
+    shdrs[SYMTAB] = section_header(names[SYMTAB], SHT_SYMTAB, 0, out.size(), syms.size() * sizeof(Elf64_Sym), STRTAB, first_global, 8, sizeof(Elf64_Sym));
+    for(Elf64_Sym const& sym : syms)
+        put(out, sym);
+
+    shdrs[STRTAB] = section_header(names[STRTAB], SHT_STRTAB, 0, out.size(), strtab.data.size());
+    out += strtab.data;
+    shdrs[SHSTRTAB] = section_header(names[SHSTRTAB], SHT_STRTAB, 0, out.size(), shstrtab.data.size());
+    out += shstrtab.data;
+    shdrs[NOTE] = section_header(names[NOTE], SHT_PROGBITS, 0, out.size(), 0);
+
+    align(out, 8);
+    Elf64_Ehdr ehdr = header(ET_REL);
+    ehdr.e_shoff = out.size();
+    ehdr.e_shnum = COUNT;
+    ehdr.e_shstrndx = SHSTRTAB;
+    for(Elf64_Shdr const& shdr : shdrs)
+        put(out, shdr);
+    std::memcpy(&out[0], &ehdr, sizeof(ehdr));
+    return out;
+}
+
+// an x86-64 ET_DYN mapped in one segment at address 0, with .dynsym found
+// through .hash and a .dynamic naming itself and what it needs, found next to it
+inline string shared_object(string const& soname, vector<string> const& needed, vector<string> const& definitions)
+{
+    enum { HASH = 1, DYNSYM, DYNSTR, TEXT, DYNAMIC, SHSTRTAB, COUNT };
+
+    string code;
+    vector<pair<uint64_t, uint64_t>> functions;
+    vector<pair<uint64_t, size_t>> calls;
+    text(definitions, 0, code, functions, calls);
+
+    string_table dynstr;
+    vector<uint32_t> name_offsets;
+    for(string const& name : definitions)
+        name_offsets.push_back(dynstr.add(name));
+    uint32_t const soname_offset = dynstr.add(soname);
+    uint32_t const runpath_offset = dynstr.add("$ORIGIN");
+    vector<uint32_t> needed_offsets;
+    for(string const& lib : needed)
+        needed_offsets.push_back(dynstr.add(lib));
+
+    // symbol 0 is the null one, chains are indexed like the symbols
+    uint32_t const nsyms = uint32_t(definitions.size() + 1);
+    uint32_t const nbucket = std::max<uint32_t>(1, nsyms / 2);
+    vector<uint32_t> buckets(nbucket, 0);
+    vector<uint32_t> chains(nsyms, 0);
+    for(uint32_t i = 1; i != nsyms; ++i)
+    {
+        uint32_t& bucket = buckets[sysv_hash(definitions[i - 1]) % nbucket];
+        chains[i] = bucket;
+        bucket = i;
+    }
+
+    size_t const phnum = 2;
+    string out(sizeof(Elf64_Ehdr) + phnum * sizeof(Elf64_Phdr), '\0');
+    vector<Elf64_Shdr> shdrs(COUNT);
+    std::memset(&shdrs[0], 0, sizeof(Elf64_Shdr));
+
+    string_table shstrtab;
+    uint32_t names[COUNT] = {0};
+    names[HASH] = shstrtab.add(".hash");
+    names[DYNSYM] = shstrtab.add(".dynsym");
+    names[DYNSTR] = shstrtab.add(".dynstr");
+    names[TEXT] = shstrtab.add(".text");
+    names[DYNAMIC] = shstrtab.add(".dynamic");
+    names[SHSTRTAB] = shstrtab.add(".shstrtab");
+
+    align(out, 8);
+    shdrs[HASH] = section_header(names[HASH], SHT_HASH, SHF_ALLOC, out.size(), (2 + nbucket + nsyms) * 4, DYNSYM, 0, 8, 4);
+    put(out, nbucket);
+    put(out, nsyms);
+    for(uint32_t b : buckets)
+        put(out, b);
+    for(uint32_t c : chains)
+        put(out, c);
+
+    align(out, 8);
+    uint64_t const text_offset = (out.size() + nsyms * sizeof(Elf64_Sym) + dynstr.data.size() + 15) / 16 * 16;
+    shdrs[DYNSYM] = section_header(names[DYNSYM], SHT_DYNSYM, SHF_ALLOC, out.size(), nsyms * sizeof(Elf64_Sym), DYNSTR, 1, 8, sizeof(Elf64_Sym));
+    put(out, symbol(0, STB_LOCAL, STT_NOTYPE, SHN_UNDEF, 0, 0));
+    for(size_t i = 0; i != definitions.size(); ++i)
+        put(out, symbol(name_offsets[i], STB_GLOBAL, STT_FUNC, TEXT, text_offset + functions[i].first, functions[i].second));
+
+    shdrs[DYNSTR] = section_header(names[DYNSTR], SHT_STRTAB, SHF_ALLOC, out.size(), dynstr.data.size());
+    out += dynstr.data;
+
+    align(out, 16);
+    shdrs[TEXT] = section_header(names[TEXT], SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, out.size(), code.size(), 0, 0, 16);
+    out += code;
+
+    align(out, 8);
+    vector<pair<int64_t, uint64_t>> dynamic;
+    for(uint32_t lib : needed_offsets)
+        dynamic.emplace_back(DT_NEEDED, lib);
+    dynamic.emplace_back(DT_SONAME, soname_offset);
+    dynamic.emplace_back(DT_RUNPATH, runpath_offset);
+    dynamic.emplace_back(DT_HASH, shdrs[HASH].sh_offset);
+    dynamic.emplace_back(DT_STRTAB, shdrs[DYNSTR].sh_offset);
+    dynamic.emplace_back(DT_SYMTAB, shdrs[DYNSYM].sh_offset);
+    dynamic.emplace_back(DT_STRSZ, dynstr.data.size());
+    dynamic.emplace_back(DT_SYMENT, sizeof(Elf64_Sym));
+    dynamic.emplace_back(DT_NULL, 0);
+
+    shdrs[DYNAMIC] = section_header(names[DYNAMIC], SHT_DYNAMIC, SHF_ALLOC | SHF_WRITE, out.size(), dynamic.size() * sizeof(Elf64_Dyn), DYNSTR, 0, 8, sizeof(Elf64_Dyn));
+    for(pair<int64_t, uint64_t> const& entry : dynamic)
+    {
+        Elf64_Dyn dyn;
+        dyn.d_tag = entry.first;
+        dyn.d_un.d_val = entry.second;
+        put(out, dyn);
+    }
+    uint64_t const loaded = out.size();
+
+    shdrs[SHSTRTAB] = section_header(names[SHSTRTAB], SHT_STRTAB, 0, out.size(), shstrtab.data.size());
+    out += shstrtab.data;
+
+    align(out, 8);
+    Elf64_Ehdr ehdr = header(ET_DYN);
+    ehdr.e_phoff = sizeof(Elf64_Ehdr);
+    ehdr.e_phentsize = sizeof(Elf64_Phdr);
+    ehdr.e_phnum = phnum;
+    ehdr.e_shoff = out.size();
+    ehdr.e_shnum = COUNT;
+    ehdr.e_shstrndx = SHSTRTAB;
+    for(Elf64_Shdr const& shdr : shdrs)
+        put(out, shdr);
+    std::memcpy(&out[0], &ehdr, sizeof(ehdr));
+
+    Elf64_Phdr phdrs[phnum];
+    phdrs[0].p_type = PT_LOAD;
+    phdrs[0].p_flags = PF_R | PF_W | PF_X;
+    phdrs[0].p_offset = 0;
+    phdrs[0].p_vaddr = phdrs[0].p_paddr = 0;
+    phdrs[0].p_filesz = phdrs[0].p_memsz = loaded;
+    phdrs[0].p_align = 0x1000;
+    phdrs[1].p_type = PT_DYNAMIC;
+    phdrs[1].p_flags = PF_R | PF_W;
+    phdrs[1].p_offset = phdrs[1].p_vaddr = phdrs[1].p_paddr = shdrs[DYNAMIC].sh_offset;
+    phdrs[1].p_filesz = phdrs[1].p_memsz = shdrs[DYNAMIC].sh_size;
+    phdrs[1].p_align = 8;
+    std::memcpy(&out[sizeof(Elf64_Ehdr)], phdrs, sizeof(phdrs));
+    return out;
+}
+
+// a GNU ar archive with a "/" symbol index and "//" long names
+inline string archive(vector<pair<string, string>> const& members, vector<vector<string>> const& definitions)
+{
+    auto header = [](string& out, string const& name, size_t size)
+    {
+        char buffer[61];
+        std::snprintf(buffer, sizeof(buffer), "%-16s%-12s%-6s%-6s%-8s%-10zu`\n", name.c_str(), "0", "0", "0", "644", size);
+        out.append(buffer, 60);
+    };
+
+    string long_names;
+    vector<string> member_names;
+    for(pair<string, string> const& member : members)
+    {
+        if(member.first.size() < 16)
+            member_names.push_back(member.first + "/");
+        else
+        {
+            member_names.push_back("/" + std::to_string(long_names.size()));
+            long_names += member.first + "/\n";
+        }
+    }
+
+    size_t count = 0;
+    string symbol_names;
+    for(vector<string> const& names : definitions)
+    {
+        for(string const& name : names)
+        {
+            symbol_names.append(name.c_str(), name.size() + 1);
+            ++count;
+        }
+    }
+
+    // where each member header will be
+    size_t const index_size = 4 + 4 * count + symbol_names.size();
+    size_t offset = 8 + 60 + index_size + index_size % 2;
+    if(!long_names.empty())
+        offset += 60 + long_names.size() + long_names.size() % 2;
+
+    vector<size_t> offsets;
+    for(pair<string, string> const& member : members)
+    {
+        offsets.push_back(offset);
+        offset += 60 + member.second.size() + member.second.size() % 2;
+    }
+
+    auto big_endian = [](string& out, uint32_t value)
+    {
+        char bytes[4] = {char(value >> 24), char(value >> 16), char(value >> 8), char(value)};
+        out.append(bytes, 4);
+    };
+
+    string out = "!<arch>\n";
+    header(out, "/", index_size);
+    big_endian(out, uint32_t(count));
+    for(size_t i = 0; i != definitions.size(); ++i)
+        for(size_t j = 0; j != definitions[i].size(); ++j)
+            big_endian(out, uint32_t(offsets[i]));
+    out += symbol_names;
+    if(out.size() % 2)
+        out += '\n';
+
+    if(!long_names.empty())
+    {
+        header(out, "//", long_names.size());
+        out += long_names;
+        if(out.size() % 2)
+            out += '\n';
+    }
+
+    for(size_t i = 0; i != members.size(); ++i)
+    {
+        header(out, member_names[i], members[i].second.size());
+        out += members[i].second;
+        if(out.size() % 2)
+            out += '\n';
+    }
+    return out;
+}
+
+inline void write(string const& file, string const& data)
+{
+    std::ofstream os(file, std::ios::binary);
+    os.write(data.data(), data.size());
+    os.close();
+    if(!os)
+        throw std::runtime_error("cannot write " + file);
+}
+
+}}
+
+// writes a synthetic x86-64 link set into dir without a compiler or linker:
+// loose objects, archives with symbol indexes and a chain of shared libraries,
+// the same options always give the same files
+//
+// returns the files in link order, objects before archives before libraries
+inline vector<string> write_corpus(string const& dir, corpus_options const& options)
+{
+    namespace corpus = detail::corpus;
+
+    if(::mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST)
+        throw std::runtime_error("cannot create " + dir);
+
+    corpus::random rng(options.seed);
+    size_t const n = options.objects;
+
+    auto defined = [&](size_t object)
+    {
+        vector<string> names;
+        for(size_t j = 0; j != options.symbols; ++j)
+            names.push_back(corpus::symbol_name('f', object, j, options.name_length));
+        if(object < options.duplicates && n > 1)
+            names.push_back(corpus::symbol_name('f', (object + 1) % n, 0, options.name_length));
+        return names;
+    };
+
+    // forward imports only keep the link order valid, backward ones make cycles
+    auto imported = [&](size_t object)
+    {
+        vector<string> names;
+        for(size_t k = 0; k != options.fanout && n > 1 && options.symbols; ++k)
+        {
+            size_t target;
+            if(options.cycles && object && rng.below(4) == 0)
+                target = rng.below(object);
+            else if(object + 1 < n)
+                target = object + 1 + rng.below(n - object - 1);
+            else
+                continue;
+            names.push_back(corpus::symbol_name('f', target, rng.below(options.symbols), options.name_length));
+        }
+        for(size_t k = 0; k != options.shared_fanout && options.shared && options.symbols; ++k)
+            names.push_back(corpus::symbol_name('d', rng.below(options.shared), rng.below(options.symbols), options.name_length));
+        return names;
+    };
+
+    auto library = [](size_t i)
+    {
+        return "libcorpus" + std::to_string(i) + ".so";
+    };
+
+    vector<string> inputs;
+    size_t const loose = options.archives ? std::min(options.loose, n) : n;
+    for(size_t i = 0; i != loose; ++i)
+    {
+        string file = dir + "/o" + std::to_string(i) + ".o";
+        corpus::write(file, corpus::relocatable(defined(i), imported(i)));
+        inputs.push_back(file);
+    }
+
+    size_t const members = n - loose;
+    for(size_t a = 0; a != options.archives && members; ++a)
+    {
+        vector<pair<string, string>> objects;
+        vector<vector<string>> definitions;
+        for(size_t i = loose + members * a / options.archives; i != loose + members * (a + 1) / options.archives; ++i)
+        {
+            definitions.push_back(defined(i));
+            objects.emplace_back("o" + std::to_string(i) + ".o", corpus::relocatable(definitions.back(), imported(i)));
+        }
+
+        string file = dir + "/libcorpus" + std::to_string(a) + ".a";
+        corpus::write(file, corpus::archive(objects, definitions));
+        inputs.push_back(file);
+    }
+
+    for(size_t i = 0; i != options.shared; ++i)
+    {
+        vector<string> definitions;
+        for(size_t j = 0; j != options.symbols; ++j)
+            definitions.push_back(corpus::symbol_name('d', i, j, options.name_length));
+
+        vector<string> needed;
+        if(i + 1 < options.shared)
+            needed.push_back(library(i + 1));
+
+        string file = dir + "/" + library(i);
+        corpus::write(file, corpus::shared_object(library(i), needed, definitions));
+        inputs.push_back(file);
+    }
+
+    return inputs;
+}
+
+}
+
+#endif
@@ -0,0 +1,288 @@
+#ifndef MABO_DEMANGLE_HPP_INCLUDED
+#define MABO_DEMANGLE_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+#include <mabo/parallel.hpp>
+#include <mabo/string_pool.hpp>
+
+#include <cxxabi.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+
+namespace mabo
+{
+
+namespace detail
+{
+
+// abi::__cxa_demangle into one buffer reused across calls
+struct demangler
+{
+    demangler() : buffer(0), length(0)
+    {
+    }
+
+    demangler(demangler const&) = delete;
+    demangler& operator=(demangler const&) = delete;
+
+    ~demangler()
+    {
+        std::free(buffer);
+    }
+
+    // valid until the next call, the name itself when it isn't mangled
+    string_view operator()(string_view name)
+    {
+        if(name.substr(0, 2) != "_Z")
+            return name;
+
+        mangled.assign(name.data(), name.size());
+        int status = 0;
+        char* out = abi::__cxa_demangle(mangled.c_str(), buffer, &length, &status);
+        if(status || !out)
+            return name;
+        buffer = out;
+        return buffer;
+    }
+
+private:
+    string mangled;
+    char* buffer;
+    size_t length;
+};
+
+// special names that are about a class rather than a member of it
+inline bool demangled_class_prefix(string_view& name)
+{
+    static char const* const prefixes[] = {
+        "vtable for ", "construction vtable for ", "VTT for ", "typeinfo for ", "typeinfo name for "
+    };
+
+    for(char const* prefix : prefixes)
+    {
+        string_view p = prefix;
+        if(name.substr(0, p.size()) == p)
+        {
+            name.remove_prefix(p.size());
+            return true;
+        }
+    }
+    return false;
+}
+
+// a demangled name without its return type and parameters, template
+// arguments collapsed to <>, so all instantiations of a template and all
+// overloads of a function fall together
+inline string template_family(string_view name)
+{
+    static char const* const prefixes[] = {
+        "guard variable for ", "non-virtual thunk to ", "virtual thunk to ", "covariant return thunk to "
+    };
+
+    for(char const* prefix : prefixes)
+    {
+        string_view p = prefix;
+        if(name.substr(0, p.size()) == p)
+            name.remove_prefix(p.size());
+    }
+
+    string_view const anonymous = "(anonymous namespace)";
+    string_view const op = "operator";
+
+    string out;
+    int depth = 0;
+    for(size_t i = 0; i != name.size(); ++i)
+    {
+        char c = name[i];
+        if(depth)
+        {
+            if(c == '<' || c == '(')
+                ++depth;
+            else if(c == '>' || c == ')')
+                --depth;
+            continue;
+        }
+
+        if(name.substr(i, anonymous.size()) == anonymous)
+        {
+            out.append(anonymous.data(), anonymous.size());
+            i += anonymous.size() - 1;
+        }
+        // operator names may contain anything, only the parameters follow
+        else if(name.substr(i, op.size()) == op && (!i || name[i - 1] == ':' || name[i - 1] == ' '))
+        {
+            size_t params = name.find('(', i + op.size() + (name.substr(i + op.size(), 2) == "()" ? 2 : 0));
+            out.append(name.data() + i, (params == string_view::npos ? name.size() : params) - i);
+            break;
+        }
+        // parameters follow the name
+        else if(c == '(')
+            break;
+        else if(c == '<')
+        {
+            out += "<>";
+            depth = 1;
+        }
+        // a return type came first
+        else if(c == ' ')
+            out.clear();
+        else
+            out += c;
+    }
+    return out;
+}
+
+// what a demangled name is grouped under: its enclosing namespace or class
+// with template arguments collapsed, empty for the global namespace and C names
+inline string demangled_scope(string_view name)
+{
+    if(demangled_class_prefix(name))
+        return template_family(name);
+
+    string family = template_family(name);
+    size_t last = family.find("::operator");
+    if(last == string::npos)
+        last = family.rfind("::");
+    return last == string::npos ? string() : family.substr(0, last);
+}
+
+}
+
+// demangled forms of the names in a string_pool, each computed once
+//
+// results are interned into an arena of their own, so repeated names are
+// stored once and stay valid as long as the cache; lookups don't lock once
+// a name is demangled
+struct demangle_cache
+{
+    explicit demangle_cache(string_pool const& names) : names(names)
+    {
+        for(std::atomic<entry*>& block : blocks)
+            block.store(nullptr, std::memory_order_relaxed);
+    }
+
+    demangle_cache(demangle_cache const&) = delete;
+    demangle_cache& operator=(demangle_cache const&) = delete;
+
+    ~demangle_cache()
+    {
+        for(std::atomic<entry*>& block : blocks)
+            delete[] block.load(std::memory_order_relaxed);
+    }
+
+    // the name itself when it isn't a C++ name, thread-safe
+    string_view demangled(string_pool::id_type id)
+    {
+        static thread_local detail::demangler demangle;
+        return lookup(id, demangle).full;
+    }
+
+    // see detail::template_family, for grouping
+    string_view stripped(string_pool::id_type id)
+    {
+        static thread_local detail::demangler demangle;
+        return lookup(id, demangle).stripped;
+    }
+
+    // by name, names not in the pool are demangled without being cached,
+    // so a copy is returned either way
+    string demangled(string_view name)
+    {
+        string_pool::id_type id = names.find(name);
+        if(id != string_pool::npos)
+            return demangled(id).to_string();
+
+        static thread_local detail::demangler demangle;
+        return demangle(name).to_string();
+    }
+
+    // fills the cache for ids on up to `threads` threads, in batches that
+    // share one demangling buffer
+    void demangle(vector<string_pool::id_type> const& ids, size_t threads)
+    {
+        size_t const batch = 1024;
+        parallel_for((ids.size() + batch - 1) / batch, threads, [&](size_t b)
+        {
+            detail::demangler demangle;
+            size_t last = std::min(ids.size(), (b + 1) * batch);
+            for(size_t i = b * batch; i != last; ++i)
+                (void)lookup(ids[i], demangle);
+        });
+    }
+
+    // every name interned so far
+    void demangle(size_t threads)
+    {
+        vector<string_pool::id_type> ids(names.size());
+        for(string_pool::id_type id = 0; id != ids.size(); ++id)
+            ids[id] = id;
+        demangle(ids, threads);
+    }
+
+private:
+    // laid out like string_pool's entries, block k holds 2^(first_block_bits + k)
+    static const size_t first_block_bits = 8;
+    static const size_t max_blocks = 33 - first_block_bits;
+
+    // ids into results plus one, 0 until demangled
+    struct entry
+    {
+        std::atomic<uint32_t> full;
+        std::atomic<uint32_t> stripped;
+    };
+
+    struct forms
+    {
+        string_view full;
+        string_view stripped;
+    };
+
+    // racing threads intern the same strings, whichever stores last wins
+    forms lookup(string_pool::id_type id, detail::demangler& demangle)
+    {
+        entry& e = at(id);
+        uint32_t stripped = e.stripped.load(std::memory_order_acquire);
+        if(stripped)
+            return forms{results[e.full.load(std::memory_order_relaxed) - 1], results[stripped - 1]};
+
+        string_view mangled = names[id];
+        string_view full = demangle(mangled);
+        string_pool::id_type full_id = results.intern(full);
+        string_pool::id_type stripped_id = full.data() == mangled.data() ? full_id : results.intern(detail::template_family(full));
+
+        e.full.store(full_id + 1, std::memory_order_relaxed);
+        e.stripped.store(stripped_id + 1, std::memory_order_release);
+        return forms{results[full_id], results[stripped_id]};
+    }
+
+    // blocks are allocated as the ids demangled reach them
+    entry& at(string_pool::id_type id)
+    {
+        uint64_t v = uint64_t(id) + (uint64_t(1) << first_block_bits);
+        unsigned top = 63 - __builtin_clzll(v);
+        std::atomic<entry*>& block = blocks[top - first_block_bits];
+        entry* p = block.load(std::memory_order_acquire);
+        if(!p)
+        {
+            std::lock_guard<std::mutex> lock(blocks_mutex);
+            p = block.load(std::memory_order_relaxed);
+            if(!p)
+            {
+                p = new entry[size_t(1) << top]();
+                block.store(p, std::memory_order_release);
+            }
+        }
+        return p[v - (uint64_t(1) << top)];
+    }
+
+    string_pool const& names;
+    string_pool results;
+    std::atomic<entry*> blocks[max_blocks];
+    std::mutex blocks_mutex;
+};
+
+}
+
+#endif
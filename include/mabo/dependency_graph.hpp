@@ -0,0 +1,372 @@
+#ifndef MABO_DEPENDENCY_GRAPH_HPP_INCLUDED
+#define MABO_DEPENDENCY_GRAPH_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+#include <mabo/binary.hpp>
+
+#include <range/v3/view.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace mabo
+{
+
+namespace detail
+{
+
+// open addressing table from node name to node id, probing on the stored hashes
+struct node_index
+{
+    typedef uint32_t node_id;
+    static constexpr node_id npos = node_id(-1);
+
+    template<class Names>
+    node_id find(string_view name, string_view section, size_t hash, vector<size_t> const& hashes, Names const& names, Names const& sections) const
+    {
+        if(slots.empty())
+            return npos;
+
+        for(size_t i = hash & (slots.size() - 1); slots[i] != npos; i = (i + 1) & (slots.size() - 1))
+        {
+            if(hashes[slots[i]] == hash && names[slots[i]] == name && sections[slots[i]] == section)
+                return slots[i];
+        }
+        return npos;
+    }
+
+    static size_t hash(string_view name, string_view section)
+    {
+        size_t h = std::hash<string_view>()(name);
+        if(!section.empty())
+            h ^= std::hash<string_view>()(section) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        return h;
+    }
+
+    void insert(node_id id, vector<size_t> const& hashes)
+    {
+        if((id + 1) * 2 > slots.size())
+        {
+            vector<node_id> old(std::max<size_t>(16, slots.size() * 2), node_id(npos));
+            old.swap(slots);
+            for(node_id other : old)
+                if(other != npos)
+                    place(other, hashes[other]);
+        }
+        place(id, hashes[id]);
+    }
+
+private:
+    void place(node_id id, size_t hash)
+    {
+        size_t i = hash & (slots.size() - 1);
+        while(slots[i] != npos)
+            i = (i + 1) & (slots.size() - 1);
+        slots[i] = id;
+    }
+
+    vector<node_id> slots;
+};
+
+// the binary of a node, opened the first time it is asked for when the node
+// was added by name, as the resolver does for inputs served from a cache
+struct graph_node
+{
+    binary const& get()
+    {
+        std::call_once(once, [this]()
+        {
+            if(!bin)
+                bin.emplace(open());
+        });
+        return *bin;
+    }
+
+    string name;
+    std::function<binary()> open;
+    std::once_flag once;
+    optional<binary> bin;
+};
+
+}
+
+// who depends on whom, edge a -> b when a uses a symbol b defines
+//
+// nodes have dense ids in the order they were added, binaries, names,
+// sections, name hashes and archive flags are kept in side arrays and the
+// edges in compressed sparse rows: the targets of node n are
+// targets[offsets[n] .. offsets[n + 1]), sorted and without duplicates
+//
+// nodes are binaries or objects, or sections of objects at section granularity;
+// copies of a graph share the nodes
+struct dependency_graph
+{
+    typedef uint32_t node_id;
+    static constexpr node_id npos = node_id(-1);
+
+    // collects nodes and edges while the resolver runs, then packs them
+    struct builder;
+
+    size_t size() const
+    {
+        return nodes_.size();
+    }
+
+    bool empty() const
+    {
+        return nodes_.empty();
+    }
+
+    size_t edge_count() const
+    {
+        return targets_.size();
+    }
+
+    binary const& node(node_id id) const
+    {
+        return nodes_[id]->get();
+    }
+
+    string_view name(node_id id) const
+    {
+        return names_[id];
+    }
+
+    // empty unless the node is a section
+    string_view section(node_id id) const
+    {
+        return sections_[id];
+    }
+
+    size_t hash(node_id id) const
+    {
+        return hashes_[id];
+    }
+
+    // whether the node is an archive, known without opening it
+    bool archive(node_id id) const
+    {
+        return archives_[id];
+    }
+
+    // nodes id depends on, sorted by id
+    auto edges(node_id id) const
+    {
+        return ranges::make_iterator_range(targets_.data() + offsets_[id], targets_.data() + offsets_[id + 1]);
+    }
+
+    node_id find(string_view name, string_view section = {}) const
+    {
+        return index_.find(name, section, detail::node_index::hash(name, section), hashes_, names_, sections_);
+    }
+
+private:
+    vector<std::shared_ptr<detail::graph_node>> nodes_;
+    vector<string_view> names_;
+    vector<string_view> sections_;
+    vector<size_t> hashes_;
+    vector<bool> archives_;
+    vector<uint32_t> offsets_;
+    vector<node_id> targets_;
+    detail::node_index index_;
+};
+
+struct dependency_graph::builder
+{
+    // nodes are identified by name like binary::operator==, and section,
+    // adding one twice returns the first id
+    node_id add_node(binary const& bin, string_view section = {})
+    {
+        return add(bin.name(), section, [&](detail::graph_node& n)
+        {
+            n.bin.emplace(bin);
+            return n.bin->name();
+        }, mabo::holds_alternative<mabo::archive>(bin));
+    }
+
+    // a node whose binary is only opened once the graph is asked for it,
+    // the caller tells whether it is an archive
+    node_id add_node(string_view name, std::function<binary()> open, string_view section = {}, bool archive = false)
+    {
+        return add(name, section, [&](detail::graph_node& n)
+        {
+            n.name = name.to_string();
+            n.open = std::move(open);
+            return string_view(n.name);
+        }, archive);
+    }
+
+    // a node never merged with another of the same name and section, for
+    // sections sharing a name in one object or objects sharing one across
+    // archives; find() returns the first of them
+    node_id add_distinct_node(binary const& bin, string_view section = {})
+    {
+        return add(bin.name(), section, [&](detail::graph_node& n)
+        {
+            n.bin.emplace(bin);
+            return n.bin->name();
+        }, mabo::holds_alternative<mabo::archive>(bin), true);
+    }
+
+    void add_edge(node_id from, node_id to)
+    {
+        edges.emplace_back(from, to);
+    }
+
+    binary const& node(node_id id) const
+    {
+        return graph.nodes_[id]->get();
+    }
+
+    string_view name(node_id id) const
+    {
+        return graph.names_[id];
+    }
+
+    dependency_graph build()
+    {
+        size_t n = graph.nodes_.size();
+
+        // counting sort on the source
+        graph.offsets_.assign(n + 1, 0);
+        for(pair<node_id, node_id> const& edge : edges)
+            ++graph.offsets_[edge.first + 1];
+        for(size_t i = 0; i != n; ++i)
+            graph.offsets_[i + 1] += graph.offsets_[i];
+
+        vector<uint32_t> fill(graph.offsets_.begin(), graph.offsets_.end() - 1);
+        graph.targets_.resize(edges.size());
+        for(pair<node_id, node_id> const& edge : edges)
+            graph.targets_[fill[edge.first]++] = edge.second;
+        vector<pair<node_id, node_id>>().swap(edges);
+
+        // sort and deduplicate each row in place
+        uint32_t out = 0;
+        for(size_t i = 0; i != n; ++i)
+        {
+            auto first = graph.targets_.begin() + graph.offsets_[i];
+            auto last = graph.targets_.begin() + graph.offsets_[i + 1];
+            std::sort(first, last);
+            last = std::unique(first, last);
+
+            graph.offsets_[i] = out;
+            out = uint32_t(std::copy(first, last, graph.targets_.begin() + out) - graph.targets_.begin());
+        }
+        graph.offsets_[n] = out;
+        graph.targets_.resize(out);
+        graph.targets_.shrink_to_fit();
+
+        graph.index_ = std::move(index);
+        return std::move(graph);
+    }
+
+private:
+    // fill sets up the new node and returns its name as stored in it
+    template<class Fill>
+    node_id add(string_view name, string_view section, Fill&& fill, bool archive, bool distinct = false)
+    {
+        size_t hash = detail::node_index::hash(name, section);
+        node_id first = index.find(name, section, hash, graph.hashes_, graph.names_, graph.sections_);
+        if(first != npos && !distinct)
+            return first;
+
+        auto n = std::make_shared<detail::graph_node>();
+        node_id id = node_id(graph.nodes_.size());
+        graph.names_.push_back(fill(*n));
+        graph.nodes_.push_back(std::move(n));
+        graph.sections_.push_back(section);
+        graph.hashes_.push_back(hash);
+        graph.archives_.push_back(archive);
+        if(first == npos)
+            index.insert(id, graph.hashes_);
+        return id;
+    }
+
+    dependency_graph graph;
+    detail::node_index index;
+    vector<pair<node_id, node_id>> edges;
+};
+
+// strongly connected components, numbered so that every edge between two
+// components goes from a higher to a lower number, sinks come first
+struct graph_components
+{
+    vector<uint32_t> component;     // per node
+    uint32_t count;
+};
+
+// iterative tarjan, deep graphs don't touch the call stack
+inline graph_components strong_components(dependency_graph const& graph)
+{
+    typedef dependency_graph::node_id node_id;
+    size_t const n = graph.size();
+
+    graph_components result{vector<uint32_t>(n), 0};
+    vector<node_id> index(n, node_id(dependency_graph::npos));
+    vector<node_id> low(n);
+    vector<bool> on_stack(n);
+    vector<node_id> stack;
+
+    struct frame
+    {
+        node_id node;
+        node_id const* next;
+    };
+    vector<frame> frames;
+
+    node_id counter = 0;
+    auto visit = [&](node_id v)
+    {
+        index[v] = low[v] = counter++;
+        stack.push_back(v);
+        on_stack[v] = true;
+        frames.push_back(frame{v, graph.edges(v).begin()});
+    };
+
+    for(node_id root = 0; root != n; ++root)
+    {
+        if(index[root] != dependency_graph::npos)
+            continue;
+
+        visit(root);
+        while(!frames.empty())
+        {
+            frame& f = frames.back();
+            node_id v = f.node;
+            if(f.next != graph.edges(v).end())
+            {
+                node_id w = *f.next++;
+                if(index[w] == dependency_graph::npos)
+                    visit(w);
+                else if(on_stack[w])
+                    low[v] = std::min(low[v], index[w]);
+                continue;
+            }
+
+            frames.pop_back();
+            if(!frames.empty())
+                low[frames.back().node] = std::min(low[frames.back().node], low[v]);
+
+            if(low[v] == index[v])
+            {
+                node_id w;
+                do
+                {
+                    w = stack.back();
+                    stack.pop_back();
+                    on_stack[w] = false;
+                    result.component[w] = result.count;
+                } while(w != v);
+                ++result.count;
+            }
+        }
+    }
+    return result;
+}
+
+}
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef MABO_DIAGNOSTICS_HPP_INCLUDED
+#define MABO_DIAGNOSTICS_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+#include <mabo/binary.hpp>
+#include <mabo/demangle.hpp>
+
+#include <ostream>
+
+namespace mabo
+{
+
+// one finding of the resolver, symbol and object names are views into the
+// context's string_pool and live as long as the context; nothing here keeps
+// a file open
+struct diagnostic
+{
+    enum kind_type
+    {
+        MULTIPLE_DEFINITION,
+        UNDEFINED_SYMBOL,
+        UNUSED_OBJECT,
+        KINDS
+    };
+
+    kind_type kind;
+    string_view symbol;         // empty for UNUSED_OBJECT
+    string_view where;          // the object, or input file at binary granularity
+    string_view previous;       // the first definition for MULTIPLE_DEFINITION
+
+    static char const* kind_name(kind_type kind)
+    {
+        switch(kind)
+        {
+        case MULTIPLE_DEFINITION: return "multiple_definition";
+        case UNDEFINED_SYMBOL:    return "undefined_symbol";
+        case UNUSED_OBJECT:       return "unused_object";
+        default:                  return "unknown";
+        }
+    }
+};
+
+// diagnostics collected during one resolution, in the order they were found
+struct diagnostics
+{
+    diagnostics() : counts_()
+    {
+    }
+
+    void add(diagnostic d)
+    {
+        ++counts_[d.kind];
+        entries_.push_back(std::move(d));
+    }
+
+    auto begin() const
+    {
+        return entries_.begin();
+    }
+
+    auto end() const
+    {
+        return entries_.end();
+    }
+
+    size_t size() const
+    {
+        return entries_.size();
+    }
+
+    bool empty() const
+    {
+        return entries_.empty();
+    }
+
+    size_t count(diagnostic::kind_type kind) const
+    {
+        return counts_[kind];
+    }
+
+    // hands every diagnostic to sink, a callable taking diagnostic const&
+    template<class Sink>
+    Sink report(Sink sink) const
+    {
+        for(diagnostic const& d : entries_)
+            sink(d);
+        return sink;
+    }
+
+private:
+    vector<diagnostic> entries_;
+    size_t counts_[diagnostic::KINDS];
+};
+
+// the messages mabo always printed, one per line, without flushing
+struct text_sink
+{
+    explicit text_sink(std::ostream& os) : os(&os), names(0)
+    {
+    }
+
+    // symbols demangled through the context's cache
+    text_sink(std::ostream& os, demangle_cache& names) : os(&os), names(&names)
+    {
+    }
+
+    void operator()(diagnostic const& d) const
+    {
+        switch(d.kind)
+        {
+        case diagnostic::MULTIPLE_DEFINITION:
+            *os << "multiple definitions of symbol " << symbol(d)
+                << " defined in " << d.where
+                << ", previous definition in " << d.previous
+                << '\n';
+            break;
+        case diagnostic::UNDEFINED_SYMBOL:
+            *os << "undefined symbol " << symbol(d) << " in object " << d.where << '\n';
+            break;
+        default:
+            *os << "unused object: " << d.where << '\n';
+            break;
+        }
+    }
+
+private:
+    string symbol(diagnostic const& d) const
+    {
+        return names ? names->demangled(d.symbol) : d.symbol.to_string();
+    }
+
+    std::ostream* os;
+    demangle_cache* names;
+};
+
+// one JSON object per line
+struct json_sink
+{
+    explicit json_sink(std::ostream& os) : os(&os)
+    {
+    }
+
+    void operator()(diagnostic const& d) const
+    {
+        *os << "{\"kind\":\"" << diagnostic::kind_name(d.kind) << '"';
+        if(!d.symbol.empty())
+            field("symbol", d.symbol);
+        field("object", d.where);
+        if(!d.previous.empty())
+            field("previous", d.previous);
+        *os << "}\n";
+    }
+
+private:
+    void field(char const* key, string_view value) const
+    {
+        *os << ",\"" << key << "\":\"";
+        for(char c : value)
+        {
+            unsigned char u = static_cast<unsigned char>(c);
+            if(c == '"' || c == '\\')
+                *os << '\\' << c;
+            else if(u < 0x20)
+            {
+                char const* hex = "0123456789abcdef";
+                *os << "\\u00" << hex[u >> 4] << hex[u & 15];
+            }
+            else
+                *os << c;
+        }
+        *os << '"';
+    }
+
+    std::ostream* os;
+};
+
+// totals per kind, e.g. across several resolutions
+struct counting_sink
+{
+    counting_sink() : counts()
+    {
+    }
+
+    void operator()(diagnostic const& d)
+    {
+        ++counts[d.kind];
+    }
+
+    size_t counts[diagnostic::KINDS];
+};
+
+}
+
+#endif
@@ -0,0 +1,290 @@
+#ifndef MABO_GC_SECTIONS_HPP_INCLUDED
+#define MABO_GC_SECTIONS_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+#include <mabo/context.hpp>
+#include <mabo/dependency_graph.hpp>
+#include <mabo/parallel.hpp>
+
+#include <elf.h>
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace mabo
+{
+
+// what the linker keeps no matter what
+struct gc_options
+{
+    gc_options() : entries{"main", "_start"}, export_dynamic(false), whole_archive(false)
+    {
+    }
+
+    vector<string> entries;     // -e and -u, main for the startup code
+    bool export_dynamic;        // -shared or -E, every global definition is kept
+    bool whole_archive;
+};
+
+// allocated bytes of an object or archive --gc-sections would keep and drop
+struct gc_usage
+{
+    string name;                // archive members as archive(member)
+    uint64_t reachable;
+    uint64_t unreachable;
+};
+
+struct gc_report
+{
+    dependency_graph sections;  // the section graph that was walked
+    vector<bool> reachable;     // per node of sections
+    mabo::diagnostics diagnostics;
+
+    // linked objects in link order, shared libraries are left out, objects
+    // with nothing reachable are only pulled in by dead code
+    vector<gc_usage> objects;
+    vector<gc_usage> archives;  // their members summed up, in order of first use
+
+    uint64_t reachable_bytes;
+    uint64_t unreachable_bytes;
+};
+
+namespace detail
+{
+
+enum gc_flags
+{
+    GC_ROOT     = 1,    // kept like the init arrays
+    GC_OPAQUE   = 2,    // its references don't keep anything, .eh_frame; the
+                        // graph has edges from code to its LSDA instead
+    GC_IGNORED  = 4     // not counted, not allocated or in a shared library
+};
+
+// sections ld keeps without a reference, see KEEP() in its default script
+inline bool gc_keep(string_view name, uint64_t flags)
+{
+    static char const* const prefixes[] = {
+        ".init_array", ".fini_array", ".preinit_array", ".ctors", ".dtors", ".note", ".jcr"
+    };
+
+    uint64_t const retain = 0x200000;   // SHF_GNU_RETAIN
+    if((flags & retain) || name == ".init" || name == ".fini")
+        return true;
+    for(char const* prefix : prefixes)
+    {
+        string_view p = prefix;
+        if(name.substr(0, p.size()) == p && (name.size() == p.size() || name[p.size()] == '.'))
+            return true;
+    }
+    return false;
+}
+
+// marks everything reachable from the roots level by level, levels large
+// enough are split into chunks walked concurrently
+inline vector<bool> gc_walk(dependency_graph const& graph, vector<uint8_t> const& flags, size_t threads)
+{
+    typedef dependency_graph::node_id node_id;
+    size_t const n = graph.size();
+    size_t const chunk = 4096;
+
+    std::unique_ptr<std::atomic<bool>[]> marked(new std::atomic<bool>[n]);
+    vector<node_id> frontier;
+    for(node_id v = 0; v != n; ++v)
+    {
+        marked[v].store(flags[v] & GC_ROOT, std::memory_order_relaxed);
+        if(flags[v] & GC_ROOT)
+            frontier.push_back(v);
+    }
+
+    vector<vector<node_id>> next;
+    while(!frontier.empty())
+    {
+        size_t chunks = (frontier.size() + chunk - 1) / chunk;
+        next.resize(std::max(next.size(), chunks));
+
+        // only the thread winning the exchange queues a node
+        parallel_for(chunks, chunks > 1 ? threads : 1, [&](size_t c)
+        {
+            size_t last = std::min(frontier.size(), (c + 1) * chunk);
+            for(size_t i = c * chunk; i != last; ++i)
+            {
+                node_id v = frontier[i];
+                if(flags[v] & GC_OPAQUE)
+                    continue;
+                for(node_id w : graph.edges(v))
+                {
+                    if(!marked[w].load(std::memory_order_relaxed) && !marked[w].exchange(true, std::memory_order_relaxed))
+                        next[c].push_back(w);
+                }
+            }
+        });
+
+        frontier.clear();
+        for(size_t c = 0; c != chunks; ++c)
+        {
+            frontier.insert(frontier.end(), next[c].begin(), next[c].end());
+            next[c].clear();
+        }
+    }
+
+    vector<bool> result(n);
+    for(node_id v = 0; v != n; ++v)
+        result[v] = marked[v].load(std::memory_order_relaxed);
+    return result;
+}
+
+}
+
+// simulates ld --gc-sections on what the context links: sections are kept
+// when reachable through relocations from the entry points, the sections ld
+// always keeps, definitions shared libraries import and, with export_dynamic,
+// every global definition; kept code keeps its exception tables, references
+// to __start_X or __stop_X keep the sections named X
+inline gc_report gc_sections(context const& ctx, gc_options const& options = gc_options())
+{
+    typedef dependency_graph::node_id node_id;
+
+    gc_report report;
+    resolution resolved = ctx.dependencies(options.whole_archive, granularity::SECTION);
+    report.sections = std::move(resolved.dependencies);
+    report.diagnostics = std::move(resolved.diagnostics);
+
+    dependency_graph const& graph = report.sections;
+    vector<section_key> const& keys = resolved.sections;
+    size_t const threads = thread_count(ctx.threads());
+    size_t const n = graph.size();
+
+    // the sections of an object are consecutive nodes, objects are told
+    // apart by position since names can repeat
+    vector<node_id> first;
+    for(node_id v = 0; v != n; ++v)
+    {
+        if(!v || keys[v].object != keys[v - 1].object)
+            first.push_back(v);
+    }
+    first.push_back(node_id(n));
+    size_t const objects = first.size() - 1;
+
+    vector<uint8_t> flags(n, 0);
+    vector<uint64_t> sizes(n, 0);
+    vector<uint8_t> shared(objects, false);     // written concurrently, no vector<bool>
+    vector<vector<string_view>> imported(objects);
+
+    auto object_of = [&](size_t i)
+    {
+        return mabo::get<mabo::object>(graph.node(first[i]));
+    };
+
+    // by section::index(), names can repeat
+    auto section_nodes = [&](size_t i)
+    {
+        std::unordered_map<uint32_t, node_id> index;
+        for(node_id v = first[i]; v != first[i + 1]; ++v)
+            index.emplace(keys[v].index, v);
+        return index;
+    };
+
+    size_t const workers = thread_safe() ? threads : 1;
+    parallel_for(objects, workers, [&](size_t i)
+    {
+        mabo::object obj = object_of(i);
+        std::unordered_map<uint32_t, node_id> index = section_nodes(i);
+
+        // linked files take part in the resolution, not in the output
+        shared[i] = bool(obj.section(".dynamic"));
+        if(shared[i])
+        {
+            for(auto const& sym : obj.imports())
+                imported[i].push_back(sym.name());
+        }
+
+        for(node_id v = first[i]; v != first[i + 1]; ++v)
+            flags[v] = detail::GC_IGNORED;
+
+        for(auto const& sec : obj.sections())
+        {
+            auto it = index.find(sec.index());
+            if(it == index.end() || !(sec.flags() & SHF_ALLOC))
+                continue;
+
+            node_id v = it->second;
+            sizes[v] = sec.size();
+            if(shared[i])
+                continue;
+
+            flags[v] &= ~detail::GC_IGNORED;
+            if(detail::gc_keep(sec.name(), sec.flags()))
+                flags[v] |= detail::GC_ROOT;
+            if(sec.name() == ".eh_frame")
+                flags[v] |= detail::GC_OPAQUE | detail::GC_IGNORED;
+        }
+    });
+
+    std::unordered_set<string_view> wanted;
+    for(string const& entry : options.entries)
+        wanted.insert(entry);
+    for(vector<string_view> const& names : imported)
+        wanted.insert(names.begin(), names.end());
+
+    parallel_for(objects, workers, [&](size_t i)
+    {
+        if(shared[i])
+            return;
+
+        mabo::object obj = object_of(i);
+        std::unordered_map<uint32_t, node_id> index = section_nodes(i);
+        for(auto const& sym : obj.symbols())
+        {
+            if(!sym.global() || !(options.export_dynamic || wanted.count(sym.name())))
+                continue;
+            if(auto sec = sym.section())
+            {
+                auto it = index.find(sec->index());
+                if(it != index.end())
+                    flags[it->second] |= detail::GC_ROOT;
+            }
+        }
+    });
+
+    report.reachable = detail::gc_walk(graph, flags, threads);
+
+    report.reachable_bytes = 0;
+    report.unreachable_bytes = 0;
+    std::unordered_map<string, size_t> archives;
+    for(size_t i = 0; i != objects; ++i)
+    {
+        if(shared[i])
+            continue;
+
+        mabo::object obj = object_of(i);
+        optional<mabo::archive> ar = obj.archive();
+
+        gc_usage usage{ar ? ar->name().to_string() + "(" + obj.name().to_string() + ")" : obj.name().to_string(), 0, 0};
+        for(node_id v = first[i]; v != first[i + 1]; ++v)
+        {
+            if(flags[v] & detail::GC_IGNORED)
+                continue;
+            (report.reachable[v] ? usage.reachable : usage.unreachable) += sizes[v];
+        }
+        report.reachable_bytes += usage.reachable;
+        report.unreachable_bytes += usage.unreachable;
+
+        if(ar)
+        {
+            auto it = archives.emplace(ar->name().to_string(), report.archives.size());
+            if(it.second)
+                report.archives.push_back(gc_usage{ar->name().to_string(), 0, 0});
+            report.archives[it.first->second].reachable += usage.reachable;
+            report.archives[it.first->second].unreachable += usage.unreachable;
+        }
+        report.objects.push_back(std::move(usage));
+    }
+
+    return report;
+}
+
+}
+
+#endif
@@ -0,0 +1,297 @@
+#ifndef MABO_GREP_HPP_INCLUDED
+#define MABO_GREP_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+#include <mabo/parallel.hpp>
+#include <mabo/binary/elf.hpp>
+
+#include <elf.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cctype>
+#include <regex>
+
+namespace mabo
+{
+
+struct grep_options
+{
+    grep_options() : regex(false), defined(true), undefined(true), threads(0)
+    {
+    }
+
+    string pattern;
+    bool regex;         // ECMAScript, matched anywhere in the name like grep
+    bool defined;
+    bool undefined;
+    size_t threads;     // 0 for all cores
+};
+
+struct grep_match
+{
+    string file;
+    string member;      // empty unless file is an archive
+    string name;
+    uint64_t addr;
+    unsigned char bind; // STB_*
+    unsigned char type; // STT_*
+    bool undefined;
+    bool dynamic;       // from .dynsym, the file has no .symtab
+};
+
+struct grep_result
+{
+    vector<grep_match> matches;             // in file order, then symbol table order
+    vector<pair<string, string>> skipped;   // files that could not be read, and why
+};
+
+namespace detail { namespace grep
+{
+
+// the longest run of characters every match of an ECMAScript regex contains,
+// empty when there is none or the pattern is too involved to tell
+inline string required_literal(string_view re)
+{
+    if(re.find('|') != string_view::npos)
+        return {};
+
+    string best;
+    string run;
+    auto flush = [&]()
+    {
+        if(run.size() > best.size())
+            best = run;
+        run.clear();
+    };
+
+    int depth = 0;
+    for(size_t i = 0; i != re.size(); ++i)
+    {
+        char c = re[i];
+        if(c == '\\' && i + 1 != re.size())
+        {
+            char next = re[++i];
+            // \d, \w, \b and friends are classes or assertions, other letters
+            // and digits are \x41, \u0041, \cJ or backreferences whose
+            // operands aren't literal text
+            if(next && ::strchr("dDwWsSbB", next))
+                flush();
+            else if(std::isalnum(static_cast<unsigned char>(next)))
+                return {};
+            else if(!depth)
+                run += next;
+        }
+        else if(c == '[')
+        {
+            flush();
+            i = re.find(']', i + 2);
+            if(i == string_view::npos)
+                return {};
+        }
+        else if(c == '(')
+        {
+            flush();
+            ++depth;
+        }
+        else if(c == ')')
+            --depth;
+        // the character before is optional
+        else if(c == '*' || c == '?' || c == '{')
+        {
+            if(!run.empty())
+                run.pop_back();
+            flush();
+            if(c == '{' && (i = re.find('}', i)) == string_view::npos)
+                return {};
+        }
+        else if(c == '+' || c == '.' || c == '^' || c == '$')
+            flush();
+        else if(!depth)
+            run += c;
+    }
+    flush();
+    return best;
+}
+
+// where a needle occurs in a string table: per string containing it, where
+// the string starts and where the last occurrence in it is
+//
+// a name at offset o, which may start in the middle of a tail merged string,
+// contains the needle when it lies in such a span
+struct hits
+{
+    hits() : all(false)
+    {
+    }
+
+    bool contains(uint32_t offset) const
+    {
+        if(all)
+            return true;
+
+        auto it = std::upper_bound(spans.begin(), spans.end(), offset, [](uint32_t o, pair<uint32_t, uint32_t> const& span)
+        {
+            return o < span.first;
+        });
+        return it != spans.begin() && offset <= (it - 1)->second;
+    }
+
+    bool empty() const
+    {
+        return !all && spans.empty();
+    }
+
+    bool all;
+    vector<pair<uint32_t, uint32_t>> spans;
+};
+
+// glibc's memmem over the whole table, the symbols are only looked at after
+inline hits find_hits(char const* data, size_t size, string_view needle)
+{
+    hits h;
+    if(needle.empty())
+    {
+        h.all = true;
+        return h;
+    }
+
+    char const* end = data + size;
+    for(char const* p = data; p < end; ++p)
+    {
+        p = static_cast<char const*>(::memmem(p, end - p, needle.data(), needle.size()));
+        if(!p)
+            break;
+
+        uint32_t at = p - data;
+        char const* nul = static_cast<char const*>(::memrchr(data, '\0', at));
+        uint32_t start = nul ? nul - data + 1 : 0;
+        if(!h.spans.empty() && h.spans.back().first == start)
+            h.spans.back().second = at;
+        else
+            h.spans.push_back(pair<uint32_t, uint32_t>(start, at));
+    }
+    return h;
+}
+
+struct matcher
+{
+    explicit matcher(grep_options const& options) : options(options)
+    {
+        if(options.regex)
+        {
+            re = std::regex(options.pattern, std::regex::ECMAScript | std::regex::optimize);
+            literal = required_literal(options.pattern);
+        }
+        else
+            literal = options.pattern;
+    }
+
+    // the symbol table, or the dynamic one without it, like object::symbols()
+    void search(elf::image const& img, string const& file, string_view member, vector<grep_match>& out) const
+    {
+        elf::section_info const* sec = img.find_section(SHT_SYMTAB);
+        bool dynamic = !sec;
+        if(dynamic)
+            sec = img.find_section(SHT_DYNSYM);
+        if(!sec || sec->link >= img.sections.size())
+            return;
+
+        elf::section_info const& strtab = img.sections[sec->link];
+        hits h = find_hits(strtab.data, strtab.size, literal);
+        if(h.empty())
+            return;
+
+        elf::symbol_table table = img.table_of(*sec);
+        for(size_t i = 1; i < table.count; ++i)
+        {
+            // st_name leads both Elf32_Sym and Elf64_Sym, the rest is only
+            // decoded for names in a span
+            uint32_t name_offset = elf::read<uint32_t>(table.entries + i * table.entsize);
+            if(!name_offset || !h.contains(name_offset))
+                continue;
+
+            elf::symbol_entry e = img.entry(table, i);
+            if(e.type == STT_SECTION || e.type == STT_FILE)
+                continue;
+
+            bool undefined = e.shndx == SHN_UNDEF;
+            if(undefined ? !options.undefined : !options.defined)
+                continue;
+
+            string_view name = table.strings[name_offset];
+            if(options.regex && !std::regex_search(name.begin(), name.end(), re))
+                continue;
+
+            out.push_back(grep_match{file, member.to_string(), name.to_string(), e.value, e.bind, e.type, undefined, dynamic});
+        }
+    }
+
+    void search(string const& path, vector<grep_match>& out) const
+    {
+        auto mapped = std::make_shared<elf::mapped_file>(path);
+        if(elf::is_archive(mapped->data(), mapped->size()))
+        {
+            auto ar = std::make_shared<elf::archive_image>(mapped);
+            elf::archive_image::member m;
+            for(size_t offset = SARMAG; ar->read_member(offset, m); offset = m.next)
+            {
+                if(elf::archive_image::special(m.name) || !elf::is_native_elf(m.data, m.size))
+                    continue;
+                search(elf::image(mapped, ar, m.name, m.data, m.size), path, m.name, out);
+            }
+        }
+        else if(elf::is_elf(mapped->data(), mapped->size()))
+            search(elf::image(mapped, nullptr, mapped->name(), mapped->data(), mapped->size()), path, {}, out);
+        else
+            throw std::runtime_error("unsupported file type");
+    }
+
+    grep_options const& options;
+    std::regex re;
+    string literal;
+};
+
+} }
+
+// the symbols of ELF files, objects, archives and shared libraries, whose
+// names contain a pattern, without loading them as binaries
+//
+// files are mapped and searched on up to options.threads threads, each
+// string table is searched for the pattern, or the longest literal a regex
+// needs, as a whole first; only symbols whose names fall on a hit are
+// decoded, so files that don't mention the pattern cost one pass over
+// their string tables
+inline grep_result grep(vector<string> const& files, grep_options const& options)
+{
+    detail::grep::matcher m(options);
+
+    vector<vector<grep_match>> found(files.size());
+    vector<string> errors(files.size());
+    parallel_for(files.size(), options.threads, [&](size_t i)
+    {
+        try
+        {
+            m.search(files[i], found[i]);
+        }
+        catch(std::exception const& e)
+        {
+            found[i].clear();
+            errors[i] = e.what();
+        }
+    });
+
+    grep_result result;
+    for(size_t i = 0; i != files.size(); ++i)
+    {
+        if(!errors[i].empty())
+            result.skipped.push_back(pair<string, string>(files[i], errors[i]));
+        for(grep_match& match : found[i])
+            result.matches.push_back(std::move(match));
+    }
+    return result;
+}
+
+}
+
+#endif
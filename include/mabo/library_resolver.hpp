@@ -0,0 +1,587 @@
+#ifndef MABO_LIBRARY_RESOLVER_HPP_INCLUDED
+#define MABO_LIBRARY_RESOLVER_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+#include <mabo/binary/search_path.hpp>
+#include <mabo/stats.hpp>
+
+#include <dirent.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace mabo
+{
+
+namespace detail { namespace ldso
+{
+
+// /etc/ld.so.cache as written by glibc's ldconfig, see elf/dl-cache.h
+static const char old_magic[] = "ld.so-1.7.0";
+static const char new_magic[] = "glibc-ld.so.cache";
+static const char new_version[] = "1.1";
+
+struct old_header
+{
+    char magic[sizeof(old_magic) - 1];
+    uint32_t nlibs;
+};
+
+struct old_entry
+{
+    int32_t flags;
+    uint32_t key;
+    uint32_t value;
+};
+
+struct new_header
+{
+    char magic[sizeof(new_magic) - 1];
+    char version[sizeof(new_version) - 1];
+    uint32_t nlibs;
+    uint32_t len_strings;
+    uint8_t flags;
+    uint8_t padding[3];
+    uint32_t extension_offset;
+    uint32_t unused[3];
+};
+
+struct new_entry
+{
+    int32_t flags;
+    uint32_t key;
+    uint32_t value;
+    uint32_t osversion;
+    uint64_t hwcap;
+};
+
+struct extension_header
+{
+    uint32_t magic;
+    uint32_t count;
+};
+
+struct extension_section
+{
+    uint32_t tag;
+    uint32_t flags;
+    uint32_t offset;
+    uint32_t size;
+};
+
+static const uint32_t extension_magic = 0xeaa42174;
+static const uint32_t extension_tag_hwcaps = 1;
+static const uint64_t hwcap_extension = uint64_t(1) << 62;
+static const int32_t flag_elf_libc6 = 0x0003;
+static const int32_t flag_arm_libhf = 0x0900;
+static const int32_t flag_arm_libsf = 0x0b00;
+
+// the entry flags ld.so accepts for an object, 0 if we do not know the machine
+inline int32_t cache_flags(uint16_t machine, unsigned bits)
+{
+    switch(machine)
+    {
+    case EM_386:     return flag_elf_libc6;
+    case EM_SPARCV9: return flag_elf_libc6 | 0x0100;
+    case EM_IA_64:   return flag_elf_libc6 | 0x0200;
+    case EM_X86_64:  return flag_elf_libc6 | (bits == 64 ? 0x0300 : 0x0800);
+    case EM_S390:    return bits == 64 ? flag_elf_libc6 | 0x0400 : flag_elf_libc6;
+    case EM_PPC64:   return flag_elf_libc6 | 0x0500;
+    case EM_PPC:     return flag_elf_libc6;
+    case EM_ARM:     return flag_elf_libc6 | flag_arm_libhf;
+    case EM_AARCH64: return flag_elf_libc6 | 0x0a00;
+    case EM_RISCV:   return bits == 64 ? flag_elf_libc6 | 0x1000 : 0;
+    default:         return 0;
+    }
+}
+
+// whether ld.so for machine could use a cache entry with these flags; the
+// float ABI of 32-bit ARM is in e_flags, so both of its entries match
+inline bool cache_match(int32_t entry, uint16_t machine, unsigned bits)
+{
+    if(machine == EM_ARM)
+        return entry == (flag_elf_libc6 | flag_arm_libhf) || entry == (flag_elf_libc6 | flag_arm_libsf);
+
+    int32_t flags = cache_flags(machine, bits);
+    return flags ? entry == flags : (entry & 0xff) == flag_elf_libc6;
+}
+
+// glibc-hwcaps subdirectories the running cpu can use, best first
+inline vector<string> host_hwcaps(uint16_t machine, unsigned bits)
+{
+    vector<string> hwcaps;
+#if defined(__x86_64__) && defined(__GNUC__) && (__GNUC__ >= 12 || defined(__clang__))
+    if(machine == EM_X86_64 && bits == 64)
+    {
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("x86-64-v4"))
+            hwcaps.push_back("x86-64-v4");
+        if(__builtin_cpu_supports("x86-64-v3"))
+            hwcaps.push_back("x86-64-v3");
+        if(__builtin_cpu_supports("x86-64-v2"))
+            hwcaps.push_back("x86-64-v2");
+    }
+#else
+    (void)machine;
+    (void)bits;
+#endif
+    return hwcaps;
+}
+
+template<class T>
+bool read(char const* data, size_t size, size_t offset, T& t)
+{
+    if(offset > size || size - offset < sizeof(T))
+        return false;
+    std::memcpy(&t, data + offset, sizeof(T));
+    return true;
+}
+
+inline string_view str(char const* data, size_t size, uint64_t offset)
+{
+    if(offset >= size)
+        return {};
+    return string_view(data + offset, strnlen(data + offset, size - offset));
+}
+
+// ELF class and machine of a file, checked like ld.so does before using it
+inline bool compatible(string const& path, uint16_t machine, unsigned bits)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return false;
+    MABO_COUNT(LIBRARIES_PROBED, 1);
+
+    unsigned char ident[EI_NIDENT + 4];
+    ssize_t n = ::pread(fd, ident, sizeof(ident), 0);
+    ::close(fd);
+
+    if(n != ssize_t(sizeof(ident)) || std::memcmp(ident, ELFMAG, SELFMAG))
+        return false;
+    if(ident[EI_CLASS] != (bits == 64 ? ELFCLASS64 : ELFCLASS32))
+        return false;
+
+    uint16_t e_machine;
+    std::memcpy(&e_machine, ident + EI_NIDENT + 2, sizeof(e_machine));
+    return machine == EM_NONE || e_machine == machine;
+}
+
+} }
+
+// finds shared libraries the way ld.so does: the object's search paths with
+// glibc-hwcaps subdirectories first, then /etc/ld.so.cache, then the default
+// library directories; ld.so.conf only reaches ld.so through the cache
+//
+// the cache and the configuration are read once, directories are listed once
+// so a lookup never tries to open a file that is not there; lookups run
+// concurrently, only the memo tables are shared
+struct library_resolver
+{
+    library_resolver()
+    : library_resolver("/etc/ld.so.cache", "/etc/ld.so.conf")
+    {
+    }
+
+    library_resolver(string cache_file, string conf_file)
+    : cache_file(std::move(cache_file)), conf_file(std::move(conf_file))
+    {
+    }
+
+    library_resolver(library_resolver const&) = delete;
+    library_resolver& operator=(library_resolver const&) = delete;
+
+    // replaces the glibc-hwcaps subdirectories detected for the running cpu
+    void hwcaps(vector<string> names)
+    {
+        hwcaps_ = std::move(names);
+    }
+
+    // lib is a DT_NEEDED entry, paths the needing object's link_paths()
+    template<class Paths>
+    optional<string> find(string_view lib, Paths const& paths, uint16_t machine, unsigned bits) const
+    {
+        MABO_PHASE(FIND_LIBRARY);
+        if(lib.find('/') != string_view::npos)
+        {
+            string file = lib.to_string();
+            if(detail::ldso::compatible(file, machine, bits))
+                return file;
+            return {};
+        }
+
+        load();
+
+        vector<string> const& hwcaps = this->hwcaps(machine, bits);
+        auto search = [&](string_view dir) -> optional<string>
+        {
+            for(string const& hwcap : hwcaps)
+                if(optional<string> file = in_directory(string(dir.data(), dir.size()) + "/glibc-hwcaps/" + hwcap, lib, machine, bits))
+                    return file;
+            return in_directory(dir.to_string(), lib, machine, bits);
+        };
+
+        for(string_view dir : paths)
+            if(optional<string> file = search(dir))
+                return file;
+
+        if(optional<string> file = in_cache(lib, machine, bits))
+            return file;
+
+        for(string const& dir : default_dirs(machine, bits))
+            if(optional<string> file = search(dir))
+                return file;
+
+        return {};
+    }
+
+    // directories listed in ld.so.conf and its includes, in order
+    vector<string> const& conf_directories() const
+    {
+        load();
+        return conf_dirs;
+    }
+
+private:
+    struct cache_entry
+    {
+        int32_t flags;
+        size_t priority;    // index into hwcaps, npos for the plain entry
+        string path;
+    };
+
+    // the cache and conf_dirs are only written here
+    void load() const
+    {
+        std::call_once(loaded, [this]()
+        {
+            load_cache();
+
+            std::unordered_set<string> seen;
+            load_conf(conf_file, seen, 0);
+        });
+    }
+
+    void load_cache() const
+    {
+        using namespace detail::ldso;
+
+        int fd = ::open(cache_file.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0)
+            return;
+
+        struct stat st;
+        void* p = MAP_FAILED;
+        if(::fstat(fd, &st) == 0 && st.st_size > 0)
+            p = ::mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(p == MAP_FAILED)
+            return;
+
+        char const* data = static_cast<char const*>(p);
+        size_t size = st.st_size;
+
+        // the old format may be followed by the new one, which we prefer
+        size_t offset = 0;
+        old_header old;
+        if(read(data, size, 0, old) && !std::memcmp(old.magic, old_magic, sizeof(old.magic)))
+        {
+            offset = sizeof(old_header) + uint64_t(old.nlibs) * sizeof(old_entry);
+            offset = (offset + alignof(new_entry) - 1) & ~(alignof(new_entry) - 1);
+
+            new_header h;
+            if(!read(data, size, offset, h) || std::memcmp(h.magic, new_magic, sizeof(h.magic)))
+            {
+                load_old_cache(data, size, old.nlibs);
+                ::munmap(p, size);
+                return;
+            }
+        }
+
+        load_new_cache(data + offset, size - offset);
+        ::munmap(p, size);
+    }
+
+    void load_old_cache(char const* data, size_t size, uint32_t nlibs) const
+    {
+        using namespace detail::ldso;
+
+        size_t strings = sizeof(old_header) + uint64_t(nlibs) * sizeof(old_entry);
+        if(strings > size)
+            return;
+
+        for(uint32_t i = 0; i != nlibs; ++i)
+        {
+            old_entry e;
+            read(data, size, sizeof(old_header) + i * sizeof(old_entry), e);
+            add(str(data + strings, size - strings, e.key), e.flags, string_view::npos,
+                str(data + strings, size - strings, e.value));
+        }
+    }
+
+    // string offsets are relative to the new header
+    void load_new_cache(char const* data, size_t size) const
+    {
+        using namespace detail::ldso;
+
+        new_header h;
+        if(!read(data, size, 0, h) || std::memcmp(h.magic, new_magic, sizeof(h.magic))
+           || std::memcmp(h.version, new_version, sizeof(h.version)))
+            return;
+
+        // glibc-hwcaps subdirectory names, entries refer to them by index
+        vector<string_view> cache_hwcaps;
+        extension_header ext;
+        if(h.extension_offset && read(data, size, h.extension_offset, ext) && ext.magic == extension_magic)
+        {
+            for(uint32_t i = 0; i != ext.count; ++i)
+            {
+                extension_section sec;
+                if(!read(data, size, h.extension_offset + sizeof(ext) + uint64_t(i) * sizeof(sec), sec))
+                    break;
+                if(sec.tag != extension_tag_hwcaps)
+                    continue;
+
+                for(uint32_t j = 0; j + sizeof(uint32_t) <= sec.size; j += sizeof(uint32_t))
+                {
+                    uint32_t name;
+                    if(!read(data, size, uint64_t(sec.offset) + j, name))
+                        break;
+                    cache_hwcaps.push_back(str(data, size, name));
+                }
+            }
+        }
+
+        for(uint32_t i = 0; i != h.nlibs; ++i)
+        {
+            new_entry e;
+            if(!read(data, size, sizeof(new_header) + uint64_t(i) * sizeof(new_entry), e))
+                break;
+
+            size_t priority = string_view::npos;
+            if(e.hwcap & hwcap_extension)
+            {
+                uint32_t index = uint32_t(e.hwcap);
+                if(index >= cache_hwcaps.size())
+                    continue;
+                priority = hwcap_priority(cache_hwcaps[index]);
+                if(priority == string_view::npos)
+                    continue;
+            }
+            else if(e.hwcap)
+            {
+                // legacy hwcap subdirectories, ignored since glibc 2.37
+                continue;
+            }
+
+            add(str(data, size, e.key), e.flags, priority, str(data, size, e.value));
+        }
+    }
+
+    // cache entries can only be checked against the running cpu,
+    // so hwcaps entries match on name against any known hwcaps list
+    size_t hwcap_priority(string_view name) const
+    {
+        vector<string> const& hwcaps = this->hwcaps(EM_NONE, 0);
+        for(size_t i = 0; i != hwcaps.size(); ++i)
+            if(hwcaps[i] == name)
+                return i;
+        return string_view::npos;
+    }
+
+    void add(string_view key, int32_t flags, size_t priority, string_view path) const
+    {
+        if(key.empty() || path.empty())
+            return;
+        cache[key.to_string()].push_back(cache_entry{flags, priority, path.to_string()});
+    }
+
+    // the best entry for the machine whose file is still there and fits,
+    // the cache can be older than the files it lists
+    optional<string> in_cache(string_view lib, uint16_t machine, unsigned bits) const
+    {
+        auto it = cache.find(lib.to_string());
+        if(it == cache.end())
+            return {};
+
+        vector<cache_entry const*> candidates;
+        for(cache_entry const& e : it->second)
+            if(detail::ldso::cache_match(e.flags, machine, bits))
+                candidates.push_back(&e);
+
+        std::stable_sort(candidates.begin(), candidates.end(), [](cache_entry const* a, cache_entry const* b)
+        {
+            return a->priority < b->priority;
+        });
+
+        for(cache_entry const* e : candidates)
+            if(detail::ldso::compatible(e->path, machine, bits))
+                return e->path;
+        return {};
+    }
+
+    // ld.so.conf: one directory per line, "include" with globs, # comments
+    void load_conf(string const& file, std::unordered_set<string>& seen, int depth) const
+    {
+        if(depth > 16 || !seen.insert(file).second)
+            return;
+
+        std::ifstream ifs(file);
+        string line;
+        while(std::getline(ifs, line))
+        {
+            line = line.substr(0, line.find('#'));
+            size_t first = line.find_first_not_of(" \t\r");
+            if(first == string::npos)
+                continue;
+            line = line.substr(first, line.find_last_not_of(" \t\r") + 1 - first);
+
+            if(!line.compare(0, 8, "include ") || !line.compare(0, 8, "include\t"))
+            {
+                string pattern = line.substr(line.find_first_not_of(" \t", 8));
+                if(pattern[0] != '/')
+                {
+                    size_t slash = file.rfind('/');
+                    if(slash != string::npos)
+                        pattern = file.substr(0, slash + 1) + pattern;
+                }
+
+                glob_t g;
+                if(::glob(pattern.c_str(), 0, 0, &g) == 0)
+                {
+                    for(size_t i = 0; i != g.gl_pathc; ++i)
+                        load_conf(g.gl_pathv[i], seen, depth + 1);
+                }
+                ::globfree(&g);
+            }
+            else if(line[0] == '/')
+            {
+                // "dir=type" is an old libc5 notation
+                conf_dirs.push_back(line.substr(0, line.find('=')));
+            }
+        }
+    }
+
+    vector<string> const& hwcaps(uint16_t machine, unsigned bits) const
+    {
+        if(hwcaps_)
+            return *hwcaps_;
+
+        std::call_once(host_hwcaps_once, [this]()
+        {
+#if defined(__x86_64__)
+            host_hwcaps_ = detail::ldso::host_hwcaps(EM_X86_64, 64);
+#else
+            host_hwcaps_ = vector<string>();
+#endif
+        });
+
+#if defined(__x86_64__)
+        if(machine == EM_NONE || (machine == EM_X86_64 && bits == 64))
+            return *host_hwcaps_;
+#endif
+        (void)machine;
+        (void)bits;
+        return no_hwcaps;
+    }
+
+    // elements of unordered maps stay where they are, so what the memo
+    // functions return can be used without the lock
+    vector<string> const& default_dirs(uint16_t machine, unsigned bits) const
+    {
+        auto key = std::make_pair(machine, bits);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = defaults.find(key);
+            if(it != defaults.end())
+                return it->second;
+        }
+
+        vector<string> dirs;
+        string lib = detail::lib_dir(machine, bits);
+        dirs.push_back("/" + lib);
+        dirs.push_back("/usr/" + lib);
+        if(lib != "lib")
+        {
+            dirs.push_back("/lib");
+            dirs.push_back("/usr/lib");
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        return defaults.emplace(key, std::move(dirs)).first->second;
+    }
+
+    // a directory is listed without the lock, when two threads list the same
+    // one the first listing stored is kept
+    std::unordered_set<string> const& listing(string const& dir) const
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = listings.find(dir);
+            if(it != listings.end())
+                return it->second;
+        }
+
+        std::unordered_set<string> names;
+        if(DIR* d = ::opendir(dir.c_str()))
+        {
+            while(dirent* e = ::readdir(d))
+                names.insert(e->d_name);
+            ::closedir(d);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        return listings.emplace(dir, std::move(names)).first->second;
+    }
+
+    optional<string> in_directory(string const& dir, string_view lib, uint16_t machine, unsigned bits) const
+    {
+        if(!listing(dir).count(lib.to_string()))
+            return {};
+
+        // ld.so skips libraries built for another machine and keeps looking
+        string file = dir + "/";
+        file.append(lib.data(), lib.size());
+        if(!detail::ldso::compatible(file, machine, bits))
+            return {};
+        return file;
+    }
+
+    struct pair_hash
+    {
+        size_t operator()(std::pair<uint16_t, unsigned> const& p) const
+        {
+            return p.first * 131 + p.second;
+        }
+    };
+
+    string cache_file;
+    string conf_file;
+    optional<vector<string>> hwcaps_;
+
+    mutable std::once_flag loaded;
+    mutable std::unordered_map<string, vector<cache_entry>> cache;
+    mutable vector<string> conf_dirs;
+    mutable std::once_flag host_hwcaps_once;
+    mutable optional<vector<string>> host_hwcaps_;
+
+    // guards the memo tables
+    mutable std::mutex mutex;
+    mutable std::unordered_map<string, std::unordered_set<string>> listings;
+    mutable std::unordered_map<std::pair<uint16_t, unsigned>, vector<string>, pair_hash> defaults;
+    vector<string> const no_hwcaps;
+};
+
+}
+
+#endif
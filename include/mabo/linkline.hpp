@@ -2,38 +2,133 @@
 #define MABO_LINKLINE_HPP_INCLUDED
 
 #include <mabo/config.hpp>
-#include <mabo/binary.hpp>
+#include <mabo/dependency_graph.hpp>
+
+#include <fstream>
+#include <functional>
+#include <ostream>
+#include <queue>
+#include <stdexcept>
 
 namespace mabo
 {
     namespace detail
     {
-        template<class Dependencies, class Visited>
-        void linkline(string& buffer, Dependencies&& dependencies, Visited&& visited, binary const& dependee)
+        // hands the arguments of the link line to emit one by one
+        //
+        // users come before what they use, components of the graph are ordered
+        // topologically keeping the input order where there is a choice, and
+        // only components with more than one archive in a cycle are grouped:
+        // objects are linked in unconditionally and a single archive is
+        // rescanned by the linker anyway
+        template<class Emit>
+        void linkline(dependency_graph const& graph, Emit&& emit)
         {
-            if(!visited.insert(dependee.name().to_string()).second)
-                return;
+            typedef dependency_graph::node_id node_id;
+
+            graph_components scc = strong_components(graph);
+            size_t const n = graph.size();
+
+            // members of each component in node order
+            vector<uint32_t> first(scc.count + 1, 0);
+            for(node_id v = 0; v != n; ++v)
+                ++first[scc.component[v] + 1];
+            for(uint32_t c = 0; c != scc.count; ++c)
+                first[c + 1] += first[c];
+
+            vector<node_id> members(n);
+            vector<uint32_t> fill(first.begin(), first.end() - 1);
+            for(node_id v = 0; v != n; ++v)
+                members[fill[scc.component[v]]++] = v;
+
+            vector<uint32_t> incoming(scc.count, 0);
+            for(node_id v = 0; v != n; ++v)
+                for(node_id w : graph.edges(v))
+                    if(scc.component[v] != scc.component[w])
+                        ++incoming[scc.component[w]];
+
+            // kahn on the condensed graph, by lowest member
+            typedef pair<node_id, uint32_t> ready_type;
+            std::priority_queue<ready_type, vector<ready_type>, std::greater<ready_type>> ready;
+            for(uint32_t c = 0; c != scc.count; ++c)
+                if(!incoming[c])
+                    ready.emplace(members[first[c]], c);
+
+            vector<node_id> archives;
+            while(!ready.empty())
+            {
+                uint32_t c = ready.top().second;
+                ready.pop();
+
+                archives.clear();
+                for(uint32_t i = first[c]; i != first[c + 1]; ++i)
+                {
+                    node_id v = members[i];
+                    if(graph.archive(v))
+                        archives.push_back(v);
+                    else
+                        emit(graph.name(v));
+                }
+
+                if(archives.size() > 1)
+                    emit("--start-group");
+                for(node_id v : archives)
+                    emit(graph.name(v));
+                if(archives.size() > 1)
+                    emit("--end-group");
+
+                for(uint32_t i = first[c]; i != first[c + 1]; ++i)
+                    for(node_id w : graph.edges(members[i]))
+                        if(scc.component[w] != c && !--incoming[scc.component[w]])
+                            ready.emplace(members[first[scc.component[w]]], scc.component[w]);
+            }
+        }
 
-            buffer += dependee.name().to_string() + " ";
-            for(binary const& dependent : dependencies[dependee])
+        // quoted the way gcc and ld read @file arguments
+        inline void response_file_argument(std::ostream& os, string_view arg)
+        {
+            for(char c : arg)
             {
-                linkline(buffer, dependencies, visited, dependent);
+                if(c == ' ' || c == '\t' || c == '\n' || c == '\\' || c == '\'' || c == '"')
+                    os << '\\';
+                os << c;
             }
+            os << '\n';
         }
     }
 
-    template<class Dependencies>
-    string linkline(Dependencies&& dependencies)
+    // streams the link line out, each argument followed by a space
+    inline void linkline(std::ostream& os, dependency_graph const& dependencies)
+    {
+        detail::linkline(dependencies, [&](string_view arg)
+        {
+            os << arg << ' ';
+        });
+    }
+
+    inline string linkline(dependency_graph const& dependencies)
     {
         string buffer;
-        std::unordered_set<string> visited;
+        detail::linkline(dependencies, [&](string_view arg)
+        {
+            buffer.append(arg.data(), arg.size());
+            buffer += ' ';
+        });
+        return buffer;
+    }
 
-        for(auto&& dependency : dependencies)
+    // writes the link line to a file to pass as @file, one argument per line
+    inline void linkline_response_file(string const& file, dependency_graph const& dependencies)
+    {
+        std::ofstream os(file);
+        detail::linkline(dependencies, [&](string_view arg)
         {
-            detail::linkline(buffer, dependencies, visited, dependency.first);
-        }
+            detail::response_file_argument(os, arg);
+        });
 
-        return buffer;
+        os.close();
+        if(!os)
+            throw std::runtime_error("cannot write response file " + file);
     }
 }
 
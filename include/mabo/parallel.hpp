@@ -0,0 +1,74 @@
+#ifndef MABO_PARALLEL_HPP_INCLUDED
+#define MABO_PARALLEL_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace mabo
+{
+
+// 0 means one thread per core
+inline size_t thread_count(size_t threads)
+{
+    if(threads)
+        return threads;
+
+    size_t n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+// calls f(i) for every i in [0, n) on up to `threads` threads
+// indices are handed out one at a time so uneven items still balance,
+// the first exception thrown stops the loop and is rethrown in the caller
+template<class F>
+void parallel_for(size_t n, size_t threads, F&& f)
+{
+    threads = std::min(thread_count(threads), n);
+    if(threads <= 1)
+    {
+        for(size_t i = 0; i != n; ++i)
+            f(i);
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto work = [&]()
+    {
+        try
+        {
+            for(size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < n; )
+                f(i);
+        }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if(!error)
+                error = std::current_exception();
+            next.store(n, std::memory_order_relaxed);
+        }
+    };
+
+    vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for(size_t t = 1; t != threads; ++t)
+        pool.emplace_back(work);
+
+    work();
+    for(std::thread& t : pool)
+        t.join();
+
+    if(error)
+        std::rethrow_exception(error);
+}
+
+}
+
+#endif
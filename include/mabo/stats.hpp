@@ -0,0 +1,223 @@
+#ifndef MABO_STATS_HPP_INCLUDED
+#define MABO_STATS_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+
+namespace mabo { namespace stats
+{
+
+// process wide counters and phase timers, only fed with MABO_WITH_STATS
+//
+// without it MABO_COUNT and MABO_PHASE expand to nothing and everything
+// here reads zero
+
+enum counter
+{
+    FILES_OPENED,
+    BYTES_READ,         // mapped, or read into memory by libbfd
+    SYMBOLS_LOADED,
+    HASH_LOOKUPS,       // through .gnu.hash or .hash
+    LIBRARIES_PROBED,   // candidate files opened to check for a DT_NEEDED
+    COUNTERS
+};
+
+enum phase
+{
+    OPEN,
+    CHECK_FORMAT,
+    LOAD_SYMBOLS,
+    LOAD_DYNAMIC,
+    FIND_LIBRARY,
+    RESOLVE,
+    EXTRACT,            // symbols interned for the resolver, part of RESOLVE
+    PHASES
+};
+
+inline char const* name(counter c)
+{
+    static char const* const names[] = {"files_opened", "bytes_read", "symbols_loaded", "hash_lookups", "libraries_probed"};
+    return c < COUNTERS ? names[c] : "unknown";
+}
+
+inline char const* name(phase p)
+{
+    static char const* const names[] = {"open", "check_format", "load_symbols", "load_dynamic", "find_library", "resolve", "extract"};
+    return p < PHASES ? names[p] : "unknown";
+}
+
+inline constexpr bool enabled()
+{
+#ifdef MABO_WITH_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+namespace detail
+{
+
+// one completed phase on one thread, times in ns since the registry started
+struct event
+{
+    phase what;
+    uint32_t thread;
+    uint64_t start;
+    uint64_t duration;
+};
+
+struct registry
+{
+    registry() : tracing(false), start(std::chrono::steady_clock::now())
+    {
+        for(std::atomic<uint64_t>& c : counters)
+            c.store(0, std::memory_order_relaxed);
+        for(size_t p = 0; p != PHASES; ++p)
+        {
+            time[p].store(0, std::memory_order_relaxed);
+            calls[p].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::atomic<uint64_t> counters[COUNTERS];
+    std::atomic<uint64_t> time[PHASES];
+    std::atomic<uint64_t> calls[PHASES];
+
+    std::atomic<bool> tracing;
+    std::mutex events_mutex;
+    vector<event> events;
+    std::chrono::steady_clock::time_point const start;
+};
+
+inline registry& global()
+{
+    static registry r;
+    return r;
+}
+
+// small and dense, for the trace viewer
+inline uint32_t thread_id()
+{
+    static std::atomic<uint32_t> next(0);
+    static thread_local uint32_t id = next.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+}
+
+inline void count(counter c, uint64_t n = 1)
+{
+    detail::global().counters[c].fetch_add(n, std::memory_order_relaxed);
+}
+
+inline uint64_t value(counter c)
+{
+    return detail::global().counters[c].load(std::memory_order_relaxed);
+}
+
+// total time in ns and number of times a phase ran, nested phases are included
+inline uint64_t time(phase p)
+{
+    return detail::global().time[p].load(std::memory_order_relaxed);
+}
+
+inline uint64_t calls(phase p)
+{
+    return detail::global().calls[p].load(std::memory_order_relaxed);
+}
+
+// times the scope it lives in, recorded as a trace event while tracing
+struct timer
+{
+    explicit timer(phase p) : p(p), start(detail::global().now())
+    {
+    }
+
+    timer(timer const&) = delete;
+    timer& operator=(timer const&) = delete;
+
+    ~timer()
+    {
+        detail::registry& r = detail::global();
+        uint64_t duration = r.now() - start;
+        r.time[p].fetch_add(duration, std::memory_order_relaxed);
+        r.calls[p].fetch_add(1, std::memory_order_relaxed);
+
+        if(r.tracing.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(r.events_mutex);
+            r.events.push_back(detail::event{p, detail::thread_id(), start, duration});
+        }
+    }
+
+private:
+    phase p;
+    uint64_t start;
+};
+
+// keep every phase from now on for write_trace()
+inline void trace(bool on = true)
+{
+    detail::global().tracing.store(on, std::memory_order_relaxed);
+}
+
+// one line per counter and phase
+inline void print(std::ostream& os)
+{
+    for(int c = 0; c != COUNTERS; ++c)
+        os << name(counter(c)) << " " << value(counter(c)) << "\n";
+    for(int p = 0; p != PHASES; ++p)
+        os << name(phase(p)) << " " << calls(phase(p)) << " calls " << time(phase(p)) / 1000000.0 << " ms\n";
+}
+
+// Chrome trace event format, for chrome://tracing and Perfetto: a complete
+// event per recorded phase and the counters at the end
+inline void write_trace(std::ostream& os)
+{
+    detail::registry& r = detail::global();
+    std::lock_guard<std::mutex> lock(r.events_mutex);
+
+    auto us = [](uint64_t ns)
+    {
+        return double(ns) / 1000;
+    };
+
+    os << "{\"traceEvents\":[";
+    char const* separator = "\n";
+    for(detail::event const& e : r.events)
+    {
+        os << separator << "{\"name\":\"" << name(e.what) << "\",\"cat\":\"mabo\",\"ph\":\"X\",\"ts\":" << us(e.start)
+           << ",\"dur\":" << us(e.duration) << ",\"pid\":1,\"tid\":" << e.thread << "}";
+        separator = ",\n";
+    }
+
+    os << separator << "{\"name\":\"counters\",\"ph\":\"C\",\"ts\":" << us(r.now()) << ",\"pid\":1,\"tid\":0,\"args\":{";
+    for(int c = 0; c != COUNTERS; ++c)
+        os << (c ? "," : "") << "\"" << name(counter(c)) << "\":" << value(counter(c));
+    os << "}}\n]}\n";
+}
+
+} }
+
+#ifdef MABO_WITH_STATS
+#define MABO_STATS_CONCAT2(a, b) a##b
+#define MABO_STATS_CONCAT(a, b) MABO_STATS_CONCAT2(a, b)
+#define MABO_COUNT(c, n) ::mabo::stats::count(::mabo::stats::c, n)
+#define MABO_PHASE(p) ::mabo::stats::timer MABO_STATS_CONCAT(mabo_phase_, __LINE__)(::mabo::stats::p)
+#else
+#define MABO_COUNT(c, n) ((void)0)
+#define MABO_PHASE(p) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef MABO_STRING_POOL_HPP_INCLUDED
+#define MABO_STRING_POOL_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace mabo
+{
+
+// interns strings into an arena, each distinct string gets a dense 32-bit id
+// and has its hash computed exactly once; views returned stay valid for the
+// lifetime of the pool and are NUL-terminated
+//
+// interning is thread-safe: the table is split in shards with one lock each,
+// and ids are looked up without locking
+struct string_pool
+{
+    typedef uint32_t id_type;
+    static constexpr id_type npos = id_type(-1);
+
+    string_pool() : count(0)
+    {
+        for(std::atomic<entry*>& block : blocks)
+            block.store(nullptr, std::memory_order_relaxed);
+    }
+
+    string_pool(string_pool const&) = delete;
+    string_pool& operator=(string_pool const&) = delete;
+
+    ~string_pool()
+    {
+        for(std::atomic<entry*>& block : blocks)
+            delete[] block.load(std::memory_order_relaxed);
+    }
+
+    id_type intern(string_view s)
+    {
+        return intern(s, hash_of(s));
+    }
+
+    // hash must be hash_of(s), lets callers hash outside the lock
+    id_type intern(string_view s, size_t hash)
+    {
+        shard& sh = shards[hash & (shard_count - 1)];
+        std::lock_guard<std::mutex> lock(sh.mutex);
+
+        size_t i = probe(sh, s, hash);
+        if(sh.slots[i].id != npos)
+            return sh.slots[i].id;
+
+        if((sh.size + 1) * 2 > sh.slots.size())
+        {
+            grow(sh);
+            i = probe(sh, s, hash);
+        }
+
+        id_type id = count.fetch_add(1, std::memory_order_relaxed);
+        if(id == npos)
+            throw std::length_error("string_pool is full");
+
+        entry& e = at(id, true);
+        e.str = store(sh, s);
+        e.hash = hash;
+
+        sh.slots[i] = slot{uint32_t(hash >> shard_bits), id};
+        ++sh.size;
+        return id;
+    }
+
+    id_type find(string_view s) const
+    {
+        size_t hash = hash_of(s);
+        shard const& sh = shards[hash & (shard_count - 1)];
+        std::lock_guard<std::mutex> lock(sh.mutex);
+
+        return sh.slots[probe(sh, s, hash)].id;
+    }
+
+    string_view operator[](id_type id) const
+    {
+        return const_cast<string_pool*>(this)->at(id, false).str;
+    }
+
+    size_t hash(id_type id) const
+    {
+        return const_cast<string_pool*>(this)->at(id, false).hash;
+    }
+
+    // ids are always in [0, size())
+    size_t size() const
+    {
+        return count.load(std::memory_order_acquire);
+    }
+
+    static size_t hash_of(string_view s)
+    {
+        return std::hash<string_view>()(s);
+    }
+
+private:
+    static const size_t shard_bits = 6;
+    static const size_t shard_count = size_t(1) << shard_bits;
+    // block k holds 2^(first_block_bits + k) entries, so what is allocated
+    // stays within twice the number of ids and 25 blocks cover all of them
+    static const size_t first_block_bits = 8;
+    static const size_t max_blocks = 33 - first_block_bits;
+    // a shard's chunks double from the first size up to the last
+    static const size_t first_chunk_size = 1024;
+    static const size_t chunk_size = 64 * 1024;
+
+    struct entry
+    {
+        string_view str;
+        size_t hash;
+    };
+
+    struct slot
+    {
+        uint32_t hash;
+        id_type id;
+    };
+
+    struct shard
+    {
+        shard() : chunk(0), chunk_left(0), size(0), slots(16, slot{0, npos})
+        {
+        }
+
+        mutable std::mutex mutex;
+        vector<std::unique_ptr<char[]>> chunks;
+        char* chunk;
+        size_t chunk_left;
+        size_t size;
+        vector<slot> slots;
+    };
+
+    // linear probing, returns the slot holding s or the empty slot where it belongs
+    size_t probe(shard const& sh, string_view s, size_t hash) const
+    {
+        size_t mask = sh.slots.size() - 1;
+        uint32_t h = uint32_t(hash >> shard_bits);
+        for(size_t i = h & mask; ; i = (i + 1) & mask)
+        {
+            slot const& sl = sh.slots[i];
+            if(sl.id == npos)
+                return i;
+            if(sl.hash == h && (*this)[sl.id] == s)
+                return i;
+        }
+    }
+
+    void grow(shard& sh)
+    {
+        vector<slot> old(sh.slots.size() * 2, slot{0, npos});
+        old.swap(sh.slots);
+
+        size_t mask = sh.slots.size() - 1;
+        for(slot const& sl : old)
+        {
+            if(sl.id == npos)
+                continue;
+
+            size_t i = sl.hash & mask;
+            while(sh.slots[i].id != npos)
+                i = (i + 1) & mask;
+            sh.slots[i] = sl;
+        }
+    }
+
+    // entries live in blocks that never move once published, allocated as the
+    // ids reach them
+    entry& at(id_type id, bool create)
+    {
+        uint64_t v = uint64_t(id) + (uint64_t(1) << first_block_bits);
+        unsigned top = 63 - __builtin_clzll(v);
+        std::atomic<entry*>& block = blocks[top - first_block_bits];
+        entry* p = block.load(std::memory_order_acquire);
+        if(!p && create)
+        {
+            std::lock_guard<std::mutex> lock(blocks_mutex);
+            p = block.load(std::memory_order_relaxed);
+            if(!p)
+            {
+                p = new entry[size_t(1) << top];
+                block.store(p, std::memory_order_release);
+            }
+        }
+        return p[v - (uint64_t(1) << top)];
+    }
+
+    static string_view store(shard& sh, string_view s)
+    {
+        size_t n = s.size() + 1;
+        char* p;
+        if(n > chunk_size / 4)
+        {
+            // large strings get their own block so chunks stay dense
+            sh.chunks.emplace_back(new char[n]);
+            p = sh.chunks.back().get();
+        }
+        else
+        {
+            if(n > sh.chunk_left)
+            {
+                size_t size = first_chunk_size << std::min<size_t>(sh.chunks.size(), 6);
+                while(size < n)
+                    size *= 2;
+                sh.chunks.emplace_back(new char[size]);
+                sh.chunk = sh.chunks.back().get();
+                sh.chunk_left = size;
+            }
+            p = sh.chunk;
+            sh.chunk += n;
+            sh.chunk_left -= n;
+        }
+
+        std::memcpy(p, s.data(), s.size());
+        p[s.size()] = '\0';
+        return string_view(p, s.size());
+    }
+
+    std::atomic<id_type> count;
+    shard shards[shard_count];
+    std::atomic<entry*> blocks[max_blocks];
+    std::mutex blocks_mutex;
+};
+
+}
+
+#endif
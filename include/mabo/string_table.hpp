@@ -0,0 +1,46 @@
+#ifndef MABO_STRING_TABLE_HPP_INCLUDED
+#define MABO_STRING_TABLE_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace mabo { namespace detail
+{
+
+// appends nul terminated strings to a table its owner keeps, each one once,
+// and returns their 32 bit offsets; what names the owner in the error
+struct string_table_writer
+{
+    explicit string_table_writer(char const* what) : what(what)
+    {
+    }
+
+    uint32_t add(vector<char>& strings, string_view s)
+    {
+        key.assign(s.data(), s.size());
+        auto it = offsets.find(key);
+        if(it != offsets.end())
+            return it->second;
+
+        if(strings.size() + s.size() >= uint32_t(-1))
+            throw std::length_error(string("string table too large for ") + what);
+
+        uint32_t offset = strings.size();
+        strings.insert(strings.end(), s.begin(), s.end());
+        strings.push_back('\0');
+        offsets.emplace(key, offset);
+        return offset;
+    }
+
+private:
+    char const* what;
+    std::unordered_map<string, uint32_t> offsets;
+    string key;
+};
+
+} }
+
+#endif
@@ -0,0 +1,625 @@
+#ifndef MABO_SYMBOL_CACHE_HPP_INCLUDED
+#define MABO_SYMBOL_CACHE_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+#include <mabo/binary.hpp>
+#include <mabo/binary/armap.hpp>
+
+#include <range/v3/view.hpp>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+
+namespace mabo
+{
+
+namespace detail { namespace cache
+{
+
+// on-disk layout, native byte order:
+// header, object_entry[objects], ref[refs], armap_ref[armap], char strings[strings]
+// the strings start with the canonical path of the cached file
+struct header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t objects;
+    uint32_t refs;
+    uint32_t strings;
+    uint32_t path;
+    uint32_t flags;
+    uint32_t armap;
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    uint64_t mtime;
+};
+
+// string in the strings block, symbols keep their weak flag in the top bit of size
+struct ref
+{
+    uint32_t offset;
+    uint32_t size;
+};
+
+static const char magic[8] = {'M', 'A', 'B', 'O', 'I', 'D', 'X', '\0'};
+static const uint32_t version = 3;
+static const uint32_t weak_bit = uint32_t(1) << 31;
+
+// header::flags
+static const uint32_t archive_flag = 1;
+
+// RPATH and RUNPATH are what the object names itself, LD_LIBRARY_PATH is
+// only added when a record is looked at
+enum list
+{
+    SYMBOLS,
+    IMPORTS,
+    LIBS,
+    RPATH,
+    RUNPATH,
+    LISTS
+};
+
+// a symbol of the archive's index and the object defining it
+struct armap_ref
+{
+    ref name;
+    uint32_t object;
+};
+
+struct object_entry
+{
+    ref name;
+    uint16_t machine;
+    uint16_t bits;
+    uint32_t first[LISTS];
+    uint32_t count[LISTS];
+};
+
+struct symbol
+{
+    string_view name() const
+    {
+        return name_;
+    }
+
+    bool weak() const
+    {
+        return weak_;
+    }
+
+    string_view name_;
+    bool weak_;
+};
+
+struct to_symbol
+{
+    symbol operator()(ref r) const
+    {
+        return symbol{string_view(strings + r.offset, r.size & ~weak_bit), (r.size & weak_bit) != 0};
+    }
+
+    char const* strings;
+};
+
+struct to_string
+{
+    string_view operator()(ref r) const
+    {
+        return string_view(strings + r.offset, r.size);
+    }
+
+    char const* strings;
+};
+
+
+inline bool identity(string const& path, header& h)
+{
+    struct stat st;
+    if(::stat(path.c_str(), &st) < 0)
+        return false;
+
+    h.dev = st.st_dev;
+    h.ino = st.st_ino;
+    h.size = st.st_size;
+    h.mtime = uint64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+inline string canonical(string_view path)
+{
+    string s = path.to_string();
+    if(char* p = ::realpath(s.c_str(), 0))
+    {
+        s = p;
+        std::free(p);
+    }
+    return s;
+}
+
+// fnv-1a, has to stay the same across builds since it names the cache files
+inline uint64_t fnv1a(string_view s)
+{
+    uint64_t h = 14695981039346656037ull;
+    for(char c : s)
+    {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// serializes the objects of one binary
+struct writer
+{
+    explicit writer(string_view file)
+    : path(str(file))
+    {
+    }
+
+    template<class Range>
+    void add(list l, object_entry& o, Range&& rng)
+    {
+        o.first[l] = refs.size();
+        for(auto&& s : rng)
+            refs.push_back(str(s));
+        o.count[l] = refs.size() - o.first[l];
+    }
+
+    template<class Range>
+    void add_symbols(list l, object_entry& o, Range&& rng)
+    {
+        o.first[l] = refs.size();
+        for(mabo::symbol const& sym : rng)
+        {
+            ref r = str(sym.name());
+            if(sym.weak())
+                r.size |= weak_bit;
+            refs.push_back(r);
+        }
+        o.count[l] = refs.size() - o.first[l];
+    }
+
+    void add(mabo::object const& obj)
+    {
+        object_entry o;
+        o.name = str(obj.name());
+        o.machine = obj.machine();
+        o.bits = obj.bits();
+        add_symbols(SYMBOLS, o, obj.symbols());
+        add_symbols(IMPORTS, o, obj.imports());
+        add(LIBS, o, obj.libs());
+
+        object_paths own = own_paths(obj.dynamic(), obj.name(), obj.machine(), obj.bits());
+        add(RPATH, o, own.rpath);
+        add(RUNPATH, o, own.runpath);
+        entries.push_back(o);
+    }
+
+    void add_armap(string_view name, uint32_t object)
+    {
+        armap.push_back(armap_ref{str(name), object});
+    }
+
+    vector<char> finish(header h) const
+    {
+        std::memcpy(h.magic, magic, sizeof(magic));
+        h.version = version;
+        h.objects = entries.size();
+        h.refs = refs.size();
+        h.strings = strings.size();
+        h.path = path.size;
+        h.armap = armap.size();
+
+        vector<char> data(sizeof(header));
+        std::memcpy(data.data(), &h, sizeof(h));
+        append(data, entries.data(), entries.size() * sizeof(object_entry));
+        append(data, refs.data(), refs.size() * sizeof(ref));
+        append(data, armap.data(), armap.size() * sizeof(armap_ref));
+        append(data, strings.data(), strings.size());
+        return data;
+    }
+
+private:
+    ref str(string_view s)
+    {
+        if(s.size() >= weak_bit)
+            throw std::length_error("string too long for symbol cache");
+
+        auto it = offsets.find(s.to_string());
+        if(it == offsets.end())
+        {
+            it = offsets.emplace(s.to_string(), strings.size()).first;
+            strings.insert(strings.end(), s.begin(), s.end());
+            strings.push_back('\0');
+        }
+        return ref{it->second, uint32_t(s.size())};
+    }
+
+    static void append(vector<char>& data, void const* p, size_t n)
+    {
+        char const* c = static_cast<char const*>(p);
+        data.insert(data.end(), c, c + n);
+    }
+
+    vector<object_entry> entries;
+    vector<ref> refs;
+    vector<armap_ref> armap;
+    vector<char> strings;
+    std::unordered_map<string, uint32_t> offsets;
+    ref path;
+};
+
+} }
+
+// opt-in on-disk cache of what the resolver needs from each input file:
+// defined symbols, imports, DT_NEEDED entries, the search paths objects
+// name themselves, the machine they were built for and an archive's index
+//
+// there is one cache file per input file, named after its canonical path
+// and only used while the input's device, inode, size and mtime match
+struct symbol_cache
+{
+    typedef detail::cache::symbol symbol;
+
+    struct entry;
+
+    // one object of a cached file, views into its entry
+    struct record
+    {
+        string_view name() const
+        {
+            return str(o->name);
+        }
+
+        uint16_t machine() const
+        {
+            return o->machine;
+        }
+
+        unsigned bits() const
+        {
+            return o->bits;
+        }
+
+        auto symbols() const
+        {
+            return refs(detail::cache::SYMBOLS) | ranges::view::transform(detail::cache::to_symbol{e->strings});
+        }
+
+        auto imports() const
+        {
+            return refs(detail::cache::IMPORTS) | ranges::view::transform(detail::cache::to_symbol{e->strings});
+        }
+
+        auto libs() const
+        {
+            return refs(detail::cache::LIBS) | ranges::view::transform(detail::cache::to_string{e->strings});
+        }
+
+        // like object::link_paths(), with LD_LIBRARY_PATH as it is now
+        vector<string> link_paths() const
+        {
+            detail::dst_expander expand(e->path(), machine(), bits());
+            detail::cache::to_string str{e->strings};
+            return detail::search_paths(refs(detail::cache::RPATH) | ranges::view::transform(str), refs(detail::cache::RUNPATH) | ranges::view::transform(str), expand);
+        }
+
+    private:
+        friend struct entry;
+
+        record(entry const* e, detail::cache::object_entry const* o)
+        : e(e), o(o)
+        {
+        }
+
+        string_view str(detail::cache::ref r) const
+        {
+            return string_view(e->strings + r.offset, r.size & ~detail::cache::weak_bit);
+        }
+
+        ranges::iterator_range<detail::cache::ref const*> refs(detail::cache::list l) const
+        {
+            return ranges::make_iterator_range(e->refs + o->first[l], e->refs + o->first[l] + o->count[l]);
+        }
+
+        entry const* e;
+        detail::cache::object_entry const* o;
+    };
+
+    // all cached objects of one input file
+    struct entry
+    {
+        entry(entry const&) = delete;
+        entry& operator=(entry const&) = delete;
+
+        ~entry()
+        {
+            if(mapped)
+                ::munmap(const_cast<char*>(data), size);
+        }
+
+        // the cached file, canonical
+        string_view path() const
+        {
+            return string_view(strings, stamp().path);
+        }
+
+        bool archive() const
+        {
+            return stamp().flags & detail::cache::archive_flag;
+        }
+
+        // the archive's index with the records' positions as members
+        vector<armap_entry> const& armap() const
+        {
+            return armap_;
+        }
+
+        record at(size_t i) const
+        {
+            return record(this, objects + i);
+        }
+
+        auto records() const
+        {
+            entry const* self = this;
+            return ranges::make_iterator_range(objects, objects + count)
+                 | ranges::view::transform([self](detail::cache::object_entry const& o)
+            {
+                return record(self, &o);
+            });
+        }
+
+        // members are looked up by name, the first of a repeated name; the
+        // index and at() go by position
+        optional<record> find(string_view name) const
+        {
+            auto it = index.find(name);
+            if(it == index.end())
+                return {};
+            return record(this, objects + it->second);
+        }
+
+    private:
+        friend struct symbol_cache;
+        friend struct record;
+
+        entry()
+        : data(0), size(0), mapped(false), objects(0), count(0), refs(0), nrefs(0), strings(0)
+        {
+        }
+
+        // checks the layout so a truncated or foreign file is never trusted
+        bool parse()
+        {
+            using namespace detail::cache;
+
+            if(size < sizeof(header))
+                return false;
+
+            header h;
+            std::memcpy(&h, data, sizeof(h));
+            if(std::memcmp(h.magic, magic, sizeof(magic)) || h.version != version)
+                return false;
+
+            uint64_t expected = sizeof(header)
+                              + uint64_t(h.objects) * sizeof(object_entry)
+                              + uint64_t(h.refs) * sizeof(ref)
+                              + uint64_t(h.armap) * sizeof(armap_ref)
+                              + h.strings;
+            if(expected != size)
+                return false;
+
+            objects = reinterpret_cast<object_entry const*>(data + sizeof(header));
+            count = h.objects;
+            refs = reinterpret_cast<ref const*>(objects + count);
+            nrefs = h.refs;
+            armap_ref const* armap = reinterpret_cast<armap_ref const*>(refs + nrefs);
+            strings = reinterpret_cast<char const*>(armap + h.armap);
+
+            auto valid = [&](ref r)
+            {
+                uint64_t n = r.size & ~weak_bit;
+                return r.offset + n < h.strings && strings[r.offset + n] == '\0';
+            };
+
+            if(!valid(ref{0, h.path}))
+                return false;
+
+            for(size_t i = 0; i != nrefs; ++i)
+                if(!valid(refs[i]))
+                    return false;
+
+            for(size_t i = 0; i != count; ++i)
+            {
+                if(!valid(objects[i].name))
+                    return false;
+                index.emplace(string_view(strings + objects[i].name.offset, objects[i].name.size), i);
+                for(size_t l = 0; l != LISTS; ++l)
+                    if(uint64_t(objects[i].first[l]) + objects[i].count[l] > nrefs)
+                        return false;
+            }
+
+            armap_.reserve(h.armap);
+            for(size_t i = 0; i != h.armap; ++i)
+            {
+                if(!valid(armap[i].name) || armap[i].object >= count)
+                    return false;
+                armap_.push_back(armap_entry{string_view(strings + armap[i].name.offset, armap[i].name.size), armap[i].object});
+            }
+
+            return true;
+        }
+
+        detail::cache::header stamp() const
+        {
+            detail::cache::header h;
+            std::memcpy(&h, data, sizeof(h));
+            return h;
+        }
+
+        char const* data;
+        size_t size;
+        bool mapped;
+        vector<char> buffer;
+
+        detail::cache::object_entry const* objects;
+        size_t count;
+        detail::cache::ref const* refs;
+        size_t nrefs;
+        char const* strings;
+        std::unordered_map<string_view, size_t> index;
+        vector<armap_entry> armap_;
+    };
+
+    explicit symbol_cache(string_view dir)
+    : dir(dir.to_string())
+    {
+    }
+
+    string_view directory() const
+    {
+        return dir;
+    }
+
+    // the cached entry of a file, or null when there is none or it is stale
+    std::shared_ptr<entry const> find(string_view path) const
+    {
+        string file = canonical_file(path);
+        detail::cache::header current;
+        if(!detail::cache::identity(file, current))
+            return {};
+
+        int fd = ::open(cache_path(file).c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0)
+            return {};
+
+        struct stat st;
+        if(::fstat(fd, &st) < 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return {};
+        }
+
+        void* p = ::mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(p == MAP_FAILED)
+            return {};
+
+        std::shared_ptr<entry> e(new entry);
+        e->data = static_cast<char const*>(p);
+        e->size = st.st_size;
+        e->mapped = true;
+
+        if(!e->parse())
+            return {};
+
+        detail::cache::header h = e->stamp();
+        if(h.dev != current.dev || h.ino != current.ino || h.size != current.size || h.mtime != current.mtime)
+            return {};
+
+        // guards against hash collisions between paths
+        if(string_view(e->strings, h.path) != file)
+            return {};
+
+        return e;
+    }
+
+    // extracts everything the cache holds from bin and writes it out,
+    // failing to write only means the next run is cold again
+    std::shared_ptr<entry const> store(binary const& bin) const
+    {
+        string file = canonical_file(bin.name());
+        detail::cache::header h;
+        std::memset(&h, 0, sizeof(h));
+        if(!detail::cache::identity(file, h))
+            return {};
+
+        detail::cache::writer w(file);
+        vector<size_t> offsets;
+        for(mabo::object const& obj : bin.objects())
+        {
+            offsets.push_back(obj.offset());
+            w.add(obj);
+        }
+
+        if(mabo::holds_alternative<mabo::archive>(bin))
+        {
+            h.flags |= detail::cache::archive_flag;
+
+            // index entries point at records by position, member names can repeat
+            mabo::archive const& ar = mabo::get<mabo::archive>(bin);
+            auto const& armap = ar.armap();
+            vector<optional<uint32_t>> objects = detail::armap_objects(ar, offsets);
+            for(size_t i = 0; i != armap.size(); ++i)
+                if(objects[i])
+                    w.add_armap(armap[i].name, *objects[i]);
+        }
+
+        std::shared_ptr<entry> e(new entry);
+        e->buffer = w.finish(h);
+        e->data = e->buffer.data();
+        e->size = e->buffer.size();
+        if(!e->parse())
+            return {};
+
+        write(cache_path(file), e->buffer);
+        return e;
+    }
+
+private:
+    static string canonical_file(string_view path)
+    {
+        return detail::cache::canonical(path);
+    }
+
+    string cache_path(string const& file) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "/%016llx.idx", static_cast<unsigned long long>(detail::cache::fnv1a(file)));
+        return dir + name;
+    }
+
+    void write(string const& path, vector<char> const& data) const
+    {
+        ::mkdir(dir.c_str(), 0777);
+
+        // written aside and renamed so readers never see a partial file
+        string tmp = path + "." + std::to_string(::getpid()) + ".tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if(fd < 0)
+            return;
+
+        char const* p = data.data();
+        size_t left = data.size();
+        while(left)
+        {
+            ssize_t n = ::write(fd, p, left);
+            if(n <= 0)
+                break;
+            p += n;
+            left -= n;
+        }
+
+        if(::close(fd) < 0 || left || ::rename(tmp.c_str(), path.c_str()) < 0)
+            ::unlink(tmp.c_str());
+    }
+
+    string dir;
+};
+
+}
+
+#endif
@@ -0,0 +1,363 @@
+#ifndef MABO_SYMBOL_COLUMNS_HPP_INCLUDED
+#define MABO_SYMBOL_COLUMNS_HPP_INCLUDED
+
+#include <mabo/config.hpp>
+#include <mabo/binary.hpp>
+#include <mabo/parallel.hpp>
+#include <mabo/string_table.hpp>
+
+#include <elf.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace mabo
+{
+
+namespace detail
+{
+
+// symbols per filter pass, the masks live on the stack
+static const size_t column_block = 4096;
+
+#ifdef __SSE2__
+
+// all ones in the low two dwords where a > b as unsigned 64 bit lanes; SSE2
+// only compares signed dwords, so the sign bits are flipped and the high
+// halves decide unless they are equal
+inline __m128i greater_u64(__m128i a, __m128i b)
+{
+    __m128i const sign = _mm_set1_epi32(int(0x80000000u));
+    a = _mm_xor_si128(a, sign);
+    b = _mm_xor_si128(b, sign);
+    __m128i gt = _mm_cmpgt_epi32(a, b);
+    __m128i eq = _mm_cmpeq_epi32(a, b);
+    __m128i greater = _mm_or_si128(gt, _mm_and_si128(eq, _mm_slli_epi64(gt, 32)));
+    return _mm_shuffle_epi32(greater, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+#endif
+
+}
+
+inline uint16_t bind_bit(unsigned bind)
+{
+    return uint16_t(1) << bind;
+}
+
+inline uint16_t type_bit(unsigned type)
+{
+    return uint16_t(1) << type;
+}
+
+// what symbol_columns::select() matches, every field has to match and the
+// defaults match everything
+//
+// global defined functions in .text larger than n bytes are
+// binds = bind_bit(STB_GLOBAL), types = type_bit(STT_FUNC), section = ".text",
+// min_size = n + 1, imports = false
+struct symbol_filter
+{
+    symbol_filter()
+    : binds(0xffff), types(0xffff), min_size(0), max_size(uint64_t(-1)), defined(true), imports(true)
+    {
+    }
+
+    uint16_t binds;         // bind_bit()s
+    uint16_t types;         // type_bit()s
+    string section;         // empty for any
+    uint64_t min_size;
+    uint64_t max_size;
+    bool defined;
+    bool imports;
+};
+
+// the symbols, local symbols and imports of many objects in columns, one
+// entry per symbol in each, so a filter is a few linear passes over small
+// arrays, eight symbols per step with SSE2, instead of a walk through the
+// backend's structs
+struct symbol_columns
+{
+    static const uint32_t npos = uint32_t(-1);
+
+    enum flag
+    {
+        DEFINED = 1,
+        IMPORT  = 2
+    };
+
+    // appends a mabo::object, a compact_object or anything with their
+    // accessors, returns the object's index
+    template<class Object>
+    uint32_t add(Object const& obj)
+    {
+        uint32_t index = object_names.size();
+        object_names.push_back(str(obj.name()));
+
+        for(auto const& sym : obj.symbols())
+        {
+            auto sec = sym.section();
+            push(sym, sec ? section_id(sec->name()) : npos, DEFINED, index);
+        }
+        for(auto const& sym : obj.local_symbols())
+        {
+            auto sec = sym.section();
+            push(sym, sec ? section_id(sec->name()) : npos, DEFINED, index);
+        }
+        for(auto const& sym : obj.imports())
+            push(sym, npos, IMPORT, index);
+        return index;
+    }
+
+    size_t size() const
+    {
+        return addrs.size();
+    }
+
+    string_view name(size_t i) const
+    {
+        return strings.data() + names[i];
+    }
+
+    // empty for undefined, absolute and common symbols
+    string_view section(size_t i) const
+    {
+        return sections[i] == npos ? string_view() : strings.data() + section_names[sections[i]];
+    }
+
+    string_view object(size_t i) const
+    {
+        return strings.data() + object_names[objects[i]];
+    }
+
+    unsigned bind(size_t i) const
+    {
+        return unsigned(__builtin_ctz(binds[i]));
+    }
+
+    unsigned type(size_t i) const
+    {
+        return unsigned(__builtin_ctz(types[i]));
+    }
+
+    // indices of the matching symbols in order, blocks are scanned on up to
+    // `threads` threads
+    vector<uint32_t> select(symbol_filter const& f, size_t threads = 1) const
+    {
+        vector<uint32_t> result;
+        scanner s(*this, f);
+        if(!s.possible)
+            return result;
+
+        size_t blocks = (size() + detail::column_block - 1) / detail::column_block;
+        if(thread_count(threads) == 1 || blocks < 2)
+        {
+            uint8_t mask[detail::column_block];
+            for(size_t b = 0; b != blocks; ++b)
+                s.append(b * detail::column_block, std::min(detail::column_block, size() - b * detail::column_block), mask, result);
+            return result;
+        }
+
+        vector<vector<uint32_t>> parts(blocks);
+        parallel_for(blocks, threads, [&](size_t b)
+        {
+            uint8_t mask[detail::column_block];
+            s.append(b * detail::column_block, std::min(detail::column_block, size() - b * detail::column_block), mask, parts[b]);
+        });
+
+        for(vector<uint32_t> const& part : parts)
+            result.insert(result.end(), part.begin(), part.end());
+        return result;
+    }
+
+    size_t count(symbol_filter const& f) const
+    {
+        scanner s(*this, f);
+        if(!s.possible)
+            return 0;
+
+        size_t n = 0;
+        uint8_t mask[detail::column_block];
+        for(size_t first = 0; first < size(); first += detail::column_block)
+        {
+            size_t len = std::min(detail::column_block, size() - first);
+            s.scan(first, len, mask);
+            for(size_t i = 0; i != len; ++i)
+                n += mask[i];
+        }
+        return n;
+    }
+
+    // the columns
+    vector<uint64_t> addrs;
+    vector<uint64_t> sizes;
+    vector<uint32_t> names;         // offsets into strings
+    vector<uint32_t> sections;      // into section_names, npos for none
+    vector<uint32_t> objects;       // into object_names
+    vector<uint16_t> binds;         // bind_bit()
+    vector<uint16_t> types;         // type_bit()
+    vector<uint8_t> flags;
+
+    // nul terminated strings, each stored once
+    vector<char> strings;
+    vector<uint32_t> section_names;
+    vector<uint32_t> object_names;
+
+private:
+    // the filter's passes over one block, each one branch free
+    struct scanner
+    {
+        scanner(symbol_columns const& t, symbol_filter const& f)
+        : t(t), f(f), section(npos), possible(true)
+        {
+            if(!f.section.empty())
+            {
+                auto it = t.section_ids.find(f.section);
+                if(it == t.section_ids.end())
+                    possible = false;
+                else
+                    section = it->second;
+            }
+
+            want = (f.defined ? DEFINED : 0) | (f.imports ? IMPORT : 0);
+            possible = possible && want && f.binds && f.types && f.min_size <= f.max_size;
+        }
+
+        void scan(size_t first, size_t n, uint8_t* mask) const
+        {
+            uint16_t const* binds = t.binds.data() + first;
+            uint16_t const* types = t.types.data() + first;
+            uint8_t const* flags = t.flags.data() + first;
+            uint16_t fbinds = f.binds;
+            uint16_t ftypes = f.types;
+            uint8_t fwant = want;
+            size_t i = 0;
+#ifdef __SSE2__
+            // lanes that miss a bit set are all ones, packed to bytes and
+            // inverted into the 0 or 1 the scalar loop stores
+            __m128i const zero = _mm_setzero_si128();
+            __m128i const one = _mm_set1_epi8(1);
+            __m128i const vbinds = _mm_set1_epi16(short(fbinds));
+            __m128i const vtypes = _mm_set1_epi16(short(ftypes));
+            __m128i const vwant = _mm_set1_epi16(short(fwant));
+            for(; i + 8 <= n; i += 8)
+            {
+                __m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(binds + i));
+                __m128i ty = _mm_loadu_si128(reinterpret_cast<__m128i const*>(types + i));
+                __m128i fl = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(flags + i)), zero);
+                __m128i miss = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(_mm_and_si128(b, vbinds), zero),
+                                                         _mm_cmpeq_epi16(_mm_and_si128(ty, vtypes), zero)),
+                                            _mm_cmpeq_epi16(_mm_and_si128(fl, vwant), zero));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(mask + i), _mm_andnot_si128(_mm_packs_epi16(miss, miss), one));
+            }
+#endif
+            for(; i != n; ++i)
+                mask[i] = ((binds[i] & fbinds) != 0) & ((types[i] & ftypes) != 0) & ((flags[i] & fwant) != 0);
+
+            if(f.min_size || f.max_size != uint64_t(-1))
+            {
+                // one unsigned compare, sizes below min_size wrap around
+                uint64_t const* sizes = t.sizes.data() + first;
+                uint64_t lo = f.min_size;
+                uint64_t range = f.max_size - f.min_size;
+                i = 0;
+#ifdef __SSE2__
+                __m128i const vlo = _mm_set1_epi64x(int64_t(lo));
+                __m128i const vrange = _mm_set1_epi64x(int64_t(range));
+                auto above = [&](size_t j)
+                {
+                    __m128i s = _mm_loadu_si128(reinterpret_cast<__m128i const*>(sizes + j));
+                    return detail::greater_u64(_mm_sub_epi64(s, vlo), vrange);
+                };
+                for(; i + 8 <= n; i += 8)
+                {
+                    __m128i lo4 = _mm_unpacklo_epi64(above(i), above(i + 2));
+                    __m128i hi4 = _mm_unpacklo_epi64(above(i + 4), above(i + 6));
+                    __m128i out = _mm_packs_epi16(_mm_packs_epi32(lo4, hi4), zero);
+                    __m128i m = _mm_loadl_epi64(reinterpret_cast<__m128i const*>(mask + i));
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(mask + i), _mm_andnot_si128(out, m));
+                }
+#endif
+                for(; i != n; ++i)
+                    mask[i] &= sizes[i] - lo <= range;
+            }
+
+            if(section != npos)
+            {
+                uint32_t const* sections = t.sections.data() + first;
+                uint32_t id = section;
+                i = 0;
+#ifdef __SSE2__
+                __m128i const vid = _mm_set1_epi32(int(id));
+                for(; i + 8 <= n; i += 8)
+                {
+                    __m128i lo4 = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(sections + i)), vid);
+                    __m128i hi4 = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(sections + i + 4)), vid);
+                    __m128i in = _mm_packs_epi16(_mm_packs_epi32(lo4, hi4), zero);
+                    __m128i m = _mm_loadl_epi64(reinterpret_cast<__m128i const*>(mask + i));
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(mask + i), _mm_and_si128(in, m));
+                }
+#endif
+                for(; i != n; ++i)
+                    mask[i] &= sections[i] == id;
+            }
+        }
+
+        void append(size_t first, size_t n, uint8_t* mask, vector<uint32_t>& out) const
+        {
+            scan(first, n, mask);
+            for(size_t i = 0; i != n; ++i)
+                if(mask[i])
+                    out.push_back(first + i);
+        }
+
+        symbol_columns const& t;
+        symbol_filter const& f;
+        uint32_t section;
+        uint8_t want;
+        bool possible;
+    };
+
+    template<class Symbol>
+    void push(Symbol const& sym, uint32_t section, uint8_t flag, uint32_t object)
+    {
+        addrs.push_back(sym.addr());
+        sizes.push_back(sym.size());
+        names.push_back(str(sym.name()));
+        sections.push_back(section);
+        objects.push_back(object);
+        binds.push_back(bind_bit(!sym.global() ? STB_LOCAL : sym.weak() ? STB_WEAK : STB_GLOBAL));
+        types.push_back(type_bit(sym.type() & 0xf));
+        flags.push_back(flag);
+    }
+
+    uint32_t str(string_view s)
+    {
+        return writer.add(strings, s);
+    }
+
+    uint32_t section_id(string_view name)
+    {
+        key.assign(name.data(), name.size());
+        auto it = section_ids.find(key);
+        if(it == section_ids.end())
+        {
+            uint32_t offset = str(name);
+            it = section_ids.emplace(key, uint32_t(section_names.size())).first;
+            section_names.push_back(offset);
+        }
+        return it->second;
+    }
+
+    detail::string_table_writer writer{"symbol columns"};
+    std::unordered_map<string, uint32_t> section_ids;
+    string key;
+};
+
+}
+
+#endif
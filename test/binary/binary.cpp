@@ -3,6 +3,8 @@
 #include "test.hpp"
 #include "chdir.hpp"
 
+#include <algorithm>
+
 using namespace testing;
 
 TEST(binary, Test1Object)
@@ -105,6 +107,58 @@ TEST(binary, LibTestsArchive)
     EXPECT_THAT(test2.libs(), ElementsAre());
 }
 
+TEST(binary, LibTestsArchiveParallel)
+{
+    mabo::binary bin("libtests.a");
+    mabo::archive& archive = mabo::get<mabo::archive>(bin);
+
+    std::vector<mabo::object> objects = archive.objects(4);
+
+    EXPECT_THAT(
+        objects | ranges::view::transform(&mabo::object::name),
+        ContainerEq(archive.objects() | ranges::view::transform(&mabo::object::name))
+    );
+
+    EXPECT_THAT(
+        objects[0].symbols() | ranges::view::transform(&mabo::symbol::name),
+        ElementsAre("g1")
+    );
+
+    EXPECT_THAT(
+        objects[1].imports() | ranges::view::transform(&mabo::symbol::name),
+        ElementsAre("f2")
+    );
+
+    EXPECT_THAT(
+        bin.objects(4) | ranges::view::transform(&mabo::object::name),
+        ElementsAre("test1.cpp.o", "test2.cpp.o")
+    );
+}
+
+TEST(binary, LibTestsArchiveIndex)
+{
+    mabo::binary bin("libtests.a");
+    mabo::archive& archive = mabo::get<mabo::archive>(bin);
+
+    auto armap = archive.armap();
+
+    EXPECT_THAT(
+        armap | ranges::view::transform(&mabo::armap_entry::name),
+        UnorderedElementsAre("g1", "g2")
+    );
+
+    for(size_t i = 0; i != armap.size(); ++i)
+    {
+        mabo::optional<mabo::object> member = archive.armap_member(i);
+        ASSERT_THAT(bool(member), Eq(true));
+        EXPECT_THAT(member->name(), Eq(armap[i].name == "g1" ? "test1.cpp.o" : "test2.cpp.o"));
+        EXPECT_THAT(
+            member->symbols() | ranges::view::transform(&mabo::symbol::name),
+            ElementsAre(armap[i].name)
+        );
+    }
+}
+
 TEST(binary, LibTestsShared)
 {
     mabo::binary bin("libtests_shared.so");
@@ -241,3 +295,128 @@ TEST(binary, TestExecutableShared2)
         AllOf(Contains(current_dir), Contains(current_dir + "/2"))
     );
 }
+
+TEST(binary, SectionData)
+{
+    mabo::binary bin("test_exe_shared");
+    mabo::object& obj = mabo::get<mabo::object>(bin);
+
+    // the contents live as long as the section
+    mabo::section sec = *obj.section(".dynstr");
+    auto dynstr = sec.data<char>();
+    ASSERT_THAT(dynstr.size(), Gt(0u));
+
+    // contiguous, so plain pointer arithmetic works
+    char const* first = &*dynstr.begin();
+    EXPECT_THAT(dynstr.end() - dynstr.begin(), Eq(std::ptrdiff_t(dynstr.size())));
+    EXPECT_THAT(mabo::string_view(first, dynstr.size()).find("libtest1_shared.so"), Ne(mabo::string_view::npos));
+
+    // loaded once, later views share the same bytes
+    EXPECT_THAT(&*sec.data<char>().begin(), Eq(first));
+}
+
+TEST(binary, Dynamic)
+{
+    mabo::binary bin("libtests_shared.so");
+    mabo::object& obj = mabo::get<mabo::object>(bin);
+
+    mabo::dynamic_table const& dynamic = obj.dynamic();
+    EXPECT_THAT(dynamic.soname(), Eq("libtests_shared.so"));
+    EXPECT_THAT(bool(dynamic.value(DT_STRTAB)), Eq(true));
+    EXPECT_THAT(dynamic.entries().size(), Gt(dynamic.needed().size()));
+
+    // the same table is handed out every time
+    EXPECT_THAT(&obj.dynamic(), Eq(&dynamic));
+    EXPECT_THAT(obj.libs(), ContainerEq(dynamic.needed()));
+
+    mabo::binary exe("test_exe_shared");
+    EXPECT_THAT(mabo::get<mabo::object>(exe).libs(), Contains("libtest1_shared.so"));
+}
+
+TEST(binary, FindSymbol)
+{
+    // hash table lookup
+    mabo::binary lib("libtests_shared.so");
+    mabo::object& shared = mabo::get<mabo::object>(lib);
+    ASSERT_THAT(bool(shared.find_symbol("g1")), Eq(true));
+    EXPECT_THAT(shared.find_symbol("g1")->name().to_string(), StartsWith("g1"));
+    EXPECT_THAT(bool(shared.find_symbol("g2")), Eq(true));
+    EXPECT_THAT(bool(shared.find_symbol("f1")), Eq(false));
+    EXPECT_THAT(bool(shared.find_symbol("g")), Eq(false));
+
+    // index over symbols()
+    mabo::binary bin("test1.cpp.o");
+    mabo::object& obj = mabo::get<mabo::object>(bin);
+    ASSERT_THAT(bool(obj.find_symbol("g1")), Eq(true));
+    EXPECT_THAT(obj.find_symbol("g1")->name(), Eq("g1"));
+    EXPECT_THAT(bool(obj.find_symbol("f1")), Eq(false));
+}
+
+TEST(binary, Disassemble)
+{
+    mabo::binary bin("test1.cpp.o");
+    mabo::object& obj = mabo::get<mabo::object>(bin);
+
+    mabo::disassembly code = obj.disassemble();
+    ASSERT_THAT(code.functions.size(), Ge(1u));
+    ASSERT_THAT(code.instructions.size(), Gt(2u));
+    EXPECT_THAT(code.functions[0].address, Eq(obj.find_symbol("g1")->addr()));
+    EXPECT_THAT(mabo::mnemonic(code.instructions.back().mnemonic).to_string(), StartsWith("ret"));
+    EXPECT_THAT(
+        std::count_if(code.instructions.begin(), code.instructions.end(), [](mabo::instruction const& insn) { return insn.flags & mabo::instruction::CALL; }),
+        Eq(1)
+    );
+
+    // the same records whichever thread decoded them
+    mabo::disassembly parallel = obj.disassemble(4);
+    ASSERT_THAT(parallel.instructions.size(), Eq(code.instructions.size()));
+    for(size_t i = 0; i != code.instructions.size(); ++i)
+    {
+        EXPECT_THAT(parallel.instructions[i].address, Eq(code.instructions[i].address));
+        EXPECT_THAT(parallel.instructions[i].mnemonic, Eq(code.instructions[i].mnemonic));
+    }
+}
+
+TEST(binary, DisassembleFunctionSections)
+{
+    mabo::binary bin("main_sections.o");
+    mabo::object& obj = mabo::get<mabo::object>(bin);
+
+    mabo::disassembly code = obj.disassemble(2);
+    std::vector<std::string> sections;
+    for(mabo::code_range const& f : code.functions)
+        sections.push_back(f.section.to_string());
+    EXPECT_THAT(sections, AllOf(Contains(".text.f1"), Contains(".text.main")));
+
+    EXPECT_THAT(
+        std::count_if(code.instructions.begin(), code.instructions.end(), [](mabo::instruction const& insn) { return insn.flags & mabo::instruction::CALL; }),
+        Eq(1)
+    );
+}
+
+TEST(binary, Relocations)
+{
+    mabo::binary bin("test1.cpp.o");
+    mabo::object& obj = mabo::get<mabo::object>(bin);
+
+    std::vector<mabo::relocation> relocations = obj.relocations();
+    auto call = std::find_if(relocations.begin(), relocations.end(), [](mabo::relocation const& rel) { return rel.symbol == "f1"; });
+    ASSERT_THAT(call != relocations.end(), Eq(true));
+    EXPECT_THAT(call->section, Eq(".text"));
+    EXPECT_THAT(call->local, Eq(false));
+    EXPECT_THAT(call->target.empty(), Eq(true));
+
+    // the unwind info refers to the code through the section symbol
+    auto unwind = std::find_if(relocations.begin(), relocations.end(), [](mabo::relocation const& rel) { return rel.section == ".eh_frame"; });
+    ASSERT_THAT(unwind != relocations.end(), Eq(true));
+    EXPECT_THAT(unwind->symbol, Eq(".text"));
+    EXPECT_THAT(unwind->target, Eq(".text"));
+    EXPECT_THAT(unwind->local, Eq(true));
+
+    // per section, and the same on several threads
+    EXPECT_THAT(obj.relocations(*obj.section(".text")).size(), Eq(1u));
+    EXPECT_THAT(obj.relocations(4).size(), Eq(relocations.size()));
+
+    EXPECT_THAT(obj.find_symbol("g1")->section()->name(), Eq(".text"));
+    EXPECT_THAT(bool((*obj.imports().begin()).section()), Eq(false));
+}
@@ -0,0 +1,56 @@
+#include <mabo/bloat.hpp>
+
+#include "test.hpp"
+#include "chdir.hpp"
+
+#include <algorithm>
+
+using namespace testing;
+
+TEST(bloat, Archive)
+{
+    mabo::bloat bloat(1);
+    bloat.add(mabo::binary("libtests.a"));
+    mabo::bloat_report report = bloat.report();
+
+    EXPECT_THAT(report.count, Eq(2u));
+    EXPECT_THAT(report.size, Gt(0u));
+
+    ASSERT_THAT(report.symbols.size(), Eq(1u));
+    EXPECT_THAT(report.symbols[0].name, AnyOf(Eq("g1"), Eq("g2")));
+    ASSERT_THAT(report.objects.size(), Eq(1u));
+    EXPECT_THAT(report.objects[0].name, StartsWith("libtests.a(test"));
+
+    // .text is all functions, .eh_frame has no symbols
+    mabo::bloat all(10);
+    all.add(mabo::binary("libtests.a"));
+    report = all.report();
+
+    auto text = std::find_if(report.sections.begin(), report.sections.end(), [](mabo::bloat_entry const& e) { return e.name == ".text"; });
+    ASSERT_THAT(text != report.sections.end(), Eq(true));
+    EXPECT_THAT(text->size, Eq(report.size));
+    EXPECT_THAT(text->count, Eq(2u));
+    EXPECT_THAT(report.unattributed, Contains(Field(&mabo::bloat_entry::name, Eq(".eh_frame"))));
+    EXPECT_THAT(report.unattributed, Not(Contains(Field(&mabo::bloat_entry::name, Eq(".text")))));
+    EXPECT_THAT(report.section_size, Gt(report.size));
+}
+
+TEST(bloat, Statics)
+{
+    mabo::bloat bloat(10);
+    bloat.add(mabo::binary("gc.o"));
+    mabo::bloat_report report = bloat.report();
+
+    // thrower is static, kept is a static in gc_keep
+    EXPECT_THAT(report.symbols, Contains(Field(&mabo::bloat_entry::name, Eq("thrower(int)"))));
+    EXPECT_THAT(report.symbols, Contains(Field(&mabo::bloat_entry::name, Eq("kept"))));
+
+    uint64_t sections = 0;
+    uint64_t unattributed = 0;
+    for(mabo::bloat_entry const& e : report.sections)
+        sections += e.size;
+    for(mabo::bloat_entry const& e : report.unattributed)
+        unattributed += e.size;
+    EXPECT_THAT(sections, Eq(report.section_size));
+    EXPECT_THAT(report.size + unattributed, Eq(report.section_size));
+}
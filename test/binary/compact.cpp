@@ -0,0 +1,77 @@
+#include <mabo/compact.hpp>
+
+#include "test.hpp"
+#include "chdir.hpp"
+
+using namespace testing;
+
+template<class Object>
+std::vector<std::string> describe(Object const& obj)
+{
+    std::vector<std::string> result;
+    for(auto const& sym : obj.symbols())
+    {
+        auto sec = sym.section();
+        result.push_back(sym.name().to_string() + " " + std::to_string(sym.addr()) + " " + std::to_string(sym.size())
+                       + (sym.global() ? " global" : "") + (sym.weak() ? " weak" : "")
+                       + " " + (sec ? sec->name().to_string() : "-"));
+    }
+    for(auto const& sym : obj.local_symbols())
+        result.push_back("l " + sym.name().to_string() + " " + std::to_string(sym.addr()) + " " + std::to_string(unsigned(sym.type())));
+    for(auto const& sym : obj.imports())
+        result.push_back("U " + sym.name().to_string() + (sym.weak() ? " weak" : ""));
+    for(auto const& lib : obj.libs())
+        result.push_back("L " + mabo::string_view(lib).to_string());
+    for(auto const& path : obj.link_paths())
+        result.push_back("P " + mabo::string_view(path).to_string());
+    for(auto const& sec : obj.sections())
+        result.push_back("S " + sec.name().to_string() + " " + std::to_string(sec.addr()) + " " + std::to_string(sec.size()) + " " + std::to_string(sec.flags()));
+    return result;
+}
+
+TEST(compact, Snapshot)
+{
+    for(char const* file : {"libtests.a", "test_exe_shared"})
+    {
+        mabo::binary bin(file);
+        mabo::compact_binary compact(bin);
+        EXPECT_THAT(compact.name(), Eq(bin.name()));
+        EXPECT_THAT(compact.archive(), Eq(mabo::holds_alternative<mabo::archive>(bin)));
+
+        std::vector<std::vector<std::string>> expected;
+        for(mabo::object const& obj : bin.objects())
+            expected.push_back(describe(obj));
+
+        std::vector<std::vector<std::string>> actual;
+        for(mabo::compact_object obj : compact.objects())
+            actual.push_back(describe(obj));
+
+        EXPECT_THAT(actual, ContainerEq(expected));
+    }
+
+    // the index refers to the snapshot's objects
+    mabo::compact_binary archive("libtests.a");
+    std::vector<std::string> armap;
+    for(mabo::compact_armap_entry const& entry : archive.armap())
+        armap.push_back(entry.name.to_string() + " " + archive.object(entry.member).name().to_string());
+    EXPECT_THAT(armap, UnorderedElementsAre("g1 test1.cpp.o", "g2 test2.cpp.o"));
+
+    // members with one name are told apart by position
+    mabo::compact_binary dup("libdup.a");
+    ASSERT_THAT(dup.armap().size(), Eq(1u));
+    EXPECT_THAT(dup.armap()[0].member, Eq(1u));
+}
+
+TEST(compact, Load)
+{
+    std::vector<mabo::compact_binary> bins = mabo::load_compact({"main.cpp.o", "libtests.a", "test_exe_shared"}, 2);
+    ASSERT_THAT(bins.size(), Eq(3u));
+
+    std::vector<std::string> objects;
+    for(mabo::compact_binary const& bin : bins)
+        for(mabo::compact_object obj : bin.objects())
+            objects.push_back(obj.archive().to_string() + "(" + obj.name().to_string() + ")");
+
+    EXPECT_THAT(objects, ElementsAre("(main.cpp.o)", "libtests.a(test1.cpp.o)", "libtests.a(test2.cpp.o)", "(test_exe_shared)"));
+    EXPECT_THAT(bins[1].memory(), Gt(0u));
+}
@@ -1,11 +1,417 @@
 #include <mabo/context.hpp>
+#include <mabo/gc_sections.hpp>
+#include <mabo/linkline.hpp>
 
 #include "test.hpp"
 #include "chdir.hpp"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
 using namespace testing;
 
 TEST(context, dependencies)
 {
     // TODO
-}
\ No newline at end of file
+}
+
+std::vector<std::string> edges(mabo::resolution const& result)
+{
+    mabo::dependency_graph const& graph = result.dependencies;
+
+    std::vector<std::string> edges;
+    for(mabo::dependency_graph::node_id node = 0; node != graph.size(); ++node)
+        for(mabo::dependency_graph::node_id dependent : graph.edges(node))
+            edges.push_back(graph.name(node).to_string() + " " + graph.name(dependent).to_string());
+
+    std::sort(edges.begin(), edges.end());
+    return edges;
+}
+
+TEST(context, ArchiveIndex)
+{
+    mabo::context ctx;
+    ctx.load_file("main.cpp.o");
+    ctx.load_file("libtests.a");
+
+    // only test1.cpp.o defines something main.cpp.o needs
+    EXPECT_THAT(
+        edges(ctx.dependencies(false, true)),
+        ElementsAre("main.cpp.o test1.cpp.o", "test1.cpp.o main.cpp.o")
+    );
+}
+
+TEST(context, Threads)
+{
+    mabo::context ctx;
+    ctx.load_file("main.cpp.o");
+    ctx.load_file("libtests.a");
+    ctx.load_file("libtests_shared.so");
+
+    for(bool whole_archive : {false, true})
+    {
+        for(bool object_granularity : {false, true})
+        {
+            ctx.threads(1);
+            std::vector<std::string> serial = edges(ctx.dependencies(whole_archive, object_granularity));
+
+            ctx.threads(4);
+            EXPECT_THAT(edges(ctx.dependencies(whole_archive, object_granularity)), ContainerEq(serial));
+        }
+    }
+}
+
+TEST(context, Cache)
+{
+    mabo::context ctx;
+    ctx.load_file("main.cpp.o");
+    ctx.load_file("libtests.a");
+    ctx.load_file("libtests_shared.so");
+    std::vector<std::string> uncached = edges(ctx.dependencies(false, true));
+
+    // the first run fills the cache, the second one is served from it
+    std::string dir = temp_dir();
+    ctx.cache(dir);
+    EXPECT_THAT(edges(ctx.dependencies(false, true)), ContainerEq(uncached));
+    ctx.threads(4);
+    EXPECT_THAT(edges(ctx.dependencies(false, true)), ContainerEq(uncached));
+
+    mabo::symbol_cache cache(dir);
+    ASSERT_THAT(cache.find("libtests.a") != nullptr, Eq(true));
+    EXPECT_THAT(cache.find("libtests.a")->find("test1.cpp.o")->symbols() | ranges::view::transform(&mabo::symbol_cache::symbol::name), ElementsAre("g1"));
+    EXPECT_THAT(cache.find("libtests.a")->armap().size(), Eq(2u));
+}
+
+TEST(context, CacheHitDoesNotOpen)
+{
+    std::string dir = temp_dir();
+    std::string file = dir + "/test1.cpp.o";
+    {
+        std::ifstream is("test1.cpp.o", std::ios::binary);
+        std::ofstream os(file, std::ios::binary);
+        os << is.rdbuf();
+    }
+
+    {
+        mabo::context ctx;
+        ctx.cache(dir + "/cache");
+        ctx.load_file(file);
+        ctx.dependencies();
+    }
+
+    // same inode, size and mtime, but no longer an object file
+    struct stat st;
+    ASSERT_THAT(::stat(file.c_str(), &st), Eq(0));
+    {
+        std::fstream f(file, std::ios::in | std::ios::out | std::ios::binary);
+        f << std::string(st.st_size, '\0');
+    }
+    struct timespec times[2] = {st.st_atim, st.st_mtim};
+    ASSERT_THAT(::utimensat(AT_FDCWD, file.c_str(), times, 0), Eq(0));
+
+    mabo::context ctx;
+    ctx.cache(dir + "/cache");
+    ctx.load_file(file);
+    mabo::resolution result = ctx.dependencies(false, true);
+    ASSERT_THAT(result.dependencies.size(), Eq(1u));
+    EXPECT_THAT(result.dependencies.name(0), Eq(file));
+    EXPECT_THAT(result.diagnostics.count(mabo::diagnostic::UNDEFINED_SYMBOL), Eq(1u));
+    EXPECT_THAT(mabo::linkline(result.dependencies), Eq(file + " "));
+}
+
+TEST(context, DuplicateMembers)
+{
+    // only the second dup.cpp.o defines g1, every mode has to pull that one,
+    // the cache twice for a cold and a warm run
+    std::string dir = temp_dir();
+    for(int mode : {0, 1, 2, 2})
+    {
+        mabo::context ctx;
+        if(mode == 1)
+            ctx.compact(true);
+        if(mode == 2)
+            ctx.cache(dir);
+        ctx.load_file("main.cpp.o");
+        ctx.load_file("libdup.a");
+
+        mabo::resolution result = ctx.dependencies(false, mabo::granularity::OBJECT);
+        EXPECT_THAT(edges(result), ElementsAre("dup.cpp.o main.cpp.o", "main.cpp.o dup.cpp.o"));
+        EXPECT_THAT(result.diagnostics.count(mabo::diagnostic::UNDEFINED_SYMBOL), Eq(0u));
+
+        bool defines = false;
+        for(mabo::object const& obj : result.dependencies.node(result.dependencies.find("dup.cpp.o")).objects())
+            defines = defines || bool(obj.find_symbol("g1"));
+        EXPECT_THAT(defines, Eq(true));
+    }
+
+    // cached although the member name repeats
+    mabo::symbol_cache cache(dir);
+    ASSERT_THAT(cache.find("libdup.a") != nullptr, Eq(true));
+    ASSERT_THAT(cache.find("libdup.a")->armap().size(), Eq(1u));
+    EXPECT_THAT(cache.find("libdup.a")->armap()[0].member, Eq(1u));
+}
+
+TEST(context, Graph)
+{
+    mabo::context ctx;
+    ctx.load_file("main.cpp.o");
+    ctx.load_file("libtests.a");
+    ctx.load_file("test2.cpp.o");
+
+    mabo::dependency_graph graph = ctx.dependencies(false, true).dependencies;
+
+    // nodes in resolution order, test2.cpp.o from the archive is not linked in
+    ASSERT_THAT(graph.size(), Eq(3u));
+    EXPECT_THAT(graph.name(0), Eq("main.cpp.o"));
+    EXPECT_THAT(graph.name(1), Eq("test1.cpp.o"));
+    EXPECT_THAT(graph.name(2), Eq("test2.cpp.o"));
+    EXPECT_THAT(graph.edge_count(), Eq(2u));
+    EXPECT_THAT(graph.edges(0), ElementsAre(1u));
+    EXPECT_THAT(graph.edges(1), ElementsAre(0u));
+    EXPECT_THAT(graph.edges(2), ElementsAre());
+
+    EXPECT_THAT(graph.find("test1.cpp.o"), Eq(1u));
+    EXPECT_THAT(graph.find("nope.o") == mabo::dependency_graph::npos, Eq(true));
+    EXPECT_THAT(mabo::linkline(graph), Eq("main.cpp.o test1.cpp.o test2.cpp.o "));
+}
+
+TEST(context, Linkline)
+{
+    mabo::context ctx;
+    ctx.load_file("test2.cpp.o");
+    ctx.load_file("libcycle1.a");
+    ctx.load_file("libcycle2.a");
+    mabo::dependency_graph graph = ctx.dependencies(true).dependencies;
+
+    mabo::graph_components scc = mabo::strong_components(graph);
+    EXPECT_THAT(scc.count, Eq(2u));
+    EXPECT_THAT(scc.component[1], Eq(scc.component[2]));
+
+    // only the archives needing each other are grouped
+    EXPECT_THAT(mabo::linkline(graph), Eq("test2.cpp.o --start-group libcycle1.a libcycle2.a --end-group "));
+
+    std::ostringstream os;
+    mabo::linkline(os, graph);
+    EXPECT_THAT(os.str(), Eq(mabo::linkline(graph)));
+
+    mabo::linkline_response_file("linkline.rsp", graph);
+    std::ifstream rsp("linkline.rsp");
+    EXPECT_THAT(std::string(std::istreambuf_iterator<char>(rsp), {}), Eq("test2.cpp.o\n--start-group\nlibcycle1.a\nlibcycle2.a\n--end-group\n"));
+
+    // an object is linked in anyway, no group needed
+    mabo::context objects;
+    objects.load_file("libcycle2.a");
+    objects.load_file("main.cpp.o");
+    EXPECT_THAT(mabo::linkline(objects.dependencies(true).dependencies), Eq("main.cpp.o libcycle2.a "));
+
+    // archives are told apart without opening the inputs again
+    for(bool compact : {false, true})
+    {
+        mabo::context lazy;
+        if(compact)
+            lazy.compact(true);
+        else
+            lazy.cache(temp_dir());
+        lazy.load_file("test2.cpp.o");
+        lazy.load_file("libcycle1.a");
+        lazy.load_file("libcycle2.a");
+        EXPECT_THAT(mabo::linkline(lazy.dependencies(true).dependencies), Eq(mabo::linkline(graph)));
+    }
+}
+
+TEST(context, SectionGranularity)
+{
+    mabo::context ctx;
+    ctx.load_file("main.cpp.o");
+    ctx.load_file("test1.cpp.o");
+
+    mabo::dependency_graph graph = ctx.dependencies(false, mabo::granularity::SECTION).dependencies;
+
+    std::vector<std::string> edges;
+    for(mabo::dependency_graph::node_id node = 0; node != graph.size(); ++node)
+        for(mabo::dependency_graph::node_id dependent : graph.edges(node))
+            edges.push_back(
+                graph.name(node).to_string() + "(" + graph.section(node).to_string() + ") " +
+                graph.name(dependent).to_string() + "(" + graph.section(dependent).to_string() + ")"
+            );
+
+    EXPECT_THAT(edges, Contains("main.cpp.o(.text) test1.cpp.o(.text)"));
+    EXPECT_THAT(edges, Contains("test1.cpp.o(.text) main.cpp.o(.text)"));
+    EXPECT_THAT(edges, Contains("test1.cpp.o(.eh_frame) test1.cpp.o(.text)"));
+    EXPECT_THAT(graph.find("main.cpp.o", ".text") == graph.find("main.cpp.o"), Eq(false));
+
+    // same named objects keep their own section nodes
+    mabo::context twice;
+    twice.load_file("main.cpp.o");
+    twice.load_file("main.cpp.o");
+    mabo::dependency_graph both = twice.dependencies(false, mabo::granularity::SECTION).dependencies;
+
+    size_t text = 0;
+    for(mabo::dependency_graph::node_id node = 0; node != both.size(); ++node)
+        text += both.name(node) == "main.cpp.o" && both.section(node) == ".text";
+    EXPECT_THAT(text, Eq(2u));
+}
+
+TEST(context, GcSections)
+{
+    mabo::context ctx;
+    ctx.load_file("main.cpp.o");
+    ctx.load_file("libtests.a");
+    ctx.threads(0);
+
+    mabo::gc_options options;
+    options.whole_archive = true;
+    mabo::gc_report report = mabo::gc_sections(ctx, options);
+
+    ASSERT_THAT(report.objects.size(), Eq(3u));
+    EXPECT_THAT(report.objects[0].name, Eq("main.cpp.o"));
+    EXPECT_THAT(report.objects[0].reachable, Gt(0u));
+    EXPECT_THAT(report.objects[2].name, Eq("libtests.a(test2.cpp.o)"));
+    EXPECT_THAT(report.objects[2].reachable, Eq(0u));
+    EXPECT_THAT(report.objects[2].unreachable, Gt(0u));
+
+    ASSERT_THAT(report.archives.size(), Eq(1u));
+    EXPECT_THAT(report.archives[0].reachable, Eq(report.objects[1].reachable));
+    EXPECT_THAT(report.archives[0].unreachable, Eq(report.objects[1].unreachable + report.objects[2].unreachable));
+    EXPECT_THAT(report.reachable_bytes + report.unreachable_bytes, Gt(report.unreachable_bytes));
+
+    // g2 kept once exported
+    options.export_dynamic = true;
+    EXPECT_THAT(mabo::gc_sections(ctx, options).objects[2].reachable, Gt(0u));
+}
+
+TEST(context, GcSectionsKeep)
+{
+    mabo::context ctx;
+    ctx.load_file("gc.o");
+    mabo::gc_report report = mabo::gc_sections(ctx);
+
+    auto reachable = [&](mabo::string_view section)
+    {
+        mabo::dependency_graph::node_id node = report.sections.find("gc.o", section);
+        EXPECT_THAT(node, Ne(mabo::dependency_graph::npos)) << section;
+        return node != mabo::dependency_graph::npos && report.reachable[node];
+    };
+
+    // kept through .eh_frame, the code using them keeps them
+    EXPECT_THAT(reachable(".gcc_except_table.main"), Eq(true));
+    EXPECT_THAT(reachable(".gcc_except_table._ZL7throweri"), Eq(true));
+
+    // kept through __start_gc_keep and __stop_gc_keep
+    EXPECT_THAT(reachable("gc_keep"), Eq(true));
+}
+
+TEST(context, Diagnostics)
+{
+    mabo::context ctx;
+    ctx.load_file("test1.cpp.o");
+    ctx.load_file("test1.cpp.o");
+    ctx.load_file("libtests.a");
+
+    mabo::resolution result = ctx.dependencies();
+    EXPECT_THAT(result.diagnostics.count(mabo::diagnostic::MULTIPLE_DEFINITION), Eq(1u));
+    EXPECT_THAT(result.diagnostics.count(mabo::diagnostic::UNDEFINED_SYMBOL), Eq(1u));
+    EXPECT_THAT(result.diagnostics.count(mabo::diagnostic::UNUSED_OBJECT), Eq(2u));
+
+    std::ostringstream text;
+    std::ostringstream json;
+    mabo::text_sink text_sink(text);
+    mabo::json_sink json_sink(json);
+    for(mabo::diagnostic const& d : result.diagnostics)
+    {
+        if(d.kind == mabo::diagnostic::UNUSED_OBJECT)
+            continue;
+        text_sink(d);
+        json_sink(d);
+    }
+    EXPECT_THAT(text.str(), Eq(
+        "multiple definitions of symbol g1 defined in test1.cpp.o, previous definition in test1.cpp.o\n"
+        "undefined symbol f1 in object test1.cpp.o\n"
+    ));
+    EXPECT_THAT(json.str(), Eq(
+        "{\"kind\":\"multiple_definition\",\"symbol\":\"g1\",\"object\":\"test1.cpp.o\",\"previous\":\"test1.cpp.o\"}\n"
+        "{\"kind\":\"undefined_symbol\",\"symbol\":\"f1\",\"object\":\"test1.cpp.o\"}\n"
+    ));
+
+    mabo::counting_sink counts = result.diagnostics.report(mabo::counting_sink());
+    EXPECT_THAT(counts.counts[mabo::diagnostic::UNUSED_OBJECT], Eq(2u));
+}
+
+template<class Context>
+std::vector<std::string> names(Context const& ctx)
+{
+    std::vector<std::string> names;
+    for(mabo::binary const& bin : ctx.binaries())
+        names.push_back(bin.name().to_string());
+    return names;
+}
+
+TEST(context, LoadDynamic)
+{
+    std::string current_path = get_executable_path();
+    std::string current_dir = ::dirname(&current_path[0]);
+
+    ::unlink("libtest1_link.so");
+    ASSERT_THAT(::symlink("libtest1_shared.so", "libtest1_link.so"), Eq(0));
+
+    mabo::context serial;
+    serial.load_file("libtest1_link.so");
+    serial.load_file("test_exe_shared2");
+    serial.load_dynamic();
+
+    // breadth first, libtest1_shared.so is the symlinked file loaded already
+    std::vector<std::string> loaded = names(serial);
+    ASSERT_THAT(loaded.size(), Gt(3u));
+    EXPECT_THAT(loaded[0], Eq("libtest1_link.so"));
+    EXPECT_THAT(loaded[1], Eq("test_exe_shared2"));
+    EXPECT_THAT(loaded[2], Eq(current_dir + "/2/libtest2_shared.so"));
+    EXPECT_THAT(loaded, Not(Contains(current_dir + "/libtest1_shared.so")));
+
+    mabo::context parallel;
+    parallel.threads(4);
+    parallel.load_file("libtest1_link.so");
+    parallel.load_file("test_exe_shared2");
+    parallel.load_dynamic();
+    EXPECT_THAT(names(parallel), ContainerEq(loaded));
+}
+
+TEST(context, Compact)
+{
+    mabo::context ctx;
+    ctx.load_file("main.cpp.o");
+    ctx.load_file("libtests.a");
+    ctx.load_file("libtests_shared.so");
+
+    // snapshots resolve like open files, at every granularity
+    mabo::context compact;
+    compact.compact(true);
+    compact.load_file("main.cpp.o");
+    compact.load_file("libtests.a");
+    compact.load_file("libtests_shared.so");
+
+    for(bool whole_archive : {false, true})
+    {
+        for(mabo::granularity::type level : {mabo::granularity::BINARY, mabo::granularity::OBJECT, mabo::granularity::SECTION})
+        {
+            std::vector<std::string> expected = edges(ctx.dependencies(whole_archive, level));
+            compact.threads(1);
+            EXPECT_THAT(edges(compact.dependencies(whole_archive, level)), ContainerEq(expected));
+            compact.threads(4);
+            EXPECT_THAT(edges(compact.dependencies(whole_archive, level)), ContainerEq(expected));
+        }
+    }
+
+    mabo::context dynamic;
+    dynamic.compact(true);
+    dynamic.load_file("test_exe_shared2");
+    dynamic.load_dynamic();
+
+    mabo::context opened;
+    opened.load_file("test_exe_shared2");
+    opened.load_dynamic();
+    EXPECT_THAT(names(dynamic), ContainerEq(names(opened)));
+}
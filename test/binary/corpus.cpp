@@ -0,0 +1,84 @@
+#include <mabo/corpus.hpp>
+#include <mabo/context.hpp>
+
+#include "test.hpp"
+#include "chdir.hpp"
+
+#include <fstream>
+#include <sstream>
+
+using namespace testing;
+
+std::string contents(std::string const& file)
+{
+    std::ifstream is(file, std::ios::binary);
+    std::ostringstream os;
+    os << is.rdbuf();
+    return os.str();
+}
+
+TEST(corpus, Archives)
+{
+    mabo::corpus_options options;
+    options.objects = 40;
+    options.symbols = 8;
+    options.archives = 3;
+    options.shared = 2;
+    options.cycles = true;
+
+    std::string dir = temp_dir();
+    std::vector<std::string> files = mabo::write_corpus(dir, options);
+    ASSERT_THAT(files.size(), Eq(6u));
+    EXPECT_THAT(files[1], Eq(dir + "/libcorpus0.a"));
+
+    mabo::binary ar(files[1]);
+    size_t members = 0;
+    for(mabo::object const& obj : ar.objects())
+        members += !obj.name().empty();
+    EXPECT_THAT(members, Eq(13u));
+    EXPECT_THAT(mabo::get<mabo::archive>(ar).armap().size(), Eq(13u * 8));
+
+    // backward references between archives are only found with them grouped
+    mabo::context ctx;
+    for(std::string const& file : files)
+        ctx.load_file(file);
+    EXPECT_THAT(ctx.dependencies().diagnostics.count(mabo::diagnostic::UNDEFINED_SYMBOL), Gt(0u));
+    EXPECT_THAT(ctx.dependencies(true).diagnostics.count(mabo::diagnostic::UNDEFINED_SYMBOL), Eq(0u));
+
+    // same options, same bytes
+    std::string again = temp_dir();
+    mabo::write_corpus(again, options);
+    EXPECT_THAT(contents(again + "/libcorpus2.a") == contents(dir + "/libcorpus2.a"), Eq(true));
+}
+
+TEST(corpus, Shared)
+{
+    mabo::corpus_options options;
+    options.objects = 10;
+    options.archives = 0;
+    options.shared = 3;
+    options.duplicates = 2;
+
+    std::string dir = temp_dir();
+    std::vector<std::string> files = mabo::write_corpus(dir, options);
+    ASSERT_THAT(files.size(), Eq(13u));
+
+    mabo::context ctx;
+    ctx.load_file(dir + "/libcorpus0.so");
+    ctx.load_dynamic();
+    size_t loaded = 0;
+    for(mabo::binary const& bin : ctx.binaries())
+        loaded += bin.name().size() != 0;
+    EXPECT_THAT(loaded, Eq(3u));
+
+    mabo::object lib = *mabo::binary(dir + "/libcorpus2.so").objects().begin();
+    EXPECT_THAT(bool(lib.find_symbol("d2_3xxxxxxxxxxxxxxxxxxxx")), Eq(true));
+    EXPECT_THAT(bool(lib.find_symbol("d1_3xxxxxxxxxxxxxxxxxxxx")), Eq(false));
+
+    mabo::context all;
+    for(std::string const& file : files)
+        all.load_file(file);
+    mabo::resolution result = all.dependencies();
+    EXPECT_THAT(result.diagnostics.count(mabo::diagnostic::MULTIPLE_DEFINITION), Eq(2u));
+    EXPECT_THAT(result.diagnostics.count(mabo::diagnostic::UNDEFINED_SYMBOL), Eq(0u));
+}
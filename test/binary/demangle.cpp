@@ -0,0 +1,43 @@
+#include <mabo/demangle.hpp>
+
+#include "test.hpp"
+
+#include <thread>
+
+using namespace testing;
+
+TEST(demangle, Scope)
+{
+    EXPECT_THAT(mabo::detail::demangled_scope("main"), Eq(""));
+    EXPECT_THAT(mabo::detail::demangled_scope("ns::f(int)"), Eq("ns"));
+    EXPECT_THAT(mabo::detail::demangled_scope("void std::vector<int, std::allocator<int> >::_M_realloc_insert<int>(int&&)"), Eq("std::vector<>"));
+    EXPECT_THAT(mabo::detail::demangled_scope("ns::(anonymous namespace)::C::operator<(ns::C const&)"), Eq("ns::(anonymous namespace)::C"));
+    EXPECT_THAT(mabo::detail::demangled_scope("vtable for ns::C<int>"), Eq("ns::C<>"));
+    EXPECT_THAT(mabo::detail::demangled_scope("guard variable for ns::f()::x"), Eq("ns"));
+}
+
+TEST(demangle, Family)
+{
+    EXPECT_THAT(mabo::detail::template_family("void std::vector<int, std::allocator<int> >::push_back(int const&)"), Eq("std::vector<>::push_back"));
+    EXPECT_THAT(mabo::detail::template_family("ns::C::operator()(int) const"), Eq("ns::C::operator()"));
+    EXPECT_THAT(mabo::detail::template_family("operator new(unsigned long)"), Eq("operator new"));
+}
+
+TEST(demangle, Cache)
+{
+    mabo::string_pool names;
+    mabo::string_pool::id_type f = names.intern("_ZN2ns1fIiEEvT_");
+    mabo::string_pool::id_type g = names.intern("_ZN2ns1fIlEEvT_");
+    mabo::string_pool::id_type c = names.intern("main");
+
+    mabo::demangle_cache cache(names);
+    cache.demangle(std::thread::hardware_concurrency());
+
+    EXPECT_THAT(cache.demangled(f), Eq("void ns::f<int>(int)"));
+    EXPECT_THAT(cache.demangled(c), Eq("main"));
+    EXPECT_THAT(cache.stripped(f), Eq("ns::f<>"));
+    EXPECT_THAT(cache.stripped(g).data(), Eq(cache.stripped(f).data()));
+    EXPECT_THAT(cache.demangled(f).data(), Eq(cache.demangled(f).data()));
+
+    EXPECT_THAT(cache.demangled(mabo::string_view("_Z1gv")), Eq("g()"));
+}
@@ -0,0 +1,12 @@
+// built twice into libdup.a under one member name, only the second copy
+// defines anything and so has entries in the archive index
+#ifdef DUP_DEFINES
+extern "C" void f1();
+
+extern "C" void g1()
+{
+   f1();
+}
+#else
+static int unindexed;
+#endif
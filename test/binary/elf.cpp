@@ -0,0 +1,212 @@
+#include <mabo/binary/elf.hpp>
+#include <mabo/corpus.hpp>
+
+#include "test.hpp"
+#include "chdir.hpp"
+
+#include <cstring>
+#include <thread>
+
+using namespace testing;
+
+TEST(elf, Test1Object)
+{
+    mabo::elf::binary bin("test1.cpp.o");
+    EXPECT_THAT(bin.name(), Eq("test1.cpp.o"));
+    EXPECT_THAT(mabo::holds_alternative<mabo::elf::object>(bin), Eq(true));
+
+    mabo::elf::object& obj = mabo::get<mabo::elf::object>(bin);
+
+    EXPECT_THAT(
+        obj.symbols() | ranges::view::transform(&mabo::elf::symbol::name),
+        ElementsAre("g1")
+    );
+
+    EXPECT_THAT(
+        obj.imports() | ranges::view::transform(&mabo::elf::symbol::name),
+        ElementsAre("f1")
+    );
+
+    EXPECT_THAT(obj.libs(), ElementsAre());
+
+    EXPECT_THAT(bool(obj.section(".text")), Eq(true));
+    EXPECT_THAT(obj.section(".text")->data<char>().size(), Gt(0u));
+}
+
+TEST(elf, LibTestsArchive)
+{
+    mabo::elf::binary bin("libtests.a");
+    EXPECT_THAT(bin.name(), Eq("libtests.a"));
+    EXPECT_THAT(mabo::holds_alternative<mabo::elf::archive>(bin), Eq(true));
+
+    mabo::elf::archive& archive = mabo::get<mabo::elf::archive>(bin);
+
+    EXPECT_THAT(
+        archive.objects() | ranges::view::transform(&mabo::elf::object::name),
+        ElementsAre("test1.cpp.o", "test2.cpp.o")
+    );
+
+    mabo::elf::object test2 = *ranges::next(archive.objects().begin(), 1);
+
+    EXPECT_THAT(test2.archive()->name(), Eq("libtests.a"));
+
+    EXPECT_THAT(
+        test2.symbols() | ranges::view::transform(&mabo::elf::symbol::name),
+        ElementsAre("g2")
+    );
+
+    EXPECT_THAT(
+        test2.imports() | ranges::view::transform(&mabo::elf::symbol::name),
+        ElementsAre("f2")
+    );
+}
+
+TEST(elf, LibTestsArchiveParallel)
+{
+    mabo::elf::binary bin("libtests.a");
+
+    std::vector<mabo::elf::object> objects = bin.objects(4);
+
+    EXPECT_THAT(
+        objects | ranges::view::transform(&mabo::elf::object::name),
+        ElementsAre("test1.cpp.o", "test2.cpp.o")
+    );
+
+    EXPECT_THAT(
+        objects[1].symbols() | ranges::view::transform(&mabo::elf::symbol::name),
+        ElementsAre("g2")
+    );
+}
+
+TEST(elf, TestExecutableShared)
+{
+    mabo::elf::binary bin("test_exe_shared");
+    EXPECT_THAT(mabo::holds_alternative<mabo::elf::object>(bin), Eq(true));
+
+    mabo::elf::object& obj = mabo::get<mabo::elf::object>(bin);
+
+    EXPECT_THAT(
+        obj.symbols() | ranges::view::transform(&mabo::elf::symbol::name),
+        AllOf(Contains("main"), Contains("f1"))
+    );
+
+    EXPECT_THAT(
+        obj.imports() | ranges::view::transform(&mabo::elf::symbol::name),
+        AllOf(Contains("__libc_start_main"), Contains("g1"))
+    );
+
+    EXPECT_THAT(
+        obj.libs(),
+        AllOf(Contains("libtest1_shared.so"), Contains("libc.so.6"))
+    );
+
+    std::string current_path = get_executable_path();
+    std::string current_dir = ::dirname(&current_path[0]);
+
+    EXPECT_THAT(
+        obj.link_paths(),
+        AllOf(Contains(current_dir), Not(Contains(current_dir + "/2")))
+    );
+}
+
+TEST(elf, SymbolOwnsObject)
+{
+    std::vector<mabo::elf::symbol> symbols;
+    {
+        mabo::elf::binary bin("test1.cpp.o");
+        for(mabo::elf::symbol const& sym : mabo::get<mabo::elf::object>(bin).symbols())
+            symbols.push_back(sym);
+    }
+
+    ASSERT_THAT(symbols.size(), Eq(1u));
+    EXPECT_THAT(symbols[0].name(), Eq("g1"));
+    EXPECT_THAT(symbols[0].object().name(), Eq("test1.cpp.o"));
+}
+
+TEST(elf, ConcurrentLookups)
+{
+    mabo::elf::binary bin("test_exe_shared");
+    mabo::elf::object obj = mabo::get<mabo::elf::object>(bin);
+
+    std::vector<std::thread> threads;
+    std::vector<int> found(8);
+    for(size_t i = 0; i != found.size(); ++i)
+    {
+        threads.emplace_back([&, i]()
+        {
+            found[i] = bool(obj.find_symbol("main")) + obj.libs().size();
+        });
+    }
+    for(std::thread& t : threads)
+        t.join();
+
+    EXPECT_THAT(found, Each(Eq(found[0])));
+    EXPECT_THAT(found[0], Gt(1));
+}
+
+TEST(elf, ForeignMember)
+{
+    namespace corpus = mabo::detail::corpus;
+
+    std::string native = corpus::relocatable({"native_f"}, {});
+    std::string foreign = corpus::relocatable({"foreign_f"}, {});
+    foreign[EI_DATA] = ELFDATA2MSB;
+    corpus::write("elf_foreign.a", corpus::archive({{"foreign.o", foreign}, {"native.o", native}}, {{"foreign_f"}, {"native_f"}}));
+
+    mabo::elf::binary bin("elf_foreign.a");
+    EXPECT_THAT(
+        bin.objects() | ranges::view::transform(&mabo::elf::object::name),
+        ElementsAre("native.o")
+    );
+    EXPECT_THAT(bin.objects(2).size(), Eq(1u));
+    EXPECT_THAT(bool(mabo::get<mabo::elf::archive>(bin).armap_member(0)), Eq(false));
+}
+
+TEST(elf, ExtendedSectionIndex)
+{
+    namespace corpus = mabo::detail::corpus;
+
+    // g's st_shndx moved into a SHT_SYMTAB_SHNDX section, as assemblers do
+    // past 0xff00 sections
+    std::string out = corpus::relocatable({"g"}, {});
+    Elf64_Ehdr ehdr;
+    std::memcpy(&ehdr, out.data(), sizeof(ehdr));
+    std::vector<Elf64_Shdr> shdrs(ehdr.e_shnum);
+    std::memcpy(shdrs.data(), out.data() + ehdr.e_shoff, shdrs.size() * sizeof(Elf64_Shdr));
+    out.resize(ehdr.e_shoff);
+
+    uint32_t symtab = 0;
+    while(shdrs[symtab].sh_type != SHT_SYMTAB)
+        ++symtab;
+    size_t count = shdrs[symtab].sh_size / sizeof(Elf64_Sym);
+
+    std::vector<uint32_t> xindex(count, 0);
+    for(size_t i = 0; i != count; ++i)
+    {
+        Elf64_Sym sym;
+        char* p = &out[shdrs[symtab].sh_offset + i * sizeof(Elf64_Sym)];
+        std::memcpy(&sym, p, sizeof(sym));
+        if(ELF64_ST_BIND(sym.st_info) == STB_GLOBAL)
+        {
+            xindex[i] = sym.st_shndx;
+            sym.st_shndx = SHN_XINDEX;
+            std::memcpy(p, &sym, sizeof(sym));
+        }
+    }
+
+    Elf64_Shdr shndx = corpus::section_header(0, SHT_SYMTAB_SHNDX, 0, out.size(), xindex.size() * 4, symtab, 0, 4, 4);
+    out.append(reinterpret_cast<char const*>(xindex.data()), xindex.size() * 4);
+    shdrs.push_back(shndx);
+
+    ehdr.e_shoff = out.size();
+    ehdr.e_shnum = shdrs.size();
+    out.append(reinterpret_cast<char const*>(shdrs.data()), shdrs.size() * sizeof(Elf64_Shdr));
+    std::memcpy(&out[0], &ehdr, sizeof(ehdr));
+    corpus::write("elf_xindex.o", out);
+
+    mabo::elf::binary bin("elf_xindex.o");
+    mabo::elf::object obj = mabo::get<mabo::elf::object>(bin);
+    ASSERT_THAT(bool(obj.find_symbol("g")), Eq(true));
+    ASSERT_THAT(bool(obj.find_symbol("g")->section()), Eq(true));
+    EXPECT_THAT(obj.find_symbol("g")->section()->name(), Eq(".text"));
+}
@@ -0,0 +1,27 @@
+// exception tables and a section found through __start_ and __stop_, for gc_sections
+#include <stdexcept>
+
+extern char const* const __start_gc_keep[];
+extern char const* const __stop_gc_keep[];
+
+__attribute__((section("gc_keep"), used)) static char const* const kept = "kept";
+
+static int thrower(int i)
+{
+    if(i > 1)
+        throw std::runtime_error("too many arguments");
+    return i;
+}
+
+int main(int argc, char**)
+{
+    try
+    {
+        thrower(argc);
+    }
+    catch(std::exception const&)
+    {
+        return 1;
+    }
+    return int(__stop_gc_keep - __start_gc_keep);
+}
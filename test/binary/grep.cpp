@@ -0,0 +1,69 @@
+#include <mabo/grep.hpp>
+
+#include "test.hpp"
+#include "chdir.hpp"
+
+using namespace testing;
+
+std::vector<std::string> names(mabo::grep_result const& result)
+{
+    std::vector<std::string> names;
+    for(mabo::grep_match const& match : result.matches)
+        names.push_back((match.member.empty() ? match.file : match.file + "(" + match.member + ")") + (match.undefined ? " U " : " D ") + match.name);
+    return names;
+}
+
+TEST(grep, Literal)
+{
+    using mabo::detail::grep::required_literal;
+    EXPECT_THAT(required_literal("foo"), Eq("foo"));
+    EXPECT_THAT(required_literal("^_Z.*Vector3foo$"), Eq("Vector3foo"));
+    EXPECT_THAT(required_literal("ab?cd"), Eq("cd"));
+    EXPECT_THAT(required_literal("x{2,3}yz"), Eq("yz"));
+    EXPECT_THAT(required_literal("(abcdef)?g"), Eq("g"));
+    EXPECT_THAT(required_literal("a\\.b[cd]e"), Eq("a.b"));
+    EXPECT_THAT(required_literal("abc|d"), Eq(""));
+    EXPECT_THAT(required_literal("ab\\dcde"), Eq("cde"));
+    EXPECT_THAT(required_literal("\\x41bc"), Eq(""));
+    EXPECT_THAT(required_literal("\\u0041bc"), Eq(""));
+    EXPECT_THAT(required_literal("a\\cJbc"), Eq(""));
+    EXPECT_THAT(required_literal("(ab)\\1cd"), Eq(""));
+}
+
+TEST(grep, Hits)
+{
+    // "g1" also ends "xg1", names may point into the middle of a string
+    char const table[] = "\0f1\0xg1\0g2\0";
+    mabo::detail::grep::hits h = mabo::detail::grep::find_hits(table, sizeof(table) - 1, "g1");
+    EXPECT_THAT(h.contains(1), Eq(false));
+    EXPECT_THAT(h.contains(4), Eq(true));
+    EXPECT_THAT(h.contains(5), Eq(true));
+    EXPECT_THAT(h.contains(6), Eq(false));
+    EXPECT_THAT(h.contains(8), Eq(false));
+}
+
+TEST(grep, Files)
+{
+    mabo::grep_options options;
+    options.pattern = "g1";
+    options.threads = 2;
+
+    std::vector<std::string> files = {"main.cpp.o", "libtests.a", "libtests_shared.so", "test_exe_shared", "CMakeFiles"};
+    mabo::grep_result result = mabo::grep(files, options);
+    EXPECT_THAT(names(result), ElementsAre(
+        "main.cpp.o U g1",
+        "libtests.a(test1.cpp.o) D g1",
+        "libtests_shared.so D g1",
+        "test_exe_shared U g1"
+    ));
+    ASSERT_THAT(result.skipped.size(), Eq(1u));
+    EXPECT_THAT(result.skipped[0].first, Eq("CMakeFiles"));
+
+    options.undefined = false;
+    options.regex = true;
+    options.pattern = "^[fg][12]$";
+    EXPECT_THAT(names(mabo::grep({"libtests.a"}, options)), ElementsAre(
+        "libtests.a(test1.cpp.o) D g1",
+        "libtests.a(test2.cpp.o) D g2"
+    ));
+}
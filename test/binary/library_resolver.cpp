@@ -0,0 +1,59 @@
+#include <mabo/binary.hpp>
+#include <mabo/library_resolver.hpp>
+
+#include "test.hpp"
+#include "chdir.hpp"
+
+#include <fstream>
+
+using namespace testing;
+
+std::string current_dir()
+{
+    std::string current_path = get_executable_path();
+    return ::dirname(&current_path[0]);
+}
+
+TEST(library_resolver, LinkPaths)
+{
+    mabo::binary bin("test_exe_shared");
+    mabo::object& obj = mabo::get<mabo::object>(bin);
+    mabo::library_resolver resolver;
+
+    EXPECT_THAT(
+        resolver.find("libtest1_shared.so", obj.link_paths(), obj.machine(), obj.bits()),
+        Eq(mabo::optional<std::string>(current_dir() + "/libtest1_shared.so"))
+    );
+
+    // not on any path of test_exe_shared
+    EXPECT_THAT(bool(resolver.find("libtest2_shared.so", obj.link_paths(), obj.machine(), obj.bits())), Eq(false));
+
+    // libc comes from ld.so.cache or the default directories
+    mabo::optional<std::string> libc = resolver.find("libc.so.6", obj.link_paths(), obj.machine(), obj.bits());
+    ASSERT_THAT(bool(libc), Eq(true));
+    EXPECT_THAT(mabo::get<mabo::object>(mabo::binary(*libc)).machine(), Eq(obj.machine()));
+}
+
+TEST(library_resolver, Conf)
+{
+    std::string dir = temp_dir();
+    std::ofstream(dir + "/resolver.conf") << "# test\ninclude resolver_*.conf\n";
+    std::ofstream(dir + "/resolver_2.conf") << current_dir() << "/2   # trailing comment\n";
+
+    mabo::library_resolver resolver("no-such-ld.so.cache", dir + "/resolver.conf");
+    EXPECT_THAT(resolver.conf_directories(), ElementsAre(current_dir() + "/2"));
+
+    // like ld.so, the directories are only used through the cache ldconfig builds from them
+    mabo::binary bin("test_exe_shared");
+    mabo::object& obj = mabo::get<mabo::object>(bin);
+    EXPECT_THAT(bool(resolver.find("libtest2_shared.so", std::vector<std::string>(), obj.machine(), obj.bits())), Eq(false));
+}
+
+TEST(library_resolver, DynamicStringTokens)
+{
+    mabo::detail::dst_expander expand("test_exe_shared", EM_X86_64, 64);
+
+    EXPECT_THAT(expand("$ORIGIN/2"), Eq(current_dir() + "/2"));
+    EXPECT_THAT(expand("${ORIGIN}/../$LIB"), Eq(current_dir() + "/../" + mabo::detail::lib_dir(EM_X86_64, 64)));
+    EXPECT_THAT(expand("/opt/$UNKNOWN/${X}"), Eq("/opt/$UNKNOWN/${X}"));
+}
@@ -0,0 +1,41 @@
+#include <mabo/context.hpp>
+#include <mabo/stats.hpp>
+
+#include "test.hpp"
+#include "chdir.hpp"
+
+#include <sstream>
+
+using namespace testing;
+
+TEST(stats, Load)
+{
+    mabo::stats::trace();
+
+    mabo::context ctx;
+    ctx.load_file("test_exe_shared");
+    ctx.load_dynamic();
+    ctx.dependencies();
+
+    std::ostringstream trace;
+    mabo::stats::write_trace(trace);
+    EXPECT_THAT(trace.str(), StartsWith("{\"traceEvents\":["));
+    EXPECT_THAT(trace.str(), HasSubstr("\"name\":\"counters\""));
+
+    if(!mabo::stats::enabled())
+    {
+        EXPECT_THAT(mabo::stats::value(mabo::stats::FILES_OPENED), Eq(0u));
+        EXPECT_THAT(mabo::stats::calls(mabo::stats::LOAD_SYMBOLS), Eq(0u));
+        return;
+    }
+
+    // the executable and libtest1_shared.so, plus libc and friends
+    EXPECT_THAT(mabo::stats::value(mabo::stats::FILES_OPENED), Ge(2u));
+    EXPECT_THAT(mabo::stats::value(mabo::stats::BYTES_READ), Gt(0u));
+    EXPECT_THAT(mabo::stats::value(mabo::stats::SYMBOLS_LOADED), Gt(0u));
+    EXPECT_THAT(mabo::stats::value(mabo::stats::LIBRARIES_PROBED), Ge(1u));
+    EXPECT_THAT(mabo::stats::calls(mabo::stats::LOAD_DYNAMIC), Eq(1u));
+    EXPECT_THAT(mabo::stats::calls(mabo::stats::RESOLVE), Eq(1u));
+    EXPECT_THAT(mabo::stats::calls(mabo::stats::LOAD_SYMBOLS), Gt(0u));
+    EXPECT_THAT(trace.str(), HasSubstr("\"name\":\"load_dynamic\",\"cat\":\"mabo\",\"ph\":\"X\""));
+}
@@ -0,0 +1,65 @@
+#include <mabo/string_pool.hpp>
+#include <mabo/parallel.hpp>
+
+#include "test.hpp"
+
+#include <string>
+
+using namespace testing;
+
+TEST(string_pool, Intern)
+{
+    mabo::string_pool pool;
+
+    mabo::string_pool::id_type f1 = pool.intern("f1");
+    mabo::string_pool::id_type g1 = pool.intern("g1");
+
+    EXPECT_THAT(f1, Ne(g1));
+    EXPECT_THAT(pool.intern(std::string("f1")), Eq(f1));
+    EXPECT_THAT(pool.find("g1"), Eq(g1));
+    EXPECT_THAT(pool.find("h1") == mabo::string_pool::npos, Eq(true));
+
+    EXPECT_THAT(pool[f1], Eq("f1"));
+    EXPECT_THAT(pool[g1].data()[2], Eq('\0'));
+    EXPECT_THAT(pool.hash(g1), Eq(mabo::string_pool::hash_of("g1")));
+    EXPECT_THAT(pool.size(), Eq(2u));
+}
+
+TEST(string_pool, Grow)
+{
+    mabo::string_pool pool;
+
+    std::vector<mabo::string_view> views;
+    for(int i = 0; i != 100000; ++i)
+        views.push_back(pool[pool.intern("symbol" + std::to_string(i))]);
+
+    // views survive rehashing and new arena chunks
+    for(int i = 0; i != 100000; ++i)
+    {
+        ASSERT_THAT(views[i], Eq("symbol" + std::to_string(i)));
+        ASSERT_THAT(pool.find(views[i]), Eq(mabo::string_pool::id_type(i)));
+    }
+
+    std::string large(1 << 20, 'x');
+    EXPECT_THAT(pool[pool.intern(large)], Eq(large));
+}
+
+TEST(string_pool, Concurrent)
+{
+    mabo::string_pool pool;
+
+    // every thread interns the same names, each must get a single dense id
+    std::vector<mabo::string_pool::id_type> ids(8 * 10000);
+    mabo::parallel_for(ids.size(), 8, [&](size_t i)
+    {
+        ids[i] = pool.intern("symbol" + std::to_string(i % 10000));
+    });
+
+    EXPECT_THAT(pool.size(), Eq(10000u));
+    for(size_t i = 0; i != ids.size(); ++i)
+    {
+        ASSERT_THAT(ids[i], Lt(10000u));
+        ASSERT_THAT(ids[i], Eq(ids[i % 10000]));
+        ASSERT_THAT(pool[ids[i]], Eq("symbol" + std::to_string(i % 10000)));
+    }
+}
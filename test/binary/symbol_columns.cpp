@@ -0,0 +1,143 @@
+#include <mabo/symbol_columns.hpp>
+#include <mabo/compact.hpp>
+
+#include "test.hpp"
+#include "chdir.hpp"
+
+using namespace testing;
+
+std::vector<std::string> selected(mabo::symbol_columns const& columns, mabo::symbol_filter const& filter, size_t threads = 1)
+{
+    std::vector<std::string> result;
+    for(uint32_t i : columns.select(filter, threads))
+        result.push_back(columns.name(i).to_string());
+    return result;
+}
+
+TEST(symbol_columns, Select)
+{
+    mabo::symbol_columns columns;
+    for(char const* file : {"main.cpp.o", "libtests.a", "test_exe_shared"})
+    {
+        mabo::binary bin(file);
+        for(mabo::object const& obj : bin.objects())
+            columns.add(obj);
+    }
+
+    mabo::symbol_filter all;
+    EXPECT_THAT(columns.count(all), Eq(columns.size()));
+
+    mabo::symbol_filter functions;
+    functions.binds = mabo::bind_bit(STB_GLOBAL);
+    functions.types = mabo::type_bit(STT_FUNC);
+    functions.section = ".text";
+    functions.min_size = 1;
+    functions.imports = false;
+    EXPECT_THAT(selected(columns, functions), IsSupersetOf({"main", "g1", "g2", "f1"}));
+    EXPECT_THAT(selected(columns, functions), Not(Contains("_IO_stdin_used")));
+
+    for(uint32_t i : columns.select(functions))
+    {
+        EXPECT_THAT(columns.section(i), Eq(".text"));
+        EXPECT_THAT(columns.type(i), Eq(unsigned(STT_FUNC)));
+        EXPECT_THAT(columns.bind(i), Eq(unsigned(STB_GLOBAL)));
+        EXPECT_THAT(columns.sizes[i], Gt(0u));
+    }
+
+    mabo::symbol_filter imports;
+    imports.defined = false;
+    EXPECT_THAT(selected(columns, imports), IsSupersetOf({"f1", "f2", "g1", "__libc_start_main"}));
+
+    mabo::symbol_filter missing;
+    missing.section = ".nonexistent";
+    EXPECT_THAT(columns.count(missing), Eq(0u));
+}
+
+TEST(symbol_columns, Threads)
+{
+    // enough symbols for many blocks
+    mabo::symbol_columns columns;
+    mabo::binary bin("test_exe_shared");
+    for(int i = 0; i != 1000; ++i)
+        for(mabo::object const& obj : bin.objects())
+            columns.add(obj);
+    ASSERT_THAT(columns.size(), Gt(8192u));
+
+    mabo::symbol_filter weak;
+    weak.binds = mabo::bind_bit(STB_WEAK);
+    EXPECT_THAT(columns.select(weak, 4), ContainerEq(columns.select(weak, 1)));
+    EXPECT_THAT(columns.select(weak, 4).size(), Eq(columns.count(weak)));
+}
+
+TEST(symbol_columns, Compact)
+{
+    mabo::symbol_columns live;
+    mabo::symbol_columns compact;
+    mabo::binary bin("libtests.a");
+    for(mabo::object const& obj : bin.objects())
+        live.add(obj);
+    mabo::compact_binary snapshot(bin);
+    for(mabo::compact_object obj : snapshot.objects())
+        compact.add(obj);
+
+    EXPECT_THAT(compact.addrs, ContainerEq(live.addrs));
+    EXPECT_THAT(compact.sizes, ContainerEq(live.sizes));
+    EXPECT_THAT(compact.binds, ContainerEq(live.binds));
+    EXPECT_THAT(compact.types, ContainerEq(live.types));
+    EXPECT_THAT(compact.strings, ContainerEq(live.strings));
+}
+
+TEST(symbol_columns, Locals)
+{
+    mabo::symbol_columns columns;
+    mabo::binary bin("gc.o");
+    for(mabo::object const& obj : bin.objects())
+        columns.add(obj);
+
+    mabo::symbol_filter statics;
+    statics.binds = mabo::bind_bit(STB_LOCAL);
+    statics.types = mabo::type_bit(STT_FUNC);
+    EXPECT_THAT(selected(columns, statics), Contains("_ZL7throweri"));
+    EXPECT_THAT(selected(columns, statics), Not(Contains("main")));
+
+    for(uint32_t i : columns.select(statics))
+        EXPECT_THAT(columns.bind(i), Eq(unsigned(STB_LOCAL)));
+}
+
+TEST(symbol_columns, Scan)
+{
+    mabo::symbol_columns columns;
+    for(char const* file : {"main.cpp.o", "gc.o", "libtests.a", "test_exe_shared"})
+    {
+        mabo::binary bin(file);
+        for(mabo::object const& obj : bin.objects())
+            columns.add(obj);
+    }
+
+    // block tails and sizes on both sides of the bounds, against a plain check
+    std::vector<mabo::symbol_filter> filters(5);
+    filters[0].binds = mabo::bind_bit(STB_LOCAL) | mabo::bind_bit(STB_WEAK);
+    filters[1].types = mabo::type_bit(STT_OBJECT);
+    filters[1].defined = false;
+    filters[2].min_size = 8;
+    filters[2].max_size = 64;
+    filters[3].section = ".text";
+    filters[3].max_size = 0;
+    filters[4].section = ".text";
+    filters[4].min_size = uint64_t(1) << 40;
+
+    for(mabo::symbol_filter const& f : filters)
+    {
+        std::vector<uint32_t> expected;
+        for(uint32_t i = 0; i != columns.size(); ++i)
+        {
+            uint8_t want = (f.defined ? mabo::symbol_columns::DEFINED : 0) | (f.imports ? mabo::symbol_columns::IMPORT : 0);
+            if((columns.binds[i] & f.binds) && (columns.types[i] & f.types) && (columns.flags[i] & want)
+            && columns.sizes[i] >= f.min_size && columns.sizes[i] <= f.max_size
+            && (f.section.empty() || columns.section(i) == f.section))
+                expected.push_back(i);
+        }
+        EXPECT_THAT(columns.select(f), ContainerEq(expected));
+        EXPECT_THAT(columns.count(f), Eq(expected.size()));
+    }
+}
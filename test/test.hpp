@@ -13,4 +13,19 @@ void PrintTo(const mabo::string_view& bar, ::std::ostream* os) {
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
+#include <stdlib.h>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+// a fresh directory for what a test writes, under TMPDIR
+inline std::string temp_dir()
+{
+    char const* tmp = std::getenv("TMPDIR");
+    std::string path = std::string(tmp && *tmp ? tmp : "/tmp") + "/mabo-test-XXXXXX";
+    if(!::mkdtemp(&path[0]))
+        throw std::runtime_error("cannot create a temporary directory");
+    return path;
+}
+
 #endif